@@ -9,6 +9,7 @@
 #ifndef KLEE_INTERPRETER_H
 #define KLEE_INTERPRETER_H
 
+#include <cstddef>
 #include <cstdint>
 #include <map>
 #include <memory>
@@ -51,6 +52,25 @@ public:
   virtual void processTestCase(const ExecutionState &state,
                                const char *err,
                                const char *suffix) = 0;
+
+  enum class Coverage { Instruction, TrueBranch, FalseBranch };
+
+  /// Called the first time this process covers an instruction or a branch
+  /// direction. Returns false if it already counts as covered, e.g. by
+  /// another process exploring the same program, so that the state covering
+  /// it does not count as covering anything new.
+  virtual bool claimCoverage(unsigned instructionId, Coverage what) {
+    return true;
+  }
+
+  /// Called periodically while exploring under a path prefix with the
+  /// number of pending states. Returns true to have the shallowest of them
+  /// handed over through donatePath instead of being explored here.
+  virtual bool wantsStateDonation(std::size_t pendingStates) { return false; }
+
+  /// Receives the branch decisions leading to a state dropped from this
+  /// run. Exploring them as a path prefix covers the state's subtree.
+  virtual void donatePath(const std::vector<bool> &path) {}
 };
 
 class Interpreter {
@@ -88,8 +108,12 @@ public:
     /// symbolic execution on concrete programs.
     unsigned MakeConcreteSymbolic;
 
+    /// Periodically offer states to the InterpreterHandler so they can be
+    /// explored elsewhere (see InterpreterHandler::wantsStateDonation).
+    bool DonateStates;
+
     InterpreterOptions()
-      : MakeConcreteSymbolic(false)
+      : MakeConcreteSymbolic(false), DonateStates(false)
     {}
   };
 
@@ -133,11 +157,21 @@ public:
   // a user specified path. use null to reset.
   virtual void setReplayPath(const std::vector<bool> *path) = 0;
 
+  // supply a list of branch decisions that every state starts with, and
+  // beyond which states are explored as usual. this restricts exploration
+  // to the subtree below the given path, see
+  // InterpreterHandler::donatePath. use null to reset.
+  virtual void setPathPrefix(const std::vector<bool> *prefix) = 0;
+
   // virtual void setTargetFunction(const std::string &targetNodeId) = 0;
   virtual void setDistMap(const std::unordered_map<const llvm::Instruction*, size_t>
 			  *distMap) = 0;
   virtual void setBlackList(const std::unordered_set<const llvm::Instruction*>
 			    *blackList) = 0;
+  // supply the paths to the target found by reach, as the first instruction
+  // of each node on the path. these guide --search=resolve-path.
+  virtual void setReachPaths(const std::vector<std::vector<const llvm::Instruction*>>
+			     *paths) = 0;
 
   // supply a set of symbolic bindings that will be used as "seeds"
   // for the search. use null to reset.
@@ -12,8 +12,12 @@
 
 #include "klee/Expr/Expr.h"
 
+#include <memory>
+
 namespace klee {
 
+class ConstraintPartition;
+
 /// Resembles a set of constraints that can be passed around
 ///
 class ConstraintSet {
@@ -36,12 +40,26 @@ public:
 
   void push_back(const ref<Expr> &e);
 
+  /// Collects the constraints that read an array byte \p e reads, directly
+  /// or through other constraints, in the order they were added. These are
+  /// the constraints a query on \p e depends on.
+  ///
+  /// \return false if the set does not track its independent subsets,
+  /// which is the case for sets built from a vector of constraints.
+  bool getIndependentConstraints(const ref<Expr> &e,
+                                 constraints_ty &result) const;
+
   bool operator==(const ConstraintSet &b) const {
     return constraints == b.constraints;
   }
 
 private:
   constraints_ty constraints;
+
+  /// The independent subsets of the constraints, updated as constraints
+  /// are added. Copies of the set share it until one of them adds a
+  /// constraint, and then share most of its contents.
+  std::shared_ptr<ConstraintPartition> partition;
 };
 
 class ExprVisitor;
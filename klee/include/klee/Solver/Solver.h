@@ -241,6 +241,19 @@ namespace klee {
   /// \param s - The underlying solver to use.
   std::unique_ptr<Solver> createCexCachingSolver(std::unique_ptr<Solver> s);
 
+  /// createPersistentCachingSolver - Create a solver which will cache the
+  /// results of the underlying solver in a file shared between runs and
+  /// between concurrent processes. Queries are keyed by their structure, with
+  /// arrays numbered instead of named.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, created if it does not exist.
+  /// \param maxSize - The size in bytes beyond which the oldest half of the
+  /// cache is dropped, or 0 to let it grow without bound.
+  std::unique_ptr<Solver>
+  createPersistentCachingSolver(std::unique_ptr<Solver> s,
+                                const std::string &path, uint64_t maxSize);
+
   /// createFastCexSolver - Create a "fast counterexample solver", which tries
   /// to quickly compute a satisfying assignment for a constraint set using
   /// value propogation and range analysis.
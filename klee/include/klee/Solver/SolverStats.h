@@ -24,7 +24,10 @@ namespace stats {
   extern Statistic queryCacheMisses;
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
+  extern Statistic queryPersistentCacheHits;
+  extern Statistic queryPersistentCacheMisses;
   extern Statistic queryConstructs;
+  extern Statistic queryConstructTime;
   extern Statistic queryCounterexamples;
   extern Statistic queryTime;
   
@@ -38,6 +38,14 @@ namespace stats {
   /// Number of inhibited forks.
   extern Statistic inhibitedForks;
 
+  /// Number of branch successors dropped at fork time because they cannot
+  /// reach the target, each saving the state that would have been forked.
+  extern Statistic prunedBranches;
+
+  /// Number of branch feasibility queries skipped by pruning successors that
+  /// cannot reach the target.
+  extern Statistic prunedQueries;
+
   /// Number of states, this is a "fake" statistic used by istats, it
   /// isn't normally up-to-date.
   extern Statistic states;
@@ -63,6 +63,7 @@ StackFrame::StackFrame(const StackFrame &s)
     callPathNode(s.callPathNode),
     allocas(s.allocas),
     minDistToUncoveredOnReturn(s.minDistToUncoveredOnReturn),
+    minDistToTargetOnReturn(s.minDistToTargetOnReturn),
     varargs(s.varargs) {
   locals = new Cell[s.kf->numRegisters];
   for (unsigned i=0; i<s.kf->numRegisters; i++)
@@ -134,8 +135,13 @@ ExecutionState *ExecutionState::branch() {
   return falseState;
 }
 
-void ExecutionState::pushFrame(KInstIterator caller, KInstIterator resume_pc, KFunction *kf) {
+void ExecutionState::pushFrame(KInstIterator caller, KInstIterator resume_pc,
+                               KFunction *kf, std::size_t resumeDistance) {
+  if (!stack.empty())
+    resumeDistance =
+        std::min(resumeDistance, stack.back().minDistToTargetOnReturn);
   stack.emplace_back(StackFrame(caller, resume_pc, kf));
+  stack.back().minDistToTargetOnReturn = resumeDistance;
 }
 
 void ExecutionState::popFrame() {
@@ -23,6 +23,7 @@
 #include "klee/Solver/Solver.h"
 #include "klee/System/Time.h"
 
+#include <limits>
 #include <map>
 #include <memory>
 #include <set>
@@ -40,6 +41,10 @@ struct InstructionInfo;
 
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const MemoryMap &mm);
 
+/// Distance to the RESOLVE target of instructions that cannot reach it
+constexpr std::size_t UnreachableDistance =
+    std::numeric_limits<std::size_t>::max();
+
 struct StackFrame {
   KInstIterator caller;
   KInstIterator resume_pc;
@@ -57,6 +62,12 @@ struct StackFrame {
   /// periodically.
   unsigned minDistToUncoveredOnReturn;
 
+  /// Minimum distance to the RESOLVE target over the resume points of this
+  /// frame and of all frames below it, or UnreachableDistance if no caller
+  /// can still reach the target once this function returns. Set when the
+  /// frame is pushed, so it stays valid as frames are popped.
+  std::size_t minDistToTargetOnReturn = UnreachableDistance;
+
   // For vararg functions: arguments not passed via parameter are
   // stored (packed tightly) in a local (alloca) memory object. This
   // is set up to match the way the front-end generates vaarg code (it
@@ -275,7 +286,8 @@ public:
 
   ExecutionState *branch();
 
-  void pushFrame(KInstIterator caller, KInstIterator resume_pc, KFunction *kf);
+  void pushFrame(KInstIterator caller, KInstIterator resume_pc, KFunction *kf,
+                 std::size_t resumeDistance = UnreachableDistance);
   void popFrame();
 
   void deallocate(const MemoryObject *mo);
@@ -499,7 +499,8 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
     : Interpreter(opts), interpreterHandler(ih), searcher(0),
       externalDispatcher(new ExternalDispatcher(ctx)), statsTracker(0),
       pathWriter(0), symPathWriter(0), specialFunctionHandler(0), timers{time::Span(TimerInterval)},
-      replayKTest(0), replayPath(0), usingSeeds(0), distMap(0), blackList(0),
+      replayKTest(0), replayPath(0), replayPathIsPrefix(false), usingSeeds(0),
+      blackList(0),
       atMemoryLimit(false), inhibitForking(false), haltExecution(false),
       ivcEnabled(false), debugLogBuffer(debugBufferString) {
 
@@ -511,6 +512,10 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
         setHaltExecution(true);
       }));
 
+  if (interpreterOpts.DonateStates)
+    timers.add(std::make_unique<Timer>(time::Span(TimerInterval),
+                                       [&] { donateState(); }));
+
   coreSolverTimeout = time::Span{MaxCoreSolverTime};
   if (coreSolverTimeout) UseForkedCoreSolver = true;
   std::unique_ptr<Solver> coreSolver = klee::createCoreSolver(CoreSolverToUse);
@@ -930,7 +935,27 @@ void Executor::branch(ExecutionState &state,
   unsigned N = conditions.size();
   assert(N);
 
-  if (!branchingPermitted(state)) {
+  // In path prefix mode the chosen condition is recorded in the path as
+  // its index, in just enough bits for N
+  unsigned indexBits = 0;
+  if (replayPathIsPrefix)
+    while ((1u << indexBits) < N)
+      ++indexBits;
+
+  if (replayingPath() && indexBits) {
+    unsigned next = 0;
+    for (unsigned i = 0;
+         i < indexBits && replayPosition < replayPath->size(); ++i)
+      next = (next << 1) | (*replayPath)[replayPosition++];
+    if (next >= N) {
+      klee_warning_once(replayPath, "path prefix diverged, dropping states");
+      terminateState(state, StateTerminationType::Replay);
+      result.assign(N, nullptr);
+      return;
+    }
+    for (unsigned i=0; i<N; ++i)
+      result.push_back(i == next ? &state : nullptr);
+  } else if (!branchingPermitted(state)) {
     unsigned next = theRNG.getInt32() % N;
     for (unsigned i=0; i<N; ++i) {
       if (i == next) {
@@ -952,9 +977,20 @@ void Executor::branch(ExecutionState &state,
       addedStates.push_back(ns);
       result.push_back(ns);
       executionTree->attach(es->executionTreeNode, ns, es, reason);
+      if (pathWriter)
+        ns->pathOS = pathWriter->open(es->pathOS);
+      if (symPathWriter)
+        ns->symPathOS = symPathWriter->open(es->symPathOS);
     }
   }
 
+  if (pathWriter && indexBits) {
+    for (unsigned i=0; i<N; ++i)
+      if (result[i])
+        for (unsigned bit = indexBits; bit--;)
+          result[i]->pathOS << (((i >> bit) & 1) ? "1" : "0");
+  }
+
   // If necessary redistribute seeds to match conditions, killing
   // states if necessary due to OnlyReplaySeeds (inefficient but
   // simple).
@@ -1086,11 +1122,21 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
     return StatePair(nullptr, nullptr);
   }
 
+  // Internal forks are only part of the path in path prefix mode
+  bool recordBranch = !isInternal || replayPathIsPrefix;
+
   if (!isSeeding) {
-    if (replayPath && !isInternal) {
+    if (replayingPath() && recordBranch) {
       assert(replayPosition<replayPath->size() &&
              "ran out of branches in replay path mode");
       bool branch = (*replayPath)[replayPosition++];
+
+      if (replayPathIsPrefix && res != Solver::Unknown &&
+          branch != (res == Solver::True)) {
+        klee_warning_once(replayPath, "path prefix diverged, dropping states");
+        terminateState(current, StateTerminationType::Replay);
+        return StatePair(nullptr, nullptr);
+      }
       
       if (res==Solver::True) {
         assert(branch && "hit invalid branch in replay path mode");
@@ -1163,7 +1209,7 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
   // hint to just use the single constraint instead of all the binary
   // search ones. If that makes sense.
   if (res==Solver::True) {
-    if (!isInternal) {
+    if (recordBranch) {
       if (pathWriter) {
         current.pathOS << "1";
       }
@@ -1171,7 +1217,7 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
 
     return StatePair(&current, nullptr);
   } else if (res==Solver::False) {
-    if (!isInternal) {
+    if (recordBranch) {
       if (pathWriter) {
         current.pathOS << "0";
       }
@@ -1229,7 +1275,7 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
       // Need to update the pathOS.id field of falseState, otherwise the same id
       // is used for both falseState and trueState.
       falseState->pathOS = pathWriter->open(current.pathOS);
-      if (!isInternal) {
+      if (recordBranch) {
         trueState->pathOS << "1";
         falseState->pathOS << "0";
       }
@@ -1675,7 +1721,8 @@ void Executor::unwindToNextLandingpad(ExecutionState &state) {
             kmodule->module->getFunction("_klee_eh_cxx_personality");
         KFunction *kf = kmodule->functionMap[personality_fn];
 
-        state.pushFrame(state.prevPC, state.pc, kf);
+        state.pushFrame(state.prevPC, state.pc, kf,
+                        getTargetDistance(state.pc));
         state.pc = kf->instructions;
         bindArgument(kf, 0, state, sui->exceptionObject);
         bindArgument(kf, 1, state, clauses_mo->getSizeExpr());
@@ -1974,7 +2021,7 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
     // from just an instruction (unlike LLVM).
     KFunction *kf = kmodule->functionMap[f];
 
-    state.pushFrame(state.prevPC, state.pc, kf);
+    state.pushFrame(state.prevPC, state.pc, kf, getTargetDistance(state.pc));
     state.pc = kf->instructions;
 
     if (statsTracker)
@@ -2092,6 +2139,53 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
   }
 }
 
+bool Executor::cannotReachTarget(const BasicBlock *dst,
+                                 const ExecutionState &state) const {
+  // Seeded states must follow their seeds, wherever they lead
+  if (!blackList || seedMap.count(const_cast<ExecutionState *>(&state)))
+    return false;
+
+  return blackList->count(&dst->front()) &&
+         state.stack.back().minDistToTargetOnReturn == UnreachableDistance;
+}
+
+void Executor::setDistMap(
+    const std::unordered_map<const llvm::Instruction *, size_t> *distMap) {
+  targetDistances.assign(kmodule->infos->getMaxID(), UnreachableDistance);
+  for (auto &kfp : kmodule->functions) {
+    KFunction *kf = kfp.get();
+    for (unsigned i = 0; i < kf->numInstructions; ++i) {
+      KInstruction *ki = kf->instructions[i];
+      auto it = distMap->find(ki->inst);
+      if (it != distMap->end())
+        targetDistances[ki->info->id] = it->second;
+    }
+  }
+}
+
+void Executor::setReachPaths(
+    const std::vector<std::vector<const llvm::Instruction *>> *paths) {
+  std::unordered_map<const llvm::Instruction *, KInstruction *> kinstructions;
+  for (auto &kfp : kmodule->functions) {
+    KFunction *kf = kfp.get();
+    for (unsigned i = 0; i < kf->numInstructions; ++i)
+      kinstructions[kf->instructions[i]->inst] = kf->instructions[i];
+  }
+
+  for (const auto &path : *paths) {
+    std::vector<KInstruction *> kpath;
+    for (const llvm::Instruction *inst : path) {
+      auto it = kinstructions.find(inst);
+      // A function and its entry block start at the same instruction
+      if (it != kinstructions.end() &&
+          (kpath.empty() || kpath.back() != it->second))
+        kpath.push_back(it->second);
+    }
+    if (!kpath.empty())
+      targetPaths.push_back(std::move(kpath));
+  }
+}
+
 void Executor::transferToBasicBlock(BasicBlock *dst, BasicBlock *src, 
                                     ExecutionState &state) {
   // Note that in general phi nodes can reuse phi values from the same
@@ -2106,56 +2200,23 @@ void Executor::transferToBasicBlock(BasicBlock *dst, BasicBlock *src,
   // With that done we simply set an index in the state so that PHI
   // instructions know which argument to eval, set the pc, and continue.
 
-  const Instruction *instr = &dst->front();
-  if (distMap && distMap->find(instr) == distMap->end()) {
-    // std::cout << "stack.size() = " << state.stack.size() << std::endl;
-    for (const auto& frame : state.stack) {
-      if (frame.resume_pc &&
-	  distMap->find(frame.resume_pc->inst) != distMap->end()) {
-	goto cont;
-      }
-    }
+  // XXX this lookup has to go ?
+  KFunction *kf = state.stack.back().kf;
+  unsigned entry = kf->basicBlockEntry[dst];
+
+  // Prune states that can no longer reach the target, neither from this
+  // block nor after returning to one of their callers
+  if (!targetDistances.empty() &&
+      getTargetDistance(kf->instructions[entry]) == UnreachableDistance &&
+      state.stack.back().minDistToTargetOnReturn == UnreachableDistance) {
     const auto bb_id = resolve::facts.addNode(*dst);
 
     klee_warning(("pruning state: " + std::to_string(bb_id)).c_str());
 
-    // For debugging
-    // std::cout << "call stack: " << std::endl;
-    // for (const auto& frame : state.stack) {
-    //   if (frame.caller) {
-    // 	std::string name;
-    // 	llvm::raw_string_ostream stream(name);
-    // 	frame.caller->inst->getParent()->printAsOperand(stream, false);
-    // 	std::cout << "caller BB label: " << name << std::endl;
-    // 	std::string callerStr;
-    // 	llvm::raw_string_ostream rso(callerStr);
-    // 	rso << *frame.caller->inst;
-    // 	rso.flush(); // Ensure all data is written to the string
-    // 	// Now, callerStr contains the pretty-printed instruction
-    // 	std::cout << "caller instruction: " << callerStr << std::endl;
-    //   } else {
-    // 	std::cout << "no caller" << std::endl;
-    //   }
-    //   if (frame.resume_pc) {
-    // 	std::string resumeStr;
-    // 	llvm::raw_string_ostream rso(resumeStr);
-    // 	rso << *frame.resume_pc->inst;
-    // 	rso.flush();
-    // 	std::cout << "resume instruction: " << resumeStr << std::endl;
-    //   } else {
-    // 	std::cout << "no resume" << std::endl;
-    //   }
-    // }
-
     terminateStateEarly(state, "Pruning state", StateTerminationType::END);
     return;
-    // }
   }
- cont:
 
-  // XXX this lookup has to go ?
-  KFunction *kf = state.stack.back().kf;
-  unsigned entry = kf->basicBlockEntry[dst];
   state.pc = &kf->instructions[entry];
   if (state.pc->inst->getOpcode() == Instruction::PHI) {
     PHINode *first = static_cast<PHINode*>(state.pc->inst);
@@ -2303,6 +2364,54 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       ref<Expr> cond = eval(ki, 0, state).value;
 
       cond = optimizer.optimizeExpr(cond, false);
+
+      // Drop successors that cannot reach the target before asking the
+      // solver about them
+      if (!isa<ConstantExpr>(cond) && !replayingPath()) {
+        bool pruneTrue = cannotReachTarget(bi->getSuccessor(0), state);
+        bool pruneFalse = cannotReachTarget(bi->getSuccessor(1), state);
+        if (pruneTrue && pruneFalse) {
+          stats::prunedBranches += 2;
+          ++stats::prunedQueries;
+          terminateStateEarly(state, "Pruning state", StateTerminationType::END);
+          break;
+        }
+
+        if (pruneTrue || pruneFalse) {
+          ref<Expr> liveCond = pruneTrue ? Expr::createIsZero(cond) : cond;
+          Solver::Validity res;
+          solver->setTimeout(coreSolverTimeout);
+          bool success = solver->evaluate(state.constraints, liveCond, res,
+                                          state.queryMetaData);
+          solver->setTimeout(time::Span());
+          if (!success) {
+            state.pc = state.prevPC;
+            terminateStateOnSolverError(state, "Query timed out (fork).");
+            break;
+          }
+
+          ++stats::prunedBranches;
+          ++stats::prunedQueries;
+          if (res == Solver::False) {
+            terminateStateEarly(state, "Pruning state", StateTerminationType::END);
+            break;
+          }
+
+          // Nothing to record when the path already implies the live successor
+          if (res == Solver::Unknown)
+            addConstraint(state, liveCond);
+          if (pathWriter)
+            state.pathOS << (pruneTrue ? "0" : "1");
+          if (statsTracker && state.stack.back().kf->trackCoverage)
+            statsTracker->markBranchVisited(pruneTrue ? nullptr : &state,
+                                            pruneTrue ? &state : nullptr);
+
+          transferToBasicBlock(bi->getSuccessor(pruneTrue ? 1 : 0),
+                               bi->getParent(), state);
+          break;
+        }
+      }
+
       Executor::StatePair branches = fork(state, cond, false, BranchType::Conditional);
 
       // NOTE: There is a hidden dependency here, markBranchVisited
@@ -2380,7 +2489,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     // terminate error state
     if (result) {
-      terminateStateOnExecError(*branches.back(), "indirectbr: illegal label address");
+      if (branches.back())
+        terminateStateOnExecError(*branches.back(), "indirectbr: illegal label address");
       branches.pop_back();
     }
 
@@ -2444,6 +2554,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         // Make sure that the default value does not contain this target's value
         defaultValue = AndExpr::create(defaultValue, Expr::createIsZero(match));
 
+        // Cases that cannot reach the target need no feasibility query
+        if (cannotReachTarget(it->second, state)) {
+          ++stats::prunedBranches;
+          ++stats::prunedQueries;
+          continue;
+        }
+
         // Check if control flow could take this case
         bool result;
         match = optimizer.optimizeExpr(match, false);
@@ -2475,11 +2592,16 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
       // Check if control could take the default case
       defaultValue = optimizer.optimizeExpr(defaultValue, false);
-      bool res;
-      bool success = solver->mayBeTrue(state.constraints, defaultValue, res,
-                                       state.queryMetaData);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
+      bool res = false;
+      if (cannotReachTarget(si->getDefaultDest(), state)) {
+        ++stats::prunedBranches;
+        ++stats::prunedQueries;
+      } else {
+        bool success = solver->mayBeTrue(state.constraints, defaultValue, res,
+                                         state.queryMetaData);
+        assert(success && "FIXME: Unhandled solver failure");
+        (void) success;
+      }
       if (res) {
         std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> ret =
             branchTargets.insert(
@@ -2497,6 +2619,11 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
            it != ie; ++it) {
         conditions.push_back(branchTargets[*it]);
       }
+      if (conditions.empty()) {
+        terminateStateEarly(state, "Pruning state", StateTerminationType::END);
+        break;
+      }
+
       std::vector<ExecutionState*> branches;
       branch(state, conditions, branches, BranchType::Switch);
 
@@ -3883,6 +4010,38 @@ void Executor::terminateState(ExecutionState &state,
   }
 }
 
+void Executor::donateState() {
+  // States can only be handed over by their recorded path once they are
+  // past the prefix, and only from the main search loop
+  // Timers fire before updateStates(), so states terminated by the last
+  // instruction are still in `states` and must not be handed over
+  std::size_t pending = states.size() - removedStates.size();
+  bool wanted = interpreterHandler->wantsStateDonation(pending);
+  if (!wanted || !searcher || !pathWriter || !replayPathIsPrefix ||
+      replayingPath() || pending < 2)
+    return;
+
+  // The shallowest state roots the largest unexplored subtree
+  ExecutionState *donated = nullptr;
+  for (ExecutionState *es : states) {
+    if (std::find(removedStates.begin(), removedStates.end(), es) !=
+        removedStates.end())
+      continue;
+    if (!donated || es->depth < donated->depth)
+      donated = es;
+  }
+
+  std::vector<unsigned char> decisions;
+  pathWriter->readStream(getPathStreamID(*donated), decisions);
+  std::vector<bool> path;
+  path.reserve(decisions.size());
+  for (unsigned char decision : decisions)
+    path.push_back(decision == '1');
+
+  interpreterHandler->donatePath(path);
+  terminateState(*donated, StateTerminationType::Interrupted);
+}
+
 static bool shouldWriteTest(const ExecutionState &state) {
   return !OnlyOutputStatesCoveringNew || state.coveredNew;
 }
@@ -4836,6 +4995,10 @@ void Executor::runFunctionAsMain(Function *f,
 				 int argc,
 				 char **argv,
 				 char **envp) {
+  // The memory objects of a previous run were dropped at its end
+  if (!memory)
+    memory = std::make_unique<MemoryManager>(&arrayCache);
+
   std::vector<ref<Expr> > arguments;
 
   // force deterministic initialization of memory objects
@@ -156,6 +156,12 @@ private:
   /// When non-null a list of branch decisions to be used for replay.
   const std::vector<bool> *replayPath;
 
+  /// Whether \ref replayPath is only a prefix that states explore freely
+  /// beyond. In this mode every fork, including internal ones and
+  /// multi-way branches, is recorded in and replayed from the path, so
+  /// that the recorded path of any state identifies its subtree.
+  bool replayPathIsPrefix;
+
   /// The index into the current \ref replayKTest or \ref replayPath
   /// object.
   unsigned replayPosition;
@@ -165,7 +171,13 @@ private:
   const std::vector<struct KTest *> *usingSeeds;
 
   // std::string targetNodeId;
-  const std::unordered_map<const llvm::Instruction*, size_t> *distMap;
+  /// Distance of each instruction to the RESOLVE target, indexed by the id
+  /// of its KInstruction. Empty if no target was given.
+  std::vector<std::size_t> targetDistances;
+
+  /// Paths to the RESOLVE target found by reach, as the first instruction of
+  /// each node on the path. Empty if no paths were given.
+  std::vector<std::vector<KInstruction *>> targetPaths;
   const std::unordered_set<const llvm::Instruction*> *blackList;
 
   /// Disables forking, instead a random path is chosen. Enabled as
@@ -241,6 +253,19 @@ private:
 			    llvm::BasicBlock *src,
 			    ExecutionState &state);
 
+  /// Returns true if entering `dst` can no longer lead `state` to the target:
+  /// the block is blacklisted and no stack frame resumes at an instruction
+  /// that reaches the target. Such successors are dropped at fork time,
+  /// without a feasibility query or a state of their own.
+  bool cannotReachTarget(const llvm::BasicBlock *dst,
+                         const ExecutionState &state) const;
+
+  /// Returns the distance of `ki` to the target, or UnreachableDistance
+  std::size_t getTargetDistance(const KInstruction *ki) const {
+    return targetDistances.empty() ? UnreachableDistance
+                                   : targetDistances[ki->info->id];
+  }
+
   void callExternalFunction(ExecutionState &state,
                             KInstruction *target,
                             KCallable *callable,
@@ -424,6 +449,17 @@ private:
   /// used in the termination functions below.
   void terminateState(ExecutionState &state, StateTerminationType reason);
 
+  /// Whether forks are still dictated by \ref replayPath.
+  bool replayingPath() const {
+    return replayPath &&
+           (!replayPathIsPrefix || replayPosition < replayPath->size());
+  }
+
+  /// Hand the shallowest pending state over to the interpreter handler if
+  /// it asks for one, as the branch decisions leading to it, and drop it
+  /// from this run. Only possible in path prefix mode.
+  void donateState();
+
   /// Call exit handler and terminate state normally
   /// (end of execution path)
   void terminateStateOnExit(ExecutionState &state);
@@ -538,18 +574,27 @@ public:
     assert(!replayKTest && "cannot replay both buffer and path");
     replayPath = path;
     replayPosition = 0;
+    replayPathIsPrefix = false;
   }
 
-  void setDistMap(const std::unordered_map<const llvm::Instruction*, size_t> *distMap)
-    override {
-    this->distMap = distMap;
+  void setPathPrefix(const std::vector<bool> *prefix) override {
+    assert(!replayKTest && "cannot replay both buffer and path");
+    replayPath = prefix;
+    replayPosition = 0;
+    replayPathIsPrefix = prefix != nullptr;
   }
 
+  void setDistMap(const std::unordered_map<const llvm::Instruction*, size_t> *distMap)
+    override;
+
   void setBlackList(const std::unordered_set<const llvm::Instruction*> *blackList)
     override {
     this->blackList = blackList;
   }
 
+  void setReachPaths(const std::vector<std::vector<const llvm::Instruction*>> *paths)
+    override;
+
   llvm::Module *setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
                           const ModuleOptions &opts) override;
 
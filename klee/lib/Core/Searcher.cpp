@@ -36,6 +36,8 @@ DISABLE_WARNING_POP
 
 #include <cassert>
 #include <cmath>
+#include <limits>
+#include <tuple>
 
 using namespace klee;
 using namespace llvm;
@@ -255,6 +257,192 @@ void WeightedRandomSearcher::printName(llvm::raw_ostream &os) {
 }
 
 
+///
+
+bool DistanceSearcher::Entry::operator<(const Entry &other) const {
+  return std::tie(distance, instsSinceCovNew, id) <
+         std::tie(other.distance, other.instsSinceCovNew, other.id);
+}
+
+DistanceSearcher::DistanceSearcher(
+    const std::vector<std::size_t> &targetDistances)
+  : targetDistances(targetDistances), startTime(time::getWallTime()) {
+  if (targetDistances.empty())
+    klee_warning("--search=resolve-dist without a target, "
+                 "selecting states by coverage only");
+}
+
+/// Returns the distance of `state` to the target, either from its next
+/// instruction or after returning to one of its callers
+static std::size_t
+getTargetDistance(const std::vector<std::size_t> &targetDistances,
+                  const ExecutionState &state) {
+  if (targetDistances.empty())
+    return UnreachableDistance;
+
+  return std::min(targetDistances[state.pc->info->id],
+                  state.stack.back().minDistToTargetOnReturn);
+}
+
+/// Returns the instructions since `state` last covered new code, ranking
+/// states that never did behind all others
+static std::uint32_t getInstsSinceCovNew(const ExecutionState &state) {
+  return state.instsSinceCovNew ? state.instsSinceCovNew
+                                : std::numeric_limits<std::uint32_t>::max();
+}
+
+std::size_t DistanceSearcher::getDistance(const ExecutionState &state) const {
+  return getTargetDistance(targetDistances, state);
+}
+
+void DistanceSearcher::insert(ExecutionState *state) {
+  Entry entry{getDistance(*state), getInstsSinceCovNew(*state), state->getID(),
+              state};
+  entries[state] = states.insert(entry).first;
+
+  if (entry.distance == 0 && !reachedTarget) {
+    reachedTarget = true;
+    klee_message("resolve-dist: reached target after %f seconds",
+                 (time::getWallTime() - startTime).toSeconds());
+  }
+}
+
+void DistanceSearcher::remove(ExecutionState *state) {
+  auto it = entries.find(state);
+  assert(it != entries.end() && "invalid state removed");
+  states.erase(it->second);
+  entries.erase(it);
+}
+
+ExecutionState &DistanceSearcher::selectState() {
+  return *states.begin()->state;
+}
+
+void DistanceSearcher::update(ExecutionState *current,
+                              const std::vector<ExecutionState *> &addedStates,
+                              const std::vector<ExecutionState *> &removedStates) {
+  // update current
+  if (current &&
+      std::find(removedStates.begin(), removedStates.end(), current) == removedStates.end()) {
+    remove(current);
+    insert(current);
+  }
+
+  // insert states
+  for (const auto state : addedStates)
+    insert(state);
+
+  // remove states
+  for (const auto state : removedStates)
+    remove(state);
+}
+
+bool DistanceSearcher::empty() {
+  return states.empty();
+}
+
+void DistanceSearcher::printName(llvm::raw_ostream &os) {
+  os << "DistanceSearcher\n";
+}
+
+
+///
+
+bool PathSearcher::Entry::operator<(const Entry &other) const {
+  if (matched != other.matched)
+    return matched > other.matched;
+  return std::tie(distance, instsSinceCovNew, id) <
+         std::tie(other.distance, other.instsSinceCovNew, other.id);
+}
+
+PathSearcher::PathSearcher(const std::vector<std::vector<KInstruction *>> &paths,
+                           const std::vector<std::size_t> &targetDistances)
+  : paths(paths), targetDistances(targetDistances) {
+  if (paths.empty())
+    klee_warning("--search=resolve-path without --reach-paths, "
+                 "selecting states by distance only");
+}
+
+void PathSearcher::advance(const ExecutionState &state,
+                           Progress &progress) const {
+  const KInstruction *pc = state.pc;
+  const llvm::Instruction *inst = pc->inst;
+  bool blockEntry = inst == &inst->getParent()->front();
+
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    std::size_t &matched = progress[i];
+    if (matched == Diverged || matched == paths[i].size())
+      continue;
+
+    const KInstruction *next = paths[i][matched];
+    if (pc == next) {
+      ++matched;
+    } else if (blockEntry &&
+               inst->getFunction() == next->inst->getFunction()) {
+      matched = Diverged;
+    }
+  }
+}
+
+void PathSearcher::insert(ExecutionState *state, Progress progress) {
+  advance(*state, progress);
+
+  std::size_t matched = 0;
+  for (std::size_t nodes : progress) {
+    if (nodes != Diverged)
+      matched = std::max(matched, nodes);
+  }
+
+  Entry entry{matched, getTargetDistance(targetDistances, *state),
+              getInstsSinceCovNew(*state), state->getID(), state};
+  tracked[state] = {std::move(progress), states.insert(entry).first};
+}
+
+void PathSearcher::remove(ExecutionState *state) {
+  auto it = tracked.find(state);
+  assert(it != tracked.end() && "invalid state removed");
+  states.erase(it->second.entry);
+  tracked.erase(it);
+}
+
+ExecutionState &PathSearcher::selectState() {
+  return *states.begin()->state;
+}
+
+void PathSearcher::update(ExecutionState *current,
+                          const std::vector<ExecutionState *> &addedStates,
+                          const std::vector<ExecutionState *> &removedStates) {
+  // new states continue from the progress of the state they branched from
+  Progress inherited(paths.size(), 0);
+  auto it = current ? tracked.find(current) : tracked.end();
+  if (it != tracked.end())
+    inherited = it->second.progress;
+
+  // update current
+  if (it != tracked.end() &&
+      std::find(removedStates.begin(), removedStates.end(), current) == removedStates.end()) {
+    remove(current);
+    insert(current, inherited);
+  }
+
+  // insert states
+  for (const auto state : addedStates)
+    insert(state, inherited);
+
+  // remove states
+  for (const auto state : removedStates)
+    remove(state);
+}
+
+bool PathSearcher::empty() {
+  return states.empty();
+}
+
+void PathSearcher::printName(llvm::raw_ostream &os) {
+  os << "PathSearcher\n";
+}
+
+
 ///
 
 // Check if n is a valid pointer and a node belonging to us
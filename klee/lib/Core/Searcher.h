@@ -18,9 +18,11 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <limits>
 #include <map>
 #include <queue>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 namespace llvm {
@@ -71,7 +73,9 @@ namespace klee {
       NURS_RP,
       NURS_ICnt,
       NURS_CPICnt,
-      NURS_QC
+      NURS_QC,
+      ResolveDist,
+      ResolvePath
     };
   };
 
@@ -157,6 +161,105 @@ namespace klee {
     void printName(llvm::raw_ostream &os) override;
   };
 
+  /// DistanceSearcher selects the state closest to the RESOLVE target, using
+  /// the per-instruction distance map built from the reachability facts. The
+  /// distance of a state is the minimum of the distance of its next
+  /// instruction and of the resume points of its stack frames, so a state in
+  /// a callee that returns towards the target is not penalized. Ties are
+  /// broken in favor of the state that covered new code most recently.
+  ///
+  /// States are kept in an ordered set indexed by state, and the priority of
+  /// the current state is recomputed on every update.
+  class DistanceSearcher final : public Searcher {
+    struct Entry {
+      std::size_t distance;
+      std::uint32_t instsSinceCovNew;
+      std::uint32_t id;
+      ExecutionState *state;
+
+      bool operator<(const Entry &other) const;
+    };
+
+    const std::vector<std::size_t> &targetDistances;
+    std::set<Entry> states;
+    std::unordered_map<ExecutionState *, std::set<Entry>::iterator> entries;
+
+    /// Time the searcher was created, to report the time to reach the target
+    time::Point startTime;
+    bool reachedTarget {false};
+
+    std::size_t getDistance(const ExecutionState &state) const;
+    void insert(ExecutionState *state);
+    void remove(ExecutionState *state);
+
+  public:
+    /// \param targetDistances The distance of each instruction to the target
+    /// by KInstruction id, or empty if no target was given.
+    explicit DistanceSearcher(const std::vector<std::size_t> &targetDistances);
+    ~DistanceSearcher() override = default;
+
+    ExecutionState &selectState() override;
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates) override;
+    bool empty() override;
+    void printName(llvm::raw_ostream &os) override;
+  };
+
+  /// PathSearcher follows the paths from the entry point to the RESOLVE
+  /// target found by reach. Each state records how many nodes of each path it
+  /// passed through in order. A path is dropped for a state once the state
+  /// enters a different block of the function the next node lies in. States
+  /// that matched the longest prefix of any remaining path are selected
+  /// first; states that diverged from all paths fall back to their distance
+  /// to the target, and then to coverage as in DistanceSearcher.
+  class PathSearcher final : public Searcher {
+    struct Entry {
+      std::size_t matched;
+      std::size_t distance;
+      std::uint32_t instsSinceCovNew;
+      std::uint32_t id;
+      ExecutionState *state;
+
+      bool operator<(const Entry &other) const;
+    };
+
+    /// Number of nodes matched on each path, or Diverged
+    using Progress = std::vector<std::size_t>;
+    static constexpr std::size_t Diverged =
+        std::numeric_limits<std::size_t>::max();
+
+    struct TrackedState {
+      Progress progress;
+      std::set<Entry>::iterator entry;
+    };
+
+    const std::vector<std::vector<KInstruction *>> &paths;
+    const std::vector<std::size_t> &targetDistances;
+    std::set<Entry> states;
+    std::unordered_map<ExecutionState *, TrackedState> tracked;
+
+    void advance(const ExecutionState &state, Progress &progress) const;
+    void insert(ExecutionState *state, Progress progress);
+    void remove(ExecutionState *state);
+
+  public:
+    /// \param paths The paths found by reach, as the first instruction of
+    /// each node.
+    /// \param targetDistances The distance of each instruction to the target
+    /// by KInstruction id, or empty if no target was given.
+    PathSearcher(const std::vector<std::vector<KInstruction *>> &paths,
+                 const std::vector<std::size_t> &targetDistances);
+    ~PathSearcher() override = default;
+
+    ExecutionState &selectState() override;
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates) override;
+    bool empty() override;
+    void printName(llvm::raw_ostream &os) override;
+  };
+
   /// RandomPathSearcher performs a random walk of the ExecutionTree to select a
   /// state. ExecutionTree is a global data structure, however, a searcher can
   /// sometimes only select from a subset of all states (depending on the update
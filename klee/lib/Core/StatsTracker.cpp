@@ -359,8 +359,11 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
         // FIXME: This trick no longer works, we should fix this in the line
         // number propogation.
           es.coveredLines[&ii.file].insert(ii.line);
-	es.coveredNew = true;
-        es.instsSinceCovNew = 1;
+        if (executor.interpreterHandler->claimCoverage(
+                ii.id, InterpreterHandler::Coverage::Instruction)) {
+          es.coveredNew = true;
+          es.instsSinceCovNew = 1;
+        }
 	++stats::coveredInstructions;
 	stats::uncoveredInstructions += (uint64_t)-1;
       }
@@ -417,16 +420,22 @@ void StatsTracker::markBranchVisited(ExecutionState *visitedTrue,
     uint64_t hasTrue = theStatisticManager->getIndexedValue(stats::trueBranches, id);
     uint64_t hasFalse = theStatisticManager->getIndexedValue(stats::falseBranches, id);
     if (visitedTrue && !hasTrue) {
-      visitedTrue->coveredNew = true;
-      visitedTrue->instsSinceCovNew = 1;
+      if (executor.interpreterHandler->claimCoverage(
+              id, InterpreterHandler::Coverage::TrueBranch)) {
+        visitedTrue->coveredNew = true;
+        visitedTrue->instsSinceCovNew = 1;
+      }
       ++stats::trueBranches;
       if (hasFalse) { ++fullBranches; --partialBranches; }
       else ++partialBranches;
       hasTrue = 1;
     }
     if (visitedFalse && !hasFalse) {
-      visitedFalse->coveredNew = true;
-      visitedFalse->instsSinceCovNew = 1;
+      if (executor.interpreterHandler->claimCoverage(
+              id, InterpreterHandler::Coverage::FalseBranch)) {
+        visitedFalse->coveredNew = true;
+        visitedFalse->instsSinceCovNew = 1;
+      }
       ++stats::falseBranches;
       if (hasTrue) { ++fullBranches; --partialBranches; }
       else ++partialBranches;
@@ -455,6 +464,7 @@ void StatsTracker::writeStatsHeader() {
          << "CoveredInstructions INTEGER,"
          << "UncoveredInstructions INTEGER,"
          << "QueryTime INTEGER,"
+         << "QueryConstructTime INTEGER,"
          << "SolverTime INTEGER,"
          << "CexCacheTime INTEGER,"
          << "ForkTime INTEGER,"
@@ -463,7 +473,11 @@ void StatsTracker::writeStatsHeader() {
          << "QueryCacheHits INTEGER,"
          << "QueryCexCacheMisses INTEGER,"
          << "QueryCexCacheHits INTEGER,"
+         << "QueryPersistentCacheMisses INTEGER,"
+         << "QueryPersistentCacheHits INTEGER,"
          << "InhibitedForks INTEGER,"
+         << "PrunedBranches INTEGER,"
+         << "PrunedQueries INTEGER,"
          << "ExternalCalls INTEGER,"
          << "Allocations INTEGER,"
          << "States INTEGER,"
@@ -501,6 +515,7 @@ void StatsTracker::writeStatsHeader() {
          << "CoveredInstructions,"
          << "UncoveredInstructions,"
          << "QueryTime,"
+         << "QueryConstructTime,"
          << "SolverTime,"
          << "CexCacheTime,"
          << "ForkTime,"
@@ -509,7 +524,11 @@ void StatsTracker::writeStatsHeader() {
          << "QueryCacheHits,"
          << "QueryCexCacheMisses,"
          << "QueryCexCacheHits,"
+         << "QueryPersistentCacheMisses,"
+         << "QueryPersistentCacheHits,"
          << "InhibitedForks,"
+         << "PrunedBranches,"
+         << "PrunedQueries,"
          << "ExternalCalls,"
          << "Allocations,"
          << "States,"
@@ -548,6 +567,11 @@ void StatsTracker::writeStatsHeader() {
          << "?,"
          << "?,"
          << "?,"
+         << "?,"
+         << "?,"
+         << "?,"
+         << "?,"
+         << "?,"
          BRANCH_TYPES
          TERMINATION_CLASSES
          << "? "
@@ -582,6 +606,7 @@ void StatsTracker::writeStatsLine() {
   sqlite3_bind_int64(insertStmt, arg++, stats::coveredInstructions);
   sqlite3_bind_int64(insertStmt, arg++, stats::uncoveredInstructions);
   sqlite3_bind_int64(insertStmt, arg++, stats::queryTime);
+  sqlite3_bind_int64(insertStmt, arg++, stats::queryConstructTime);
   sqlite3_bind_int64(insertStmt, arg++, stats::solverTime);
   sqlite3_bind_int64(insertStmt, arg++, stats::cexCacheTime);
   sqlite3_bind_int64(insertStmt, arg++, stats::forkTime);
@@ -590,7 +615,11 @@ void StatsTracker::writeStatsLine() {
   sqlite3_bind_int64(insertStmt, arg++, stats::queryCacheHits);
   sqlite3_bind_int64(insertStmt, arg++, stats::queryCexCacheMisses);
   sqlite3_bind_int64(insertStmt, arg++, stats::queryCexCacheHits);
+  sqlite3_bind_int64(insertStmt, arg++, stats::queryPersistentCacheMisses);
+  sqlite3_bind_int64(insertStmt, arg++, stats::queryPersistentCacheHits);
   sqlite3_bind_int64(insertStmt, arg++, stats::inhibitedForks);
+  sqlite3_bind_int64(insertStmt, arg++, stats::prunedBranches);
+  sqlite3_bind_int64(insertStmt, arg++, stats::prunedQueries);
   sqlite3_bind_int64(insertStmt, arg++, stats::externalCalls);
   sqlite3_bind_int64(insertStmt, arg++, stats::allocations);
   sqlite3_bind_int64(insertStmt, arg++, ExecutionState::getLastID());
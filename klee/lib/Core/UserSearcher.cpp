@@ -47,7 +47,11 @@ cl::list<Searcher::CoreSearchType> CoreSearch(
                    "use NURS with Instr-Count"),
         clEnumValN(Searcher::NURS_CPICnt, "nurs:cpicnt",
                    "use NURS with CallPath-Instr-Count"),
-        clEnumValN(Searcher::NURS_QC, "nurs:qc", "use NURS with Query-Cost")),
+        clEnumValN(Searcher::NURS_QC, "nurs:qc", "use NURS with Query-Cost"),
+        clEnumValN(Searcher::ResolveDist, "resolve-dist",
+                   "select the state closest to the --target function"),
+        clEnumValN(Searcher::ResolvePath, "resolve-path",
+                   "select the state furthest along the --reach-paths")),
     cl::cat(SearchCat));
 
 cl::opt<bool> UseIterativeDeepeningTimeSearch(
@@ -107,7 +111,9 @@ bool userSearcherRequiresInMemoryExecutionTree() {
 } // namespace klee
 
 Searcher *getNewSearcher(Searcher::CoreSearchType type, RNG &rng,
-                         InMemoryExecutionTree *executionTree) {
+                         InMemoryExecutionTree *executionTree,
+                         const std::vector<std::size_t> &targetDistances,
+                         const std::vector<std::vector<KInstruction *>> &targetPaths) {
   Searcher *searcher = nullptr;
   switch (type) {
     case Searcher::DFS: searcher = new DFSSearcher(); break;
@@ -121,6 +127,8 @@ Searcher *getNewSearcher(Searcher::CoreSearchType type, RNG &rng,
     case Searcher::NURS_ICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::InstCount, rng); break;
     case Searcher::NURS_CPICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::CPInstCount, rng); break;
     case Searcher::NURS_QC: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::QueryCost, rng); break;
+    case Searcher::ResolveDist: searcher = new DistanceSearcher(targetDistances); break;
+    case Searcher::ResolvePath: searcher = new PathSearcher(targetPaths, targetDistances); break;
   }
 
   return searcher;
@@ -129,14 +137,18 @@ Searcher *getNewSearcher(Searcher::CoreSearchType type, RNG &rng,
 Searcher *klee::constructUserSearcher(Executor &executor) {
   auto *etree =
       llvm::dyn_cast<InMemoryExecutionTree>(executor.executionTree.get());
-  Searcher *searcher = getNewSearcher(CoreSearch[0], executor.theRNG, etree);
+  Searcher *searcher = getNewSearcher(CoreSearch[0], executor.theRNG, etree,
+                                      executor.targetDistances,
+                                      executor.targetPaths);
 
   if (CoreSearch.size() > 1) {
     std::vector<Searcher *> s;
     s.push_back(searcher);
 
     for (unsigned i = 1; i < CoreSearch.size(); i++)
-      s.push_back(getNewSearcher(CoreSearch[i], executor.theRNG, etree));
+      s.push_back(getNewSearcher(CoreSearch[i], executor.theRNG, etree,
+                                 executor.targetDistances,
+                                 executor.targetPaths));
 
     searcher = new InterleavedSearcher(s);
   }
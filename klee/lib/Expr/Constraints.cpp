@@ -9,6 +9,9 @@
 
 #include "klee/Expr/Constraints.h"
 
+#include "klee/ADT/ImmutableMap.h"
+#include "klee/ADT/ImmutableSet.h"
+#include "klee/Expr/ExprUtil.h"
 #include "klee/Expr/ExprVisitor.h"
 #include "klee/Module/KModule.h"
 #include "klee/Support/OptionCategories.h"
@@ -16,7 +19,10 @@
 #include "llvm/IR/Function.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+#include <limits>
 #include <map>
+#include <vector>
 
 using namespace klee;
 
@@ -29,6 +35,175 @@ llvm::cl::opt<bool> RewriteEqualities(
     llvm::cl::cat(SolvingCat));
 } // namespace
 
+namespace klee {
+/// Union-find over the array bytes read by a set of constraints. All bytes
+/// read by one constraint end up in the same class, and each class lists
+/// the constraints reading it. A read at a symbolic index stands for every
+/// byte of its array.
+///
+/// The partition is held in persistent maps, so a copy shares everything
+/// with the original and adding a constraint to it only copies the paths to
+/// the entries it changes.
+class ConstraintPartition {
+  static constexpr unsigned none = std::numeric_limits<unsigned>::max();
+
+  struct ArrayNodes {
+    /// The node of each byte read at a constant index, until the array is
+    /// read at a symbolic index.
+    ImmutableMap<unsigned, unsigned> bytes;
+    /// The node of the whole array once it is read at a symbolic index.
+    unsigned whole = none;
+  };
+
+  /// What is stored at the root of a class
+  struct Class {
+    unsigned rank = 0;
+    /// The constraints of the class, and their number
+    ImmutableSet<unsigned> members;
+    std::size_t size = 0;
+  };
+
+  unsigned nodes = 0;
+  /// The parent of each node that is not the root of its class
+  ImmutableMap<unsigned, unsigned> parent;
+  /// The classes with a rank or members, by root
+  ImmutableMap<unsigned, Class> classes;
+  ImmutableMap<const Array *, ArrayNodes> arrays;
+
+  unsigned newNode() { return nodes++; }
+
+  unsigned find(unsigned node) const {
+    while (auto *p = parent.lookup(node))
+      node = p->second;
+    return node;
+  }
+
+  Class getClass(unsigned root) const {
+    auto *c = classes.lookup(root);
+    return c ? c->second : Class();
+  }
+
+  ArrayNodes getArrayNodes(const Array *array) const {
+    auto *nodes = arrays.lookup(array);
+    return nodes ? nodes->second : ArrayNodes();
+  }
+
+  unsigned unite(unsigned a, unsigned b) {
+    a = find(a);
+    b = find(b);
+    if (a == b)
+      return a;
+    Class ca = getClass(a);
+    Class cb = getClass(b);
+    if (ca.rank < cb.rank) {
+      std::swap(a, b);
+      std::swap(ca, cb);
+    } else if (ca.rank == cb.rank) {
+      ++ca.rank;
+    }
+    parent = parent.insert({b, a});
+
+    // Insert the smaller list of constraints into the larger one
+    if (ca.size < cb.size) {
+      std::swap(ca.members, cb.members);
+      std::swap(ca.size, cb.size);
+    }
+    for (unsigned constraint : cb.members)
+      ca.members = ca.members.insert(constraint);
+    ca.size += cb.size;
+    classes = classes.remove(b).replace({a, ca});
+    return a;
+  }
+
+  /// Returns the node standing for what \p re reads, creating it if needed.
+  unsigned getNode(const ReadExpr &re) {
+    const Array *array = re.updates.root;
+    ArrayNodes nodes = getArrayNodes(array);
+    if (nodes.whole != none)
+      return nodes.whole;
+    if (auto *CE = dyn_cast<ConstantExpr>(re.index)) {
+      unsigned index = CE->getZExtValue(32);
+      if (auto *byte = nodes.bytes.lookup(index))
+        return byte->second;
+      unsigned node = newNode();
+      nodes.bytes = nodes.bytes.insert({index, node});
+      arrays = arrays.replace({array, nodes});
+      return node;
+    }
+    nodes.whole = newNode();
+    for (const auto &byte : nodes.bytes)
+      unite(nodes.whole, byte.second);
+    nodes.bytes = ImmutableMap<unsigned, unsigned>();
+    arrays = arrays.replace({array, nodes});
+    return nodes.whole;
+  }
+
+  /// Adds the roots of the classes \p re may read to \p roots.
+  void findRoots(const ReadExpr &re, std::vector<unsigned> &roots) const {
+    auto *found = arrays.lookup(re.updates.root);
+    if (!found)
+      return;
+    const ArrayNodes &nodes = found->second;
+    if (nodes.whole != none) {
+      roots.push_back(find(nodes.whole));
+    } else if (auto *CE = dyn_cast<ConstantExpr>(re.index)) {
+      if (auto *byte = nodes.bytes.lookup(CE->getZExtValue(32)))
+        roots.push_back(find(byte->second));
+    } else {
+      for (const auto &byte : nodes.bytes)
+        roots.push_back(find(byte.second));
+    }
+  }
+
+  static void findDependentReads(const ref<Expr> &e,
+                                 std::vector<ref<ReadExpr>> &reads) {
+    findReads(e, /* visitUpdates= */ true, reads);
+    // Reads of a constant array don't alias.
+    reads.erase(std::remove_if(reads.begin(), reads.end(),
+                               [](const ref<ReadExpr> &re) {
+                                 return re->updates.root->isConstantArray() &&
+                                        !re->updates.head;
+                               }),
+                reads.end());
+  }
+
+public:
+  /// Adds \p e as the constraint numbered \p constraint.
+  void add(unsigned constraint, const ref<Expr> &e) {
+    std::vector<ref<ReadExpr>> reads;
+    findDependentReads(e, reads);
+    if (reads.empty())
+      return; // independent of every query
+
+    unsigned root = getNode(*reads.front());
+    for (const auto &re : reads)
+      root = unite(root, getNode(*re));
+    Class c = getClass(root);
+    c.members = c.members.insert(constraint);
+    ++c.size;
+    classes = classes.replace({root, c});
+  }
+
+  /// Collects the numbers of the constraints \p e depends on, in order.
+  void collect(const ref<Expr> &e, std::vector<unsigned> &result) const {
+    std::vector<ref<ReadExpr>> reads;
+    findDependentReads(e, reads);
+
+    std::vector<unsigned> roots;
+    for (const auto &re : reads)
+      findRoots(*re, roots);
+    std::sort(roots.begin(), roots.end());
+    roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+    for (unsigned root : roots)
+      if (auto *c = classes.lookup(root))
+        for (unsigned constraint : c->second.members)
+          result.push_back(constraint);
+    std::sort(result.begin(), result.end());
+  }
+};
+} // namespace klee
+
 class ExprReplaceVisitor : public ExprVisitor {
 private:
   ref<Expr> src, dst;
@@ -71,22 +246,30 @@ public:
 };
 
 bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
-  ConstraintSet old;
+  ConstraintSet::constraints_ty rewritten;
   bool changed = false;
 
-  std::swap(constraints, old);
-  for (auto &ce : old) {
-    ref<Expr> e = visitor.visit(ce);
+  rewritten.reserve(constraints.size());
+  for (auto &ce : constraints) {
+    rewritten.push_back(visitor.visit(ce));
+    changed |= rewritten.back() != ce;
+  }
 
-    if (e!=ce) {
-      addConstraintInternal(e); // enable further reductions
-      changed = true;
+  // Leave the set, and its partition, alone unless something changed
+  if (!changed)
+    return false;
+
+  ConstraintSet old;
+  std::swap(constraints, old);
+  for (std::size_t i = 0; i != rewritten.size(); ++i) {
+    if (rewritten[i] != old.constraints[i]) {
+      addConstraintInternal(rewritten[i]); // enable further reductions
     } else {
-      constraints.push_back(ce);
+      constraints.push_back(rewritten[i]);
     }
   }
 
-  return changed;
+  return true;
 }
 
 ref<Expr> ConstraintManager::simplifyExpr(const ConstraintSet &constraints,
@@ -175,4 +358,32 @@ klee::ConstraintSet::constraint_iterator ConstraintSet::end() const {
 
 size_t ConstraintSet::size() const noexcept { return constraints.size(); }
 
-void ConstraintSet::push_back(const ref<Expr> &e) { constraints.push_back(e); }
+void ConstraintSet::push_back(const ref<Expr> &e) {
+  // Sets built from a vector of constraints are not partitioned
+  if (!partition && !constraints.empty()) {
+    constraints.push_back(e);
+    return;
+  }
+
+  if (!partition)
+    partition = std::make_shared<ConstraintPartition>();
+  else if (partition.use_count() > 1)
+    partition = std::make_shared<ConstraintPartition>(*partition);
+  partition->add(constraints.size(), e);
+  constraints.push_back(e);
+}
+
+bool ConstraintSet::getIndependentConstraints(const ref<Expr> &e,
+                                              constraints_ty &result) const {
+  if (constraints.empty())
+    return true;
+  if (!partition)
+    return false;
+
+  std::vector<unsigned> indices;
+  partition->collect(e, indices);
+  result.reserve(result.size() + indices.size());
+  for (unsigned i : indices)
+    result.push_back(constraints[i]);
+  return true;
+}
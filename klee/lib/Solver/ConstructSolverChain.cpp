@@ -52,6 +52,10 @@ std::unique_ptr<Solver> constructSolverChain(
   if (UseFastCexSolver)
     solver = createFastCexSolver(std::move(solver));
 
+  if (!PersistentQueryCache.empty())
+    solver = createPersistentCachingSolver(
+        std::move(solver), PersistentQueryCache, PersistentQueryCacheMaxSize);
+
   if (UseCexCache)
     solver = createCexCachingSolver(std::move(solver));
 
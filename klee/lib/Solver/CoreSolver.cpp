@@ -10,6 +10,7 @@
 #include "STPSolver.h"
 #include "Z3Solver.h"
 #include "MetaSMTSolver.h"
+#include "PortfolioSolver.h"
 
 #include "klee/Solver/SolverCmdLine.h"
 #include "klee/Support/ErrorHandling.h"
@@ -20,9 +21,46 @@
 
 #include <string>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace klee {
 
+/// Builds every compiled-in backend for the portfolio. They run in children
+/// of the portfolio already, so STP does not fork itself.
+static std::unique_ptr<Solver> createPortfolioCoreSolver() {
+  std::vector<std::pair<std::string, CoreSolverType>> available;
+#ifdef ENABLE_STP
+  available.emplace_back("stp", STP_SOLVER);
+#endif
+#ifdef ENABLE_Z3
+  available.emplace_back("z3", Z3_SOLVER);
+#endif
+#ifdef ENABLE_METASMT
+  available.emplace_back("metasmt", METASMT_SOLVER);
+#endif
+
+  if (available.size() < 2) {
+    klee_message("Not compiled with several solvers for the portfolio");
+    return available.empty() ? NULL
+                             : createCoreSolver(available.front().second);
+  }
+
+  std::vector<std::pair<std::string, std::unique_ptr<Solver>>> backends;
+  for (auto const &[name, type] : available) {
+#ifdef ENABLE_STP
+    if (type == STP_SOLVER) {
+      backends.emplace_back(name, std::make_unique<STPSolver>(
+                                      false, CoreSolverOptimizeDivides));
+      continue;
+    }
+#endif
+    backends.emplace_back(name, createCoreSolver(type));
+  }
+  klee_message("Using solver portfolio");
+  return createPortfolioSolver(std::move(backends));
+}
+
 std::unique_ptr<Solver> createCoreSolver(CoreSolverType cst) {
   switch (cst) {
   case STP_SOLVER:
@@ -51,6 +89,8 @@ std::unique_ptr<Solver> createCoreSolver(CoreSolverType cst) {
     klee_message("Not compiled with Z3 support");
     return NULL;
 #endif
+  case PORTFOLIO_SOLVER:
+    return createPortfolioCoreSolver();
   case NO_SOLVER:
     klee_message("Invalid solver");
     return NULL;
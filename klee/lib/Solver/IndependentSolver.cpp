@@ -16,6 +16,8 @@
 #include "klee/Expr/ExprUtil.h"
 #include "klee/Support/Debug.h"
 #include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Statistics/TimerStatIncrementer.h"
 
 #include "llvm/Support/raw_ostream.h"
 
@@ -368,6 +370,15 @@ IndependentElementSet getIndependentConstraints(const Query& query,
 }
 
 
+// Collects the constraints the query depends on, using the independent
+// subsets the constraint set tracks where it does.
+static void getRequiredConstraints(const Query &query,
+                                   std::vector<ref<Expr>> &required) {
+  TimerStatIncrementer t(stats::queryConstructTime);
+  if (!query.constraints.getIndependentConstraints(query.expr, required))
+    getIndependentConstraints(query, required);
+}
+
 // Extracts which arrays are referenced from a particular independent set.  Examines both
 // the actual known array accesses arr[1] plus the undetermined accesses arr[x].
 static
@@ -411,8 +422,7 @@ public:
 bool IndependentSolver::computeValidity(const Query& query,
                                         Solver::Validity &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure =
-    getIndependentConstraints(query, required);
+  getRequiredConstraints(query, required);
   ConstraintSet tmp(required);
   return solver->impl->computeValidity(Query(tmp, query.expr), 
                                        result);
@@ -420,8 +430,7 @@ bool IndependentSolver::computeValidity(const Query& query,
 
 bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getRequiredConstraints(query, required);
   ConstraintSet tmp(required);
   return solver->impl->computeTruth(Query(tmp, query.expr), 
                                     isValid);
@@ -429,8 +438,7 @@ bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
 
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getRequiredConstraints(query, required);
   ConstraintSet tmp(required);
   return solver->impl->computeValue(Query(tmp, query.expr), result);
 }
@@ -481,7 +489,11 @@ bool IndependentSolver::computeInitialValues(const Query& query,
   hasSolution = true;
   // FIXME: When we switch to C++11 this should be a std::unique_ptr so we don't need
   // to remember to manually call delete
-  std::list<IndependentElementSet> *factors = getAllIndependentConstraintsSets(query);
+  std::list<IndependentElementSet> *factors;
+  {
+    TimerStatIncrementer t(stats::queryConstructTime);
+    factors = getAllIndependentConstraintsSets(query);
+  }
 
   //Used to rearrange all of the answers into the correct order
   std::map<const Array*, std::vector<unsigned char> > retMap;
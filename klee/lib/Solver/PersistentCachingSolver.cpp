@@ -0,0 +1,631 @@
+//===-- PersistentCachingSolver.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A solver layer that keeps the results of the solver below it in a file, so
+// that later runs on the same program start with them. The file is a log of
+// records shared between concurrent processes: appends happen under an
+// exclusive flock, and every process indexes the records of all others as the
+// file grows. Records hold a digest of the query instead of the query itself.
+// Once the file would grow beyond its maximum size, its newest records are
+// copied to a new file that is renamed over it, and the other processes switch
+// to that file when they next take the lock or miss.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver/Solver.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Support/ErrorHandling.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/xxhash.h"
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// Identifies the file format, bumped whenever the encoding changes
+constexpr char CacheMagic[8] = {'K', 'L', 'E', 'E', 'Q', 'C', '0', '2'};
+
+/// Identifies the canonical encoding of a query without storing it
+struct KeyDigest {
+  /// xxHash64 of the key, which records are indexed by
+  uint64_t hash;
+  /// MD5 of the key, which tells apart keys of the same hash
+  std::array<uint8_t, 16> verifier;
+
+  explicit KeyDigest(llvm::StringRef key)
+      : hash(llvm::xxHash64(key)),
+        verifier(llvm::MD5::hash(llvm::arrayRefFromStringRef(key))) {}
+};
+
+/// Precedes the value bytes of every record
+struct RecordHeader {
+  /// xxHash64 of the rest of the record, which tells a complete record from
+  /// one that is still being written
+  uint64_t checksum;
+  uint64_t hash;
+  uint8_t verifier[16];
+  uint32_t valueSize;
+  uint32_t padding;
+};
+
+enum QueryKind : unsigned char { TruthQuery, ValueQuery, InitialValuesQuery };
+
+/// Builds the canonical encoding of a query that records are keyed by.
+/// Arrays are numbered in order of first use instead of named, so the same
+/// query built by another run encodes the same way. Repeated subexpressions,
+/// arrays and update nodes are encoded once and referred to by number.
+class QueryEncoder {
+  std::string bytes;
+  ExprHashMap<uint32_t> exprs;
+  std::unordered_map<const Array *, uint32_t> arrays;
+  std::unordered_map<const UpdateNode *, uint32_t> updates;
+
+  enum Tag : unsigned char { New, Seen };
+
+  void writeByte(unsigned char value) { bytes.push_back(value); }
+  void writeInt(uint64_t value) {
+    bytes.append(reinterpret_cast<const char *>(&value), sizeof value);
+  }
+  void writeConstant(const ConstantExpr &ce) {
+    const llvm::APInt &value = ce.getAPValue();
+    writeInt(ce.getWidth());
+    for (unsigned i = 0; i != value.getNumWords(); ++i)
+      writeInt(value.getRawData()[i]);
+  }
+
+  void writeArray(const Array *array);
+  void writeUpdates(const UpdateList &ul);
+
+public:
+  explicit QueryEncoder(QueryKind kind) { writeByte(kind); }
+
+  void writeExpr(const ref<Expr> &e);
+  void writeQuery(const Query &query);
+  void writeObjects(const std::vector<const Array *> &objects);
+
+  std::string take() { return std::move(bytes); }
+};
+
+void QueryEncoder::writeArray(const Array *array) {
+  auto [it, inserted] = arrays.insert({array, arrays.size()});
+  if (!inserted) {
+    writeByte(Seen);
+    writeInt(it->second);
+    return;
+  }
+
+  writeByte(New);
+  writeInt(array->size);
+  writeInt(array->domain);
+  writeInt(array->range);
+  writeInt(array->constantValues.size());
+  for (auto const &value : array->constantValues)
+    writeConstant(*value);
+}
+
+void QueryEncoder::writeUpdates(const UpdateList &ul) {
+  writeArray(ul.root);
+
+  // Updates lists share their tails, so only the nodes not encoded yet are
+  // written, oldest first
+  std::vector<const UpdateNode *> fresh;
+  const UpdateNode *seen = nullptr;
+  for (const UpdateNode *un = ul.head.get(); un; un = un->next.get()) {
+    if (updates.count(un)) {
+      seen = un;
+      break;
+    }
+    fresh.push_back(un);
+  }
+
+  writeInt(fresh.size());
+  if (seen) {
+    writeByte(Seen);
+    writeInt(updates[seen]);
+  } else {
+    writeByte(New);
+  }
+  for (auto it = fresh.rbegin(), ie = fresh.rend(); it != ie; ++it) {
+    writeExpr((*it)->index);
+    writeExpr((*it)->value);
+    updates.insert({*it, updates.size()});
+  }
+}
+
+void QueryEncoder::writeExpr(const ref<Expr> &e) {
+  auto it = exprs.find(e);
+  if (it != exprs.end()) {
+    writeByte(Seen);
+    writeInt(it->second);
+    return;
+  }
+
+  writeByte(New);
+  writeByte(e->getKind());
+  writeInt(e->getWidth());
+  if (auto ce = dyn_cast<ConstantExpr>(e)) {
+    writeConstant(*ce);
+  } else if (auto re = dyn_cast<ReadExpr>(e)) {
+    writeUpdates(re->updates);
+  } else if (auto ee = dyn_cast<ExtractExpr>(e)) {
+    writeInt(ee->offset);
+  }
+
+  writeInt(e->getNumKids());
+  for (unsigned i = 0; i != e->getNumKids(); ++i)
+    writeExpr(e->getKid(i));
+  exprs.insert({e, exprs.size()});
+}
+
+void QueryEncoder::writeQuery(const Query &query) {
+  writeInt(query.constraints.size());
+  for (auto const &constraint : query.constraints)
+    writeExpr(constraint);
+  writeExpr(query.expr);
+}
+
+void QueryEncoder::writeObjects(const std::vector<const Array *> &objects) {
+  writeInt(objects.size());
+  for (auto const &object : objects)
+    writeArray(object);
+}
+
+/// Writes all of `data` to `fd` at `offset`, retrying interrupted writes
+bool writeAll(int fd, const char *data, uint64_t size, uint64_t offset) {
+  uint64_t written = 0;
+  while (written < size) {
+    ssize_t n = pwrite(fd, data + written, size - written, offset + written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    written += n;
+  }
+  return true;
+}
+
+/// The cache file, mapped read-only and indexed by the hash of each key
+class CacheFile {
+  int fd = -1;
+  std::string path;
+  /// Size beyond which the file is compacted, 0 if unbounded
+  uint64_t maxSize;
+  const char *mapped = nullptr;
+  uint64_t mappedSize = 0;
+  /// End of the last complete record indexed
+  uint64_t indexedEnd = sizeof CacheMagic;
+  std::unordered_multimap<uint64_t, uint64_t> index;
+
+  void unmap();
+  bool refresh();
+  bool reopenIfReplaced();
+  void lockLatest();
+  bool compact(uint64_t keep);
+  const char *find(const KeyDigest &digest, uint32_t &valueSize);
+
+public:
+  CacheFile(const std::string &path, uint64_t maxSize);
+  ~CacheFile();
+  CacheFile(const CacheFile &) = delete;
+  CacheFile &operator=(const CacheFile &) = delete;
+
+  bool lookup(llvm::StringRef key, std::string &value);
+  void insert(llvm::StringRef key, llvm::StringRef value);
+};
+
+CacheFile::CacheFile(const std::string &path, uint64_t maxSize)
+    : path(path), maxSize(maxSize) {
+  fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0)
+    klee_error("Unable to open query cache \"%s\": %s", path.c_str(),
+               strerror(errno));
+
+  flock(fd, LOCK_EX);
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size == 0 &&
+      write(fd, CacheMagic, sizeof CacheMagic) != sizeof CacheMagic)
+    klee_error("Unable to initialise query cache \"%s\": %s", path.c_str(),
+               strerror(errno));
+  flock(fd, LOCK_UN);
+
+  char magic[sizeof CacheMagic];
+  if (pread(fd, magic, sizeof magic, 0) != sizeof magic ||
+      memcmp(magic, CacheMagic, sizeof magic) != 0)
+    klee_error("\"%s\" is not a query cache of this KLEE version",
+               path.c_str());
+
+  refresh();
+  klee_message("Using query cache \"%s\" with %zu entries", path.c_str(),
+               index.size());
+}
+
+CacheFile::~CacheFile() {
+  unmap();
+  if (fd >= 0)
+    close(fd);
+}
+
+void CacheFile::unmap() {
+  if (mapped)
+    munmap(const_cast<char *>(mapped), mappedSize);
+  mapped = nullptr;
+  mappedSize = 0;
+}
+
+/// Maps and indexes the records appended since the last call. Returns false
+/// if the file ends in a record that is incomplete or corrupt.
+bool CacheFile::refresh() {
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    return false;
+  uint64_t size = st.st_size;
+  if (size == indexedEnd)
+    return true;
+
+  if (size > mappedSize) {
+    void *m = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+      klee_warning_once(nullptr, "Unable to map query cache \"%s\": %s",
+                        path.c_str(), strerror(errno));
+      return false;
+    }
+    unmap();
+    mapped = static_cast<const char *>(m);
+    mappedSize = size;
+  }
+
+  while (indexedEnd + sizeof(RecordHeader) <= size) {
+    RecordHeader header;
+    memcpy(&header, mapped + indexedEnd, sizeof header);
+    uint64_t end = indexedEnd + sizeof header + header.valueSize;
+    if (end > size)
+      return false;
+
+    llvm::StringRef record(mapped + indexedEnd, end - indexedEnd);
+    if (llvm::xxHash64(record.drop_front(sizeof header.checksum)) !=
+        header.checksum)
+      return false;
+
+    index.insert({header.hash, indexedEnd});
+    indexedEnd = end;
+  }
+  return indexedEnd == size;
+}
+
+/// Switches to the file now at the cache path if a compaction replaced the
+/// one open. Returns true if it did, which releases the lock if it was held.
+bool CacheFile::reopenIfReplaced() {
+  struct stat current, opened;
+  if (stat(path.c_str(), &current) != 0 || fstat(fd, &opened) != 0 ||
+      (current.st_dev == opened.st_dev && current.st_ino == opened.st_ino))
+    return false;
+
+  int newFd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (newFd < 0)
+    return false;
+  char magic[sizeof CacheMagic];
+  if (pread(newFd, magic, sizeof magic, 0) != sizeof magic ||
+      memcmp(magic, CacheMagic, sizeof magic) != 0) {
+    close(newFd);
+    return false;
+  }
+
+  unmap();
+  close(fd);
+  fd = newFd;
+  indexedEnd = sizeof CacheMagic;
+  index.clear();
+  return true;
+}
+
+/// Takes the exclusive lock of the file currently at the cache path
+void CacheFile::lockLatest() {
+  do
+    flock(fd, LOCK_EX);
+  while (reopenIfReplaced());
+}
+
+/// Writes the newest records, up to `keep` bytes of them, to a new file and
+/// renames it over the cache. Processes that still map the old file keep
+/// reading it until they switch. Must be called holding the lock, with the
+/// file refreshed.
+bool CacheFile::compact(uint64_t keep) {
+  uint64_t start = sizeof CacheMagic;
+  while (indexedEnd - start > keep) {
+    RecordHeader header;
+    memcpy(&header, mapped + start, sizeof header);
+    start += sizeof header + header.valueSize;
+  }
+
+  std::string compactPath = path + ".compact";
+  int compactFd =
+      open(compactPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool written =
+      compactFd >= 0 &&
+      writeAll(compactFd, CacheMagic, sizeof CacheMagic, 0) &&
+      writeAll(compactFd, mapped + start, indexedEnd - start,
+               sizeof CacheMagic);
+  if (compactFd >= 0)
+    close(compactFd);
+  if (!written || rename(compactPath.c_str(), path.c_str()) != 0) {
+    klee_warning_once(nullptr, "Unable to compact query cache \"%s\": %s",
+                      path.c_str(), strerror(errno));
+    unlink(compactPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+const char *CacheFile::find(const KeyDigest &digest, uint32_t &valueSize) {
+  auto range = index.equal_range(digest.hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    RecordHeader header;
+    memcpy(&header, mapped + it->second, sizeof header);
+    if (memcmp(header.verifier, digest.verifier.data(),
+               sizeof header.verifier) == 0) {
+      valueSize = header.valueSize;
+      return mapped + it->second + sizeof header;
+    }
+  }
+  return nullptr;
+}
+
+bool CacheFile::lookup(llvm::StringRef key, std::string &value) {
+  KeyDigest digest(key);
+  uint32_t valueSize;
+  const char *found = find(digest, valueSize);
+
+  // Another process may have solved the query, or compacted the file, in the
+  // meantime
+  if (!found) {
+    reopenIfReplaced();
+    refresh();
+    found = find(digest, valueSize);
+  }
+  if (!found)
+    return false;
+
+  value.assign(found, valueSize);
+  return true;
+}
+
+void CacheFile::insert(llvm::StringRef key, llvm::StringRef value) {
+  KeyDigest digest(key);
+  lockLatest();
+
+  // Holding the lock, a record that does not check out was torn by a
+  // writer that died. The new record is written over it, so the file never
+  // shrinks under the mappings of other processes.
+  refresh();
+
+  uint32_t valueSize;
+  if (!find(digest, valueSize)) {
+    std::string record(sizeof(RecordHeader), '\0');
+    record.append(value.data(), value.size());
+    RecordHeader header = {};
+    header.hash = digest.hash;
+    memcpy(header.verifier, digest.verifier.data(), sizeof header.verifier);
+    header.valueSize = static_cast<uint32_t>(value.size());
+    memcpy(&record[0], &header, sizeof header);
+    header.checksum = llvm::xxHash64(
+        llvm::StringRef(record).drop_front(sizeof header.checksum));
+    memcpy(&record[0], &header.checksum, sizeof header.checksum);
+
+    // Dropping the older half leaves room to grow before compacting again
+    if (maxSize && indexedEnd + record.size() > maxSize &&
+        compact(maxSize / 2)) {
+      lockLatest();
+      refresh();
+    }
+
+    if (!writeAll(fd, record.data(), record.size(), indexedEnd))
+      klee_warning_once(nullptr, "Unable to write query cache \"%s\": %s",
+                        path.c_str(), strerror(errno));
+    refresh();
+  }
+
+  flock(fd, LOCK_UN);
+}
+
+class PersistentCachingSolver : public SolverImpl {
+  std::unique_ptr<Solver> solver;
+  CacheFile cache;
+
+  std::string truthKey(const Query &query) {
+    QueryEncoder encoder(TruthQuery);
+    encoder.writeQuery(query);
+    return encoder.take();
+  }
+  bool lookupTruth(const std::string &key, bool &isValid);
+  void insertTruth(const std::string &key, bool isValid) {
+    cache.insert(key, llvm::StringRef(isValid ? "\1" : "\0", 1));
+  }
+
+public:
+  PersistentCachingSolver(std::unique_ptr<Solver> solver,
+                          const std::string &path, uint64_t maxSize)
+      : solver(std::move(solver)), cache(path, maxSize) {}
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  std::string getConstraintLog(const Query &) override;
+  void setCoreSolverTimeout(time::Span timeout);
+};
+
+} // namespace
+
+bool PersistentCachingSolver::lookupTruth(const std::string &key,
+                                          bool &isValid) {
+  std::string value;
+  if (!cache.lookup(key, value) || value.size() != 1)
+    return false;
+  isValid = value[0];
+  return true;
+}
+
+bool PersistentCachingSolver::computeValidity(const Query &query,
+                                              Solver::Validity &result) {
+  std::string trueKey = truthKey(query);
+  std::string falseKey = truthKey(query.negateExpr());
+  bool mustBeTrue, mustBeFalse;
+  if (lookupTruth(trueKey, mustBeTrue) && lookupTruth(falseKey, mustBeFalse)) {
+    ++stats::queryPersistentCacheHits;
+    result = mustBeTrue    ? Solver::True
+             : mustBeFalse ? Solver::False
+                           : Solver::Unknown;
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeValidity(query, result))
+    return false;
+  insertTruth(trueKey, result == Solver::True);
+  insertTruth(falseKey, result == Solver::False);
+  return true;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query,
+                                           bool &isValid) {
+  std::string key = truthKey(query);
+  if (lookupTruth(key, isValid)) {
+    ++stats::queryPersistentCacheHits;
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+  insertTruth(key, isValid);
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  QueryEncoder encoder(ValueQuery);
+  encoder.writeQuery(query);
+  std::string key = encoder.take();
+
+  // The value is stored as its width followed by its bytes
+  std::string value;
+  if (cache.lookup(key, value) && value.size() >= sizeof(uint32_t)) {
+    uint32_t width;
+    memcpy(&width, value.data(), sizeof width);
+    std::vector<uint64_t> words((value.size() - sizeof width + 7) / 8);
+    memcpy(words.data(), value.data() + sizeof width,
+           value.size() - sizeof width);
+    ++stats::queryPersistentCacheHits;
+    result = ConstantExpr::alloc(llvm::APInt(width, words));
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeValue(query, result))
+    return false;
+
+  if (auto ce = dyn_cast<ConstantExpr>(result)) {
+    const llvm::APInt &apValue = ce->getAPValue();
+    uint32_t width = apValue.getBitWidth();
+    value.assign(reinterpret_cast<const char *>(&width), sizeof width);
+    value.append(reinterpret_cast<const char *>(apValue.getRawData()),
+                 apValue.getNumWords() * sizeof(uint64_t));
+    cache.insert(key, value);
+  }
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  QueryEncoder encoder(InitialValuesQuery);
+  encoder.writeQuery(query);
+  encoder.writeObjects(objects);
+  std::string key = encoder.take();
+
+  // Whether there is a solution, followed by the bytes of every object
+  std::string value;
+  uint64_t expectedSize = 1;
+  for (auto const &object : objects)
+    expectedSize += object->size;
+  if (cache.lookup(key, value) &&
+      (value.size() == expectedSize || (value.size() == 1 && !value[0]))) {
+    ++stats::queryPersistentCacheHits;
+    hasSolution = value[0];
+    values.clear();
+    if (hasSolution) {
+      const char *data = value.data() + 1;
+      for (auto const &object : objects) {
+        values.emplace_back(data, data + object->size);
+        data += object->size;
+      }
+    }
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeInitialValues(query, objects, values,
+                                          hasSolution))
+    return false;
+
+  value.assign(1, hasSolution);
+  if (hasSolution) {
+    for (auto const &bytes : values)
+      value.append(bytes.begin(), bytes.end());
+  }
+  cache.insert(key, value);
+  return true;
+}
+
+SolverImpl::SolverRunStatus PersistentCachingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+std::string PersistentCachingSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void PersistentCachingSolver::setCoreSolverTimeout(time::Span timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+std::unique_ptr<Solver>
+klee::createPersistentCachingSolver(std::unique_ptr<Solver> solver,
+                                    const std::string &path,
+                                    uint64_t maxSize) {
+  return std::make_unique<Solver>(std::make_unique<PersistentCachingSolver>(
+      std::move(solver), path, maxSize));
+}
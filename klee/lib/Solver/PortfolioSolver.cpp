@@ -0,0 +1,370 @@
+//===-- PortfolioSolver.cpp -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PortfolioSolver.h"
+
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/ExprUtil.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Statistics/TimerStatIncrementer.h"
+#include "klee/Support/ErrorHandling.h"
+#include "klee/System/Time.h"
+
+#include "llvm/Support/Errno.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+enum QueryKind { TruthQuery, ValueQuery, InitialValuesQuery, NumQueryKinds };
+
+const char *const QueryKindNames[NumQueryKinds] = {"truth", "value",
+                                                   "initial values"};
+
+/// Races of a kind of query needed before routing it to one backend
+constexpr uint64_t RouteAfterRaces = 32;
+/// Share of those races, in percent, the backend must have won
+constexpr uint64_t RouteWinPercent = 90;
+/// Every this many routable queries, one is raced to keep the history current
+constexpr uint64_t RaceEvery = 16;
+
+/// What a child leaves in the first byte of its shared memory slot, followed
+/// by the values of all objects if the query is solvable
+enum SlotStatus : unsigned char { Pending, Solvable, Unsolvable, Failed };
+
+class PortfolioSolverImpl : public SolverImpl {
+  struct Backend {
+    std::string name;
+    std::unique_ptr<Solver> solver;
+  };
+
+  /// Races and wins of each backend for one kind of query
+  struct KindHistory {
+    uint64_t races = 0;
+    uint64_t routed = 0;
+    /// Queries that met the routing threshold, whether routed or raced
+    uint64_t routable = 0;
+    std::vector<uint64_t> wins;
+  };
+
+  std::vector<Backend> backends;
+  std::array<KindHistory, NumQueryKinds> history;
+  time::Span timeout;
+  SolverRunStatus runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  int getRoutedBackend(QueryKind kind);
+  SolverRunStatus race(const std::vector<unsigned> &entrants,
+                       const Query &query,
+                       const std::vector<const Array *> &objects,
+                       std::vector<std::vector<unsigned char>> &values,
+                       bool &hasSolution, int &winner);
+  bool solve(QueryKind kind, const Query &query,
+             const std::vector<const Array *> &objects,
+             std::vector<std::vector<unsigned char>> &values,
+             bool &hasSolution);
+
+public:
+  explicit PortfolioSolverImpl(
+      std::vector<std::pair<std::string, std::unique_ptr<Solver>>> solvers);
+  ~PortfolioSolverImpl();
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() { return runStatusCode; }
+  std::string getConstraintLog(const Query &) override;
+  void setCoreSolverTimeout(time::Span timeout);
+};
+
+} // namespace
+
+PortfolioSolverImpl::PortfolioSolverImpl(
+    std::vector<std::pair<std::string, std::unique_ptr<Solver>>> solvers) {
+  assert(!solvers.empty() && "portfolio without backends");
+  for (auto &[name, solver] : solvers)
+    backends.push_back({name, std::move(solver)});
+  for (auto &kind : history)
+    kind.wins.resize(backends.size());
+}
+
+PortfolioSolverImpl::~PortfolioSolverImpl() {
+  for (unsigned kind = 0; kind != NumQueryKinds; ++kind) {
+    const KindHistory &h = history[kind];
+    if (!h.races)
+      continue;
+    std::ostringstream wins;
+    for (unsigned i = 0; i != backends.size(); ++i)
+      wins << (i ? ", " : "") << backends[i].name << " " << h.wins[i];
+    klee_message("Solver portfolio: %s queries won by %s (%llu routed)",
+                 QueryKindNames[kind], wins.str().c_str(),
+                 (unsigned long long)h.routed);
+  }
+}
+
+/// Returns the backend that has won nearly all races of this kind of query,
+/// or -1 if the query should be raced
+int PortfolioSolverImpl::getRoutedBackend(QueryKind kind) {
+  KindHistory &h = history[kind];
+  if (backends.size() == 1)
+    return 0;
+  if (h.races < RouteAfterRaces)
+    return -1;
+
+  auto best = std::max_element(h.wins.begin(), h.wins.end());
+  if (*best * 100 < h.races * RouteWinPercent)
+    return -1;
+  if (++h.routable % RaceEvery == 0)
+    return -1;
+  return best - h.wins.begin();
+}
+
+SolverImpl::SolverRunStatus PortfolioSolverImpl::race(
+    const std::vector<unsigned> &entrants, const Query &query,
+    const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution,
+    int &winner) {
+  std::size_t slotSize = 1;
+  for (const auto object : objects)
+    slotSize += object->size;
+  std::size_t regionSize = slotSize * entrants.size();
+  void *region = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    klee_warning("mmap failed (for solver portfolio) - %s",
+                 llvm::sys::StrError(errno).c_str());
+    return SOLVER_RUN_STATUS_FAILURE;
+  }
+  unsigned char *slots = static_cast<unsigned char *>(region);
+
+  // Children write the number of their slot here once it is filled in
+  int done[2];
+  if (pipe(done) != 0) {
+    klee_warning("pipe failed (for solver portfolio) - %s",
+                 llvm::sys::StrError(errno).c_str());
+    munmap(region, regionSize);
+    return SOLVER_RUN_STATUS_FAILURE;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+
+  std::vector<pid_t> children;
+  for (unsigned k = 0; k != entrants.size(); ++k) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      klee_warning("fork failed (for solver portfolio) - %s",
+                   llvm::sys::StrError(errno).c_str());
+      break;
+    }
+    if (pid == 0) {
+      close(done[0]);
+      unsigned char *slot = slots + k * slotSize;
+      std::vector<std::vector<unsigned char>> childValues;
+      bool childHasSolution = false;
+      Solver &solver = *backends[entrants[k]].solver;
+      if (solver.impl->computeInitialValues(query, objects, childValues,
+                                            childHasSolution)) {
+        if (childHasSolution) {
+          unsigned char *pos = slot + 1;
+          for (unsigned i = 0; i != objects.size(); ++i)
+            pos = std::copy_n(childValues[i].begin(), objects[i]->size, pos);
+        }
+        slot[0] = childHasSolution ? Solvable : Unsolvable;
+      } else {
+        slot[0] = Failed;
+      }
+      unsigned char index = k;
+      _exit(write(done[1], &index, 1) == 1 ? 0 : 1);
+    }
+    children.push_back(pid);
+  }
+  close(done[1]);
+
+  // Wait for the first definitive answer, for every child to have given up,
+  // or for the timeout
+  SolverRunStatus status = children.empty() ? SOLVER_RUN_STATUS_FORK_FAILED
+                                            : SOLVER_RUN_STATUS_FAILURE;
+  time::Point deadline = time::getWallTime() + timeout;
+  for (unsigned reported = 0; reported != children.size();) {
+    int waitMs = -1;
+    if (timeout) {
+      time::Point now = time::getWallTime();
+      if (deadline <= now) {
+        status = SOLVER_RUN_STATUS_TIMEOUT;
+        break;
+      }
+      waitMs = std::max<uint64_t>(1, (deadline - now).toMicroseconds() / 1000);
+    }
+
+    pollfd pfd = {done[0], POLLIN, 0};
+    int ready = poll(&pfd, 1, waitMs);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    if (ready == 0)
+      continue;
+
+    unsigned char k;
+    ssize_t n = ready < 0 ? -1 : read(done[0], &k, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    // All children have exited, the remaining ones without reporting
+    if (n != 1 || k >= children.size())
+      break;
+
+    ++reported;
+    const unsigned char *slot = slots + k * slotSize;
+    if (slot[0] != Solvable && slot[0] != Unsolvable)
+      continue;
+
+    winner = entrants[k];
+    hasSolution = slot[0] == Solvable;
+    values.clear();
+    if (hasSolution) {
+      const unsigned char *pos = slot + 1;
+      for (const auto object : objects) {
+        values.emplace_back(pos, pos + object->size);
+        pos += object->size;
+      }
+    }
+    status = hasSolution ? SOLVER_RUN_STATUS_SUCCESS_SOLVABLE
+                         : SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+    break;
+  }
+
+  for (pid_t pid : children)
+    kill(pid, SIGKILL);
+  for (pid_t pid : children) {
+    int childStatus;
+    while (waitpid(pid, &childStatus, 0) < 0 && errno == EINTR)
+      ;
+  }
+  close(done[0]);
+  munmap(region, regionSize);
+
+  if (status == SOLVER_RUN_STATUS_TIMEOUT)
+    klee_warning("Solver portfolio timed out");
+  return status;
+}
+
+bool PortfolioSolverImpl::solve(
+    QueryKind kind, const Query &query,
+    const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  TimerStatIncrementer t(stats::queryTime);
+  ++stats::solverQueries;
+  if (kind != TruthQuery)
+    ++stats::queryCounterexamples;
+
+  // Statistics counted by the backends are lost with their children
+  KindHistory &h = history[kind];
+  int routed = getRoutedBackend(kind);
+  std::vector<unsigned> entrants;
+  for (unsigned i = 0; i != backends.size(); ++i)
+    if (routed < 0 || unsigned(routed) == i)
+      entrants.push_back(i);
+
+  int winner = -1;
+  runStatusCode = race(entrants, query, objects, values, hasSolution, winner);
+
+  if (routed >= 0 && backends.size() > 1) {
+    ++h.routed;
+
+    // Give the other backends a chance when the routed one fails outright,
+    // but not when it used up the whole time budget
+    if (winner < 0 && runStatusCode != SOLVER_RUN_STATUS_TIMEOUT) {
+      entrants.clear();
+      for (unsigned i = 0; i != backends.size(); ++i)
+        if (unsigned(routed) != i)
+          entrants.push_back(i);
+      runStatusCode =
+          race(entrants, query, objects, values, hasSolution, winner);
+    }
+  } else if (winner >= 0 && entrants.size() > 1) {
+    ++h.races;
+    ++h.wins[winner];
+  }
+
+  if (winner < 0)
+    return false;
+  if (hasSolution)
+    ++stats::queriesInvalid;
+  else
+    ++stats::queriesValid;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution;
+  if (!solve(TruthQuery, query, {}, values, hasSolution))
+    return false;
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValue(const Query &query,
+                                       ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!solve(ValueQuery, query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+  return true;
+}
+
+bool PortfolioSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  return solve(InitialValuesQuery, query, objects, values, hasSolution);
+}
+
+std::string PortfolioSolverImpl::getConstraintLog(const Query &query) {
+  return backends.front().solver->impl->getConstraintLog(query);
+}
+
+void PortfolioSolverImpl::setCoreSolverTimeout(time::Span timeout) {
+  this->timeout = timeout;
+  for (auto &backend : backends)
+    backend.solver->setCoreSolverTimeout(timeout);
+}
+
+std::unique_ptr<Solver> klee::createPortfolioSolver(
+    std::vector<std::pair<std::string, std::unique_ptr<Solver>>> backends) {
+  return std::make_unique<Solver>(
+      std::make_unique<PortfolioSolverImpl>(std::move(backends)));
+}
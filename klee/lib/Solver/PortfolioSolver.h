@@ -0,0 +1,33 @@
+//===-- PortfolioSolver.h ---------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PORTFOLIOSOLVER_H
+#define KLEE_PORTFOLIOSOLVER_H
+
+#include "klee/Solver/Solver.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace klee {
+
+/// createPortfolioSolver - Create a core solver that races the given
+/// backends on every query, each in a forked child, and takes the first
+/// definitive answer. Once one backend keeps winning a kind of query, such
+/// queries are routed to it alone.
+///
+/// \param backends - The named core solvers to race. They are only ever run
+/// in child processes, so they should not fork themselves.
+std::unique_ptr<Solver> createPortfolioSolver(
+    std::vector<std::pair<std::string, std::unique_ptr<Solver>>> backends);
+} // namespace klee
+
+#endif /* KLEE_PORTFOLIOSOLVER_H */
@@ -388,14 +388,17 @@ bool STPSolverImpl::computeInitialValues(
 
   vc_push(vc);
 
-  for (const auto &constraint : query.constraints)
-    vc_assertFormula(vc, builder->construct(constraint));
+  ExprHandle stp_e;
+  {
+    TimerStatIncrementer construct(stats::queryConstructTime);
+    for (const auto &constraint : query.constraints)
+      vc_assertFormula(vc, builder->construct(constraint));
+    stp_e = builder->construct(query.expr);
+  }
 
   ++stats::solverQueries;
   ++stats::queryCounterexamples;
 
-  ExprHandle stp_e = builder->construct(query.expr);
-
   if (DebugDumpSTPQueries) {
     char *buf;
     unsigned long len;
@@ -51,6 +51,19 @@ cl::opt<bool> UseBranchCache("use-branch-cache", cl::init(true),
                              cl::desc("Use the branch cache (default=true)"),
                              cl::cat(SolvingCat));
 
+cl::opt<std::string> PersistentQueryCache(
+    "persistent-query-cache", cl::init(""),
+    cl::desc("Reuse the results of the core solver across runs through the "
+             "cache file at this path (default=off)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned long long> PersistentQueryCacheMaxSize(
+    "persistent-query-cache-max-size", cl::init(256ULL << 20),
+    cl::desc("Once the persistent query cache would grow beyond this size (in "
+             "bytes), its oldest records are dropped until it is half full. "
+             "Set to 0 to disable (default=256MiB)"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool>
     UseIndependentSolver("use-independent-solver", cl::init(true),
                          cl::desc("Use constraint independence (default=true)"),
@@ -196,7 +209,9 @@ cl::opt<CoreSolverType> CoreSolverToUse(
                clEnumValN(METASMT_SOLVER, "metasmt",
                           "metaSMT" METASMT_IS_DEFAULT_STR),
                clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
-               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR)),
+               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+               clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                          "Race all available solvers on every query")),
     cl::init(DEFAULT_CORE_SOLVER), cl::cat(SolvingCat));
 
 cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
@@ -27,7 +27,9 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <cstdint>
 #include <memory>
+#include <set>
 
 namespace {
 // NOTE: Very useful for debugging Z3 behaviour. These files can be given to
@@ -51,12 +53,61 @@ llvm::cl::opt<unsigned>
     Z3VerbosityLevel("debug-z3-verbosity", llvm::cl::init(0),
                      llvm::cl::desc("Z3 verbosity level (default=0)"),
                      llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<bool> Z3Incremental(
+    "z3-incremental", llvm::cl::init(false),
+    llvm::cl::desc("Reuse Z3 solvers across queries, enabling constraints "
+                   "through assumption literals (default=false)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> Z3SolverPoolSize(
+    "z3-solver-pool-size", llvm::cl::init(4),
+    llvm::cl::desc("Number of live Z3 solvers kept by -z3-incremental "
+                   "(default=4)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+// Guarded assertions a pooled solver may accumulate before it is rebuilt
+constexpr std::size_t MaxGuardedAssertions = 4096;
 }
 
 #include "llvm/Support/ErrorHandling.h"
 
 namespace klee {
 
+/// A Z3 solver kept alive across queries by -z3-incremental. Every
+/// constraint is asserted once as `literal => constraint`, and a query only
+/// assumes the literals of its own constraints, so constraints left over from
+/// other states never restrict it.
+struct Z3PooledSolver {
+  ::Z3_context ctx;
+  ::Z3_solver solver;
+  /// Literal guarding each asserted constraint
+  ExprHashMap<Z3ASTHandle> constraintLiterals;
+  /// Literal guarding the negation of each asserted query expression
+  ExprHashMap<Z3ASTHandle> queryLiterals;
+  /// Constant arrays whose contents are asserted unconditionally
+  std::set<const Array *> definedArrays;
+  /// Constraints of the last query, used to pick the solver for the next
+  std::vector<ref<Expr>> lastConstraints;
+  std::uint64_t lastUse = 0;
+
+  explicit Z3PooledSolver(::Z3_context ctx)
+      : ctx(ctx), solver(Z3_mk_solver(ctx)) {
+    Z3_solver_inc_ref(ctx, solver);
+  }
+  ~Z3PooledSolver() {
+    constraintLiterals.clear();
+    queryLiterals.clear();
+    Z3_solver_dec_ref(ctx, solver);
+  }
+  Z3PooledSolver(const Z3PooledSolver &) = delete;
+  Z3PooledSolver &operator=(const Z3PooledSolver &) = delete;
+
+  std::size_t guardedAssertions() const {
+    return constraintLiterals.size() + queryLiterals.size();
+  }
+};
+
 class Z3SolverImpl : public SolverImpl {
 private:
   std::unique_ptr<Z3Builder> builder;
@@ -66,7 +117,17 @@ private:
   ::Z3_params solverParameters;
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
-
+  // Solvers reused by -z3-incremental, destroyed before the builder's context
+  std::vector<std::unique_ptr<Z3PooledSolver>> solverPool;
+  std::uint64_t solverPoolClock = 0;
+
+  ::Z3_solver assertQuery(const Query &);
+  ::Z3_solver assertQueryIncrementally(const Query &,
+                                       std::vector<Z3ASTHandle> &assumptions);
+  Z3PooledSolver &selectPooledSolver(const Query &);
+  void assertConstantArrays(::Z3_solver theSolver,
+                            const ConstantArrayFinder &finder,
+                            std::set<const Array *> *defined);
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
                          std::vector<std::vector<unsigned char> > *values,
@@ -238,11 +299,22 @@ bool Z3SolverImpl::computeInitialValues(
   return internalRunSolver(query, &objects, &values, hasSolution);
 }
 
-bool Z3SolverImpl::internalRunSolver(
-    const Query &query, const std::vector<const Array *> *objects,
-    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+void Z3SolverImpl::assertConstantArrays(::Z3_solver theSolver,
+                                        const ConstantArrayFinder &finder,
+                                        std::set<const Array *> *defined) {
+  for (auto const &constant_array : finder.results) {
+    if (defined && !defined->insert(constant_array).second)
+      continue;
+    assert(builder->constant_array_assertions.count(constant_array) == 1 &&
+           "Constant array found in query, but not handled by Z3Builder");
+    for (auto const &arrayIndexValueExpr :
+         builder->constant_array_assertions[constant_array]) {
+      Z3_solver_assert(builder->ctx, theSolver, arrayIndexValueExpr);
+    }
+  }
+}
 
-  TimerStatIncrementer t(stats::queryTime);
+::Z3_solver Z3SolverImpl::assertQuery(const Query &query) {
   // NOTE: Z3 will switch to using a slower solver internally if push/pop are
   // used so for now it is likely that creating a new solver each time is the
   // right way to go until Z3 changes its behaviour.
@@ -251,31 +323,17 @@ bool Z3SolverImpl::internalRunSolver(
   // https://github.com/klee/klee/issues/653
   Z3_solver theSolver = Z3_mk_solver(builder->ctx);
   Z3_solver_inc_ref(builder->ctx, theSolver);
-  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
-
-  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
   ConstantArrayFinder constant_arrays_in_query;
   for (auto const &constraint : query.constraints) {
     Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
     constant_arrays_in_query.visit(constraint);
   }
-  ++stats::solverQueries;
-  if (objects)
-    ++stats::queryCounterexamples;
 
   Z3ASTHandle z3QueryExpr =
       Z3ASTHandle(builder->construct(query.expr), builder->ctx);
   constant_arrays_in_query.visit(query.expr);
-
-  for (auto const &constant_array : constant_arrays_in_query.results) {
-    assert(builder->constant_array_assertions.count(constant_array) == 1 &&
-           "Constant array found in query, but not handled by Z3Builder");
-    for (auto const &arrayIndexValueExpr :
-         builder->constant_array_assertions[constant_array]) {
-      Z3_solver_assert(builder->ctx, theSolver, arrayIndexValueExpr);
-    }
-  }
+  assertConstantArrays(theSolver, constant_arrays_in_query, nullptr);
 
   // KLEE Queries are validity queries i.e.
   // ∀ X Constraints(X) → query(X)
@@ -285,17 +343,152 @@ bool Z3SolverImpl::internalRunSolver(
   Z3_solver_assert(
       builder->ctx, theSolver,
       Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
+  return theSolver;
+}
+
+/// Picks the pooled solver whose last query shares the longest constraint
+/// prefix with `query`, as sibling states do. Without any shared prefix a
+/// new solver is started, evicting the least recently used one when the pool
+/// is full.
+Z3PooledSolver &Z3SolverImpl::selectPooledSolver(const Query &query) {
+  Z3PooledSolver *best = nullptr;
+  std::size_t bestPrefix = 0;
+  for (auto const &pooled : solverPool) {
+    std::size_t prefix = 0;
+    auto it = query.constraints.begin(), ie = query.constraints.end();
+    for (auto const &constraint : pooled->lastConstraints) {
+      if (it == ie || !(*it == constraint))
+        break;
+      ++prefix, ++it;
+    }
+    if (!best || prefix > bestPrefix ||
+        (prefix == bestPrefix && pooled->lastUse > best->lastUse)) {
+      best = pooled.get();
+      bestPrefix = prefix;
+    }
+  }
+
+  std::size_t poolSize = std::max(1u, unsigned(Z3SolverPoolSize));
+  if (!best || (bestPrefix == 0 && solverPool.size() < poolSize)) {
+    solverPool.push_back(std::make_unique<Z3PooledSolver>(builder->ctx));
+    return *solverPool.back();
+  }
+
+  std::unique_ptr<Z3PooledSolver> *slot = nullptr;
+  if (bestPrefix == 0) {
+    for (auto &pooled : solverPool)
+      if (!slot || pooled->lastUse < (*slot)->lastUse)
+        slot = &pooled;
+  } else if (best->guardedAssertions() >= MaxGuardedAssertions) {
+    for (auto &pooled : solverPool)
+      if (pooled.get() == best)
+        slot = &pooled;
+  } else {
+    return *best;
+  }
+  *slot = std::make_unique<Z3PooledSolver>(builder->ctx);
+  return **slot;
+}
+
+::Z3_solver
+Z3SolverImpl::assertQueryIncrementally(const Query &query,
+                                       std::vector<Z3ASTHandle> &assumptions) {
+  Z3PooledSolver &pooled = selectPooledSolver(query);
+  pooled.lastUse = ++solverPoolClock;
+  pooled.lastConstraints.assign(query.constraints.begin(),
+                                query.constraints.end());
+
+  Z3SortHandle boolSort =
+      Z3SortHandle(Z3_mk_bool_sort(builder->ctx), builder->ctx);
+  auto guard = [&](const Z3ASTHandle &formula) {
+    Z3ASTHandle literal = Z3ASTHandle(
+        Z3_mk_fresh_const(builder->ctx, "klee_assumption", boolSort),
+        builder->ctx);
+    Z3_solver_assert(
+        builder->ctx, pooled.solver,
+        Z3ASTHandle(Z3_mk_implies(builder->ctx, literal, formula),
+                    builder->ctx));
+    return literal;
+  };
+
+  // Only constraints new to this solver are constructed and asserted
+  ConstantArrayFinder constant_arrays_in_query;
+  for (auto const &constraint : query.constraints) {
+    auto it = pooled.constraintLiterals.find(constraint);
+    if (it == pooled.constraintLiterals.end()) {
+      it = pooled.constraintLiterals
+               .insert({constraint, guard(builder->construct(constraint))})
+               .first;
+      constant_arrays_in_query.visit(constraint);
+    }
+    assumptions.push_back(it->second);
+  }
+
+  // The negated query expression, as for a fresh solver
+  auto it = pooled.queryLiterals.find(query.expr);
+  if (it == pooled.queryLiterals.end()) {
+    Z3ASTHandle z3QueryExpr =
+        Z3ASTHandle(builder->construct(query.expr), builder->ctx);
+    it = pooled.queryLiterals
+             .insert({query.expr,
+                      guard(Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr),
+                                        builder->ctx))})
+             .first;
+    constant_arrays_in_query.visit(query.expr);
+  }
+  assumptions.push_back(it->second);
+
+  assertConstantArrays(pooled.solver, constant_arrays_in_query,
+                       &pooled.definedArrays);
+
+  Z3_solver_inc_ref(builder->ctx, pooled.solver);
+  return pooled.solver;
+}
+
+bool Z3SolverImpl::internalRunSolver(
+    const Query &query, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+
+  TimerStatIncrementer t(stats::queryTime);
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  std::vector<Z3ASTHandle> assumptions;
+  Z3_solver theSolver;
+  {
+    TimerStatIncrementer construct(stats::queryConstructTime);
+    theSolver = Z3Incremental ? assertQueryIncrementally(query, assumptions)
+                              : assertQuery(query);
+  }
+  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+  ++stats::solverQueries;
+  if (objects)
+    ++stats::queryCounterexamples;
 
   if (dumpedQueriesFile) {
     *dumpedQueriesFile << "; start Z3 query\n";
     *dumpedQueriesFile << Z3_solver_to_string(builder->ctx, theSolver);
-    *dumpedQueriesFile << "(check-sat)\n";
+    if (assumptions.empty()) {
+      *dumpedQueriesFile << "(check-sat)\n";
+    } else {
+      *dumpedQueriesFile << "(check-sat";
+      for (auto const &literal : assumptions)
+        *dumpedQueriesFile << " " << Z3_ast_to_string(builder->ctx, literal);
+      *dumpedQueriesFile << ")\n";
+    }
     *dumpedQueriesFile << "(reset)\n";
     *dumpedQueriesFile << "; end Z3 query\n\n";
     dumpedQueriesFile->flush();
   }
 
-  ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
+  ::Z3_lbool satisfiable;
+  if (assumptions.empty()) {
+    satisfiable = Z3_solver_check(builder->ctx, theSolver);
+  } else {
+    std::vector<::Z3_ast> rawAssumptions{assumptions.cbegin(),
+                                         assumptions.cend()};
+    satisfiable = Z3_solver_check_assumptions(
+        builder->ctx, theSolver, rawAssumptions.size(), rawAssumptions.data());
+  }
   runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
                                        hasSolution);
 
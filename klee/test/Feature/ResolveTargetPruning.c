@@ -0,0 +1,24 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -g -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --target=target %t.bc
+// RUN: %klee-stats --print-columns 'PrunedBranches' --table-format=csv %t.klee-out | FileCheck --check-prefix=CHECK-STATS %s
+
+// Check that the side of a symbolic branch that cannot reach the target is
+// dropped at fork time instead of being forked and pruned afterwards
+
+#include "klee/klee.h"
+
+int target(int x) {
+  return x - 10;
+}
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  // CHECK-STATS: {{^}}1{{$}}
+  // The false side skips the call to target
+  if (x > 10)
+    return target(x);
+  return 0;
+}
@@ -0,0 +1,21 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --workers=2 %t1.bc 2>&1 | FileCheck %s
+// RUN: test -d %t.klee-out/worker-0
+// RUN: test -d %t.klee-out/worker-1
+// RUN: ls %t.klee-out | grep -c '\.ktest$' | grep -q '^256$'
+// RUN: grep -q "Workers: 2" %t.klee-out/info
+#include "klee/klee.h"
+
+int main() {
+  unsigned char a[8];
+  unsigned n = 0;
+  klee_make_symbolic(a, sizeof(a), "a");
+  for (int i = 0; i < 8; ++i)
+    if (a[i] > 100)
+      ++n;
+  return n;
+}
+
+// CHECK: KLEE: done: completed paths = 256
+// CHECK: KLEE: done: generated tests = 256
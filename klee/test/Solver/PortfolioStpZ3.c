@@ -0,0 +1,12 @@
+// REQUIRES: stp
+// REQUIRES: z3
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=portfolio --use-cex-cache=false --use-branch-cache=false %t1.bc 2>&1 | FileCheck %s
+
+#include "ExerciseSolver.c.inc"
+
+// CHECK: KLEE: Using solver portfolio
+// CHECK: KLEE: Solver portfolio: {{.*}} queries won by stp {{[0-9]+}}, z3 {{[0-9]+}}
+// CHECK: KLEE: done: completed paths = 15
+// CHECK: KLEE: done: partially completed paths = 0
@@ -0,0 +1,419 @@
+//===-- WorkerPool.cpp ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "WorkerPool.h"
+
+#include "klee/Support/ErrorHandling.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/xxhash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <new>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// Bits of the shared coverage map, three per instruction. Instructions
+/// beyond it always count as new.
+constexpr std::size_t CoverageBits = std::size_t(1) << 26;
+/// Slots of the shared table of test case input hashes
+constexpr std::size_t TestHashSlots = std::size_t(1) << 16;
+/// Slots probed for a test case hash before giving up on deduplicating it
+constexpr std::size_t TestHashProbes = 64;
+
+struct WorkerSlot {
+  /// Pending states of the worker's current subtree
+  std::atomic<std::uint64_t> pendingStates;
+  /// Set by the coordinator to have the worker split off a subtree
+  std::atomic<bool> splitRequested;
+};
+
+} // namespace
+
+/// Everything the coordinator and the workers share, in an anonymous shared
+/// mapping set up before forking. It starts out zeroed.
+struct klee::WorkerShared {
+  std::atomic<bool> halt;
+  std::atomic<unsigned> lastTestId;
+  std::atomic<unsigned> generatedTests;
+  std::atomic<std::uint64_t> testHashes[TestHashSlots];
+  std::atomic<std::uint8_t> coverage[CoverageBits / 8];
+  WorkerSlot slots[1];
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "worker statistics must be shared without locks");
+
+static bool writeAll(int fd, const std::string &data) {
+  for (std::size_t written = 0; written < data.size();) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    written += n;
+  }
+  return true;
+}
+
+/// Reads the next line from \p fd into \p line, keeping what follows it in
+/// \p buffer. Returns false at the end of the input.
+static bool readLine(int fd, std::string &buffer, std::string &line) {
+  for (;;) {
+    std::size_t end = buffer.find('\n');
+    if (end != std::string::npos) {
+      line = buffer.substr(0, end);
+      buffer.erase(0, end + 1);
+      return true;
+    }
+
+    char chunk[4096];
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    buffer.append(chunk, n);
+  }
+}
+
+static std::string encodePath(const std::vector<bool> &path) {
+  std::string encoded;
+  encoded.reserve(path.size());
+  for (bool branch : path)
+    encoded += branch ? '1' : '0';
+  return encoded;
+}
+
+WorkerConnection::WorkerConnection(WorkerShared *shared, unsigned index,
+                                   int toCoordinator, int fromCoordinator,
+                                   const std::string &outputDirectory)
+    : shared(shared), index(index), toCoordinator(toCoordinator),
+      fromCoordinator(fromCoordinator), outputDirectory(outputDirectory) {}
+
+WorkerConnection::~WorkerConnection() {
+  close(toCoordinator);
+  close(fromCoordinator);
+}
+
+bool WorkerConnection::nextPrefix(std::vector<bool> &prefix) {
+  shared->slots[index].pendingStates = 0;
+  if (assigned && !writeAll(toCoordinator, "idle\n"))
+    return false;
+  assigned = false;
+
+  std::string line;
+  if (!readLine(fromCoordinator, buffer, line) ||
+      !llvm::StringRef(line).startswith("path "))
+    return false;
+
+  prefix.clear();
+  for (char branch : llvm::StringRef(line).drop_front(5))
+    prefix.push_back(branch == '1');
+  assigned = true;
+  return true;
+}
+
+bool WorkerConnection::wantsStateDonation(std::size_t pendingStates) {
+  WorkerSlot &slot = shared->slots[index];
+  slot.pendingStates = pendingStates;
+  return pendingStates > 1 && slot.splitRequested.exchange(false);
+}
+
+void WorkerConnection::donatePath(const std::vector<bool> &path) {
+  if (!writeAll(toCoordinator, "path " + encodePath(path) + "\n"))
+    klee_warning("unable to hand a subtree to the coordinator, losing it");
+}
+
+bool WorkerConnection::claimCoverage(unsigned instructionId,
+                                     InterpreterHandler::Coverage what) {
+  std::size_t bit = std::size_t(instructionId) * 3 + unsigned(what);
+  if (bit >= CoverageBits)
+    return true;
+  std::uint8_t mask = 1u << (bit % 8);
+  return !(shared->coverage[bit / 8].fetch_or(mask) & mask);
+}
+
+bool WorkerConnection::claimTestCase(
+    const std::vector<std::pair<std::string, std::vector<unsigned char>>>
+        &inputs) {
+  std::string key;
+  for (const auto &input : inputs) {
+    key += input.first;
+    key += '\0';
+    key += std::to_string(input.second.size());
+    key += '\0';
+    key.append(input.second.begin(), input.second.end());
+  }
+
+  // Zero marks a free slot
+  std::uint64_t hash = std::max<std::uint64_t>(llvm::xxHash64(key), 1);
+  for (std::size_t probe = 0; probe != TestHashProbes; ++probe) {
+    std::atomic<std::uint64_t> &slot =
+        shared->testHashes[(hash + probe) % TestHashSlots];
+    std::uint64_t expected = 0;
+    if (slot.compare_exchange_strong(expected, hash))
+      return true;
+    if (expected == hash)
+      return false;
+  }
+  return true;
+}
+
+unsigned WorkerConnection::nextTestId() { return ++shared->lastTestId; }
+
+void WorkerConnection::countGeneratedTest() { ++shared->generatedTests; }
+
+unsigned WorkerConnection::getNumGeneratedTests() const {
+  return shared->generatedTests;
+}
+
+bool WorkerConnection::isHalted() const { return shared->halt; }
+
+void WorkerConnection::haltAll() { shared->halt = true; }
+
+void WorkerConnection::finish(const WorkerTotals &totals) {
+  char line[128];
+  snprintf(line, sizeof(line),
+           "done %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+           totals.instructions, totals.completedPaths, totals.partialPaths,
+           totals.generatedTests);
+  writeAll(toCoordinator, line);
+}
+
+/***/
+
+namespace {
+
+struct Worker {
+  pid_t pid;
+  int toWorker, fromWorker;
+  std::string buffer;
+  bool alive = true;
+  /// Whether the worker is exploring a subtree
+  bool busy = false;
+};
+
+WorkerShared *coordinatedWorkers = nullptr;
+
+void haltWorkers() {
+  coordinatedWorkers->halt = true;
+  llvm::sys::SetInterruptFunction(haltWorkers);
+}
+
+/// Handles one message of \p worker. Returns false for an unknown message.
+bool handleMessage(Worker &worker, const std::string &message,
+                   std::deque<std::string> &subtrees, WorkerTotals &totals) {
+  llvm::StringRef line(message);
+  WorkerTotals reported;
+  if (line.consume_front("path ")) {
+    subtrees.push_back(line.str());
+  } else if (line == "idle") {
+    worker.busy = false;
+  } else if (sscanf(message.c_str(),
+                    "done %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+                    &reported.instructions, &reported.completedPaths,
+                    &reported.partialPaths, &reported.generatedTests) == 4) {
+    worker.busy = false;
+    totals.instructions += reported.instructions;
+    totals.completedPaths += reported.completedPaths;
+    totals.partialPaths += reported.partialPaths;
+    totals.generatedTests += reported.generatedTests;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/// Reads what \p worker sent. Returns false once it has exited.
+bool readMessages(Worker &worker, std::deque<std::string> &subtrees,
+                  WorkerTotals &totals) {
+  char chunk[4096];
+  ssize_t n = read(worker.fromWorker, chunk, sizeof(chunk));
+  if (n < 0 && errno == EINTR)
+    return true;
+  if (n <= 0)
+    return false;
+  worker.buffer.append(chunk, n);
+
+  for (std::size_t end; (end = worker.buffer.find('\n')) != std::string::npos;) {
+    std::string message = worker.buffer.substr(0, end);
+    worker.buffer.erase(0, end + 1);
+    if (!handleMessage(worker, message, subtrees, totals))
+      klee_warning("worker %d sent an unknown message", worker.pid);
+  }
+  return true;
+}
+
+void reapWorker(Worker &worker, bool halted) {
+  if (worker.busy && !halted)
+    klee_warning("worker %d exited while exploring, losing its subtree",
+                 worker.pid);
+  worker.alive = false;
+  worker.busy = false;
+  close(worker.toWorker);
+  close(worker.fromWorker);
+  int status;
+  while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR)
+    ;
+}
+
+} // namespace
+
+std::unique_ptr<WorkerConnection>
+klee::forkWorkers(unsigned numWorkers, const std::string &outputDirectory,
+                  time::Span maxTime, WorkerTotals &totals) {
+  std::size_t sharedSize =
+      sizeof(WorkerShared) + (numWorkers - 1) * sizeof(WorkerSlot);
+  void *mapping = mmap(nullptr, sharedSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED)
+    klee_error("unable to map memory shared by the workers: %s",
+               llvm::sys::StrError(errno).c_str());
+  WorkerShared *shared = new (mapping) WorkerShared;
+
+  fflush(stdout);
+  fflush(stderr);
+
+  std::vector<Worker> workers;
+  for (unsigned i = 0; i != numWorkers; ++i) {
+    int toWorker[2], fromWorker[2];
+    if (pipe(toWorker) < 0 || pipe(fromWorker) < 0)
+      klee_error("unable to create worker pipes: %s",
+                 llvm::sys::StrError(errno).c_str());
+
+    pid_t pid = fork();
+    if (pid < 0)
+      klee_error("unable to fork worker: %s",
+                 llvm::sys::StrError(errno).c_str());
+
+    if (pid == 0) {
+      for (const Worker &worker : workers) {
+        close(worker.toWorker);
+        close(worker.fromWorker);
+      }
+      close(toWorker[1]);
+      close(fromWorker[0]);
+      return std::make_unique<WorkerConnection>(
+          shared, i, fromWorker[1], toWorker[0], outputDirectory);
+    }
+
+    close(toWorker[0]);
+    close(fromWorker[1]);
+    Worker worker;
+    worker.pid = pid;
+    worker.toWorker = toWorker[1];
+    worker.fromWorker = fromWorker[0];
+    workers.push_back(std::move(worker));
+  }
+
+  // An idle worker must not take the coordinator down with it
+  signal(SIGPIPE, SIG_IGN);
+  coordinatedWorkers = shared;
+  llvm::sys::SetInterruptFunction(haltWorkers);
+
+  // Subtrees not explored yet, by the path prefix leading to them
+  std::deque<std::string> subtrees{""};
+  unsigned explored = 0;
+  time::Point deadline = time::getWallTime() + maxTime;
+
+  for (;;) {
+    if (maxTime && deadline <= time::getWallTime())
+      shared->halt = true;
+    bool halted = shared->halt;
+
+    for (Worker &worker : workers) {
+      if (!worker.alive || worker.busy || halted || subtrees.empty())
+        continue;
+      worker.busy = true;
+      ++explored;
+      if (!writeAll(worker.toWorker, "path " + subtrees.front() + "\n"))
+        reapWorker(worker, halted);
+      subtrees.pop_front();
+    }
+
+    unsigned idle = 0, busy = 0;
+    for (const Worker &worker : workers)
+      if (worker.alive)
+        ++(worker.busy ? busy : idle);
+    if (!busy && (halted || subtrees.empty()))
+      break;
+
+    // Have the workers with the most pending states split off a subtree for
+    // each idle worker
+    if (!halted) {
+      unsigned requested = 0;
+      for (unsigned i = 0; i != workers.size(); ++i) {
+        WorkerSlot &slot = shared->slots[i];
+        if (!workers[i].busy || slot.pendingStates < 2)
+          slot.splitRequested = false;
+        else if (slot.splitRequested)
+          ++requested;
+      }
+      for (; requested < idle; ++requested) {
+        WorkerSlot *largest = nullptr;
+        for (unsigned i = 0; i != workers.size(); ++i) {
+          WorkerSlot &slot = shared->slots[i];
+          if (workers[i].busy && !slot.splitRequested &&
+              slot.pendingStates > 1 &&
+              (!largest || slot.pendingStates > largest->pendingStates))
+            largest = &slot;
+        }
+        if (!largest)
+          break;
+        largest->splitRequested = true;
+      }
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<Worker *> polled;
+    for (Worker &worker : workers) {
+      if (!worker.alive)
+        continue;
+      fds.push_back({worker.fromWorker, POLLIN, 0});
+      polled.push_back(&worker);
+    }
+    int ready = poll(fds.data(), fds.size(), 100);
+    if (ready <= 0)
+      continue;
+
+    for (unsigned i = 0; i != fds.size(); ++i)
+      if (fds[i].revents && !readMessages(*polled[i], subtrees, totals))
+        reapWorker(*polled[i], halted);
+  }
+
+  // Let the remaining workers report their totals and exit
+  for (Worker &worker : workers) {
+    if (!worker.alive)
+      continue;
+    writeAll(worker.toWorker, "quit\n");
+    while (readMessages(worker, subtrees, totals))
+      ;
+    reapWorker(worker, true);
+  }
+
+  klee_message("%u workers explored %u subtrees", numWorkers, explored);
+  munmap(mapping, sharedSize);
+  return nullptr;
+}
@@ -0,0 +1,102 @@
+//===-- WorkerPool.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_WORKERPOOL_H
+#define KLEE_WORKERPOOL_H
+
+#include "klee/Core/Interpreter.h"
+#include "klee/System/Time.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace klee {
+struct WorkerShared;
+
+/// Totals a worker reports to the coordinator when it is done.
+struct WorkerTotals {
+  std::uint64_t instructions = 0;
+  std::uint64_t completedPaths = 0;
+  std::uint64_t partialPaths = 0;
+  std::uint64_t generatedTests = 0;
+};
+
+/// The worker end of a --workers run. A worker explores the subtrees the
+/// coordinator hands it one after the other, each given as the path prefix
+/// leading to it, and splits off part of its current subtree whenever the
+/// coordinator asks for one on behalf of an idle worker.
+class WorkerConnection {
+  WorkerShared *shared;
+  unsigned index;
+  int toCoordinator, fromCoordinator;
+  std::string outputDirectory;
+  std::string buffer;
+  bool assigned = false;
+
+public:
+  WorkerConnection(WorkerShared *shared, unsigned index, int toCoordinator,
+                   int fromCoordinator, const std::string &outputDirectory);
+  ~WorkerConnection();
+
+  unsigned getIndex() const { return index; }
+
+  /// The output directory of the whole run, where all test cases go.
+  const std::string &getOutputDirectory() const { return outputDirectory; }
+
+  /// Waits for the next subtree to explore. Returns false once there is
+  /// none left.
+  bool nextPrefix(std::vector<bool> &prefix);
+
+  /// See InterpreterHandler::wantsStateDonation.
+  bool wantsStateDonation(std::size_t pendingStates);
+  void donatePath(const std::vector<bool> &path);
+
+  /// See InterpreterHandler::claimCoverage, shared by all workers.
+  bool claimCoverage(unsigned instructionId,
+                     InterpreterHandler::Coverage what);
+
+  /// Returns false if a test case with the same inputs was already written
+  /// by any worker.
+  bool claimTestCase(
+      const std::vector<std::pair<std::string, std::vector<unsigned char>>>
+          &inputs);
+
+  /// Returns the next test case id, unique across all workers.
+  unsigned nextTestId();
+
+  /// Counts a written test case.
+  void countGeneratedTest();
+
+  /// Returns the test cases written by all workers.
+  unsigned getNumGeneratedTests() const;
+
+  /// Whether any worker or the coordinator asked all workers to stop.
+  bool isHalted() const;
+  void haltAll();
+
+  /// Reports this worker's totals to the coordinator.
+  void finish(const WorkerTotals &totals);
+};
+
+/// Forks \p numWorkers workers exploring the program into
+/// \p outputDirectory. Returns the connection in each worker. In the calling
+/// process it coordinates the workers until the program is explored or
+/// \p maxTime has passed, then returns null and the summed worker totals in
+/// \p totals.
+std::unique_ptr<WorkerConnection> forkWorkers(unsigned numWorkers,
+                                              const std::string &outputDirectory,
+                                              time::Span maxTime,
+                                              WorkerTotals &totals);
+} // namespace klee
+
+#endif /* KLEE_WORKERPOOL_H */
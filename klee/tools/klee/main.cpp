@@ -29,6 +29,8 @@
 #include "reach/graph.hpp"
 #include "resolve_facts_llvm/resolve_facts_llvm.hpp"
 
+#include "WorkerPool.h"
+
 #include "klee/Support/CompilerWarning.h"
 DISABLE_WARNING_PUSH
 DISABLE_WARNING_DEPRECATED_DECLARATIONS
@@ -154,6 +156,13 @@ namespace {
           cl::desc("Parse environment from the given file (in \"env\" format)"),
           cl::cat(StartCat));
 
+  cl::opt<unsigned>
+  Workers("workers",
+          cl::desc("Number of processes exploring disjoint parts of the "
+                   "program in parallel (default=1)"),
+          cl::init(1),
+          cl::cat(StartCat));
+
   cl::opt<bool>
   OptimizeModule("optimize",
                  cl::desc("Optimize the code before execution (default=false)."),
@@ -262,6 +271,13 @@ namespace {
 		 cl::value_desc("target function"),
 		 cl::cat(StartCat));
 
+  cl::opt<std::string>
+  ReachPathsFile("reach-paths",
+		 cl::desc("reach results JSON with paths to the --target "
+			  "function, followed by --search=resolve-path"),
+		 cl::value_desc("reach results"),
+		 cl::cat(StartCat));
+
   cl::opt<std::string>
   DumpProgramPath("dump-program-path",
 		  cl::desc("Path to dump final program IR to"),
@@ -319,25 +335,30 @@ private:
   std::unique_ptr<llvm::raw_ostream> m_infoFile;
 
   SmallString<128> m_outputDirectory;
+  SmallString<128> m_testDirectory;
 
   unsigned m_numTotalTests;     // Number of tests received from the interpreter
   unsigned m_numGeneratedTests; // Number of tests successfully generated
   unsigned m_pathsCompleted; // number of completed paths
   unsigned m_pathsExplored; // number of partially explored and completed paths
+  unsigned m_pathsDonated; // number of paths handed over to other workers
+
+  // set when running as one of several --workers
+  WorkerConnection *m_worker;
 
   // used for writing .ktest files
   int m_argc;
   char **m_argv;
 
 public:
-  KleeHandler(int argc, char **argv);
+  KleeHandler(int argc, char **argv, WorkerConnection *worker = nullptr);
   ~KleeHandler();
 
   llvm::raw_ostream &getInfoStream() const { return *m_infoFile; }
   /// Returns the number of test cases successfully generated so far
   unsigned getNumTestCases() { return m_numGeneratedTests; }
   unsigned getNumPathsCompleted() { return m_pathsCompleted; }
-  unsigned getNumPathsExplored() { return m_pathsExplored; }
+  unsigned getNumPathsExplored() { return m_pathsExplored - m_pathsDonated; }
   void incPathsCompleted() { ++m_pathsCompleted; }
   void incPathsExplored(std::uint32_t num = 1) {
     m_pathsExplored += num; }
@@ -348,6 +369,16 @@ public:
                        const char *errorMessage,
                        const char *errorSuffix);
 
+  bool claimCoverage(unsigned instructionId, Coverage what) override {
+    return !m_worker || m_worker->claimCoverage(instructionId, what);
+  }
+
+  bool wantsStateDonation(std::size_t pendingStates) override;
+  void donatePath(const std::vector<bool> &path) override;
+
+  // create OutputDir or "klee-out-<i>"
+  static std::string createOutputDirectory();
+
   std::string getOutputFilename(const std::string &filename);
   std::unique_ptr<llvm::raw_fd_ostream> openOutputFile(const std::string &filename);
   std::string getTestFilename(const std::string &suffix, unsigned id);
@@ -364,18 +395,20 @@ public:
    std::unordered_map<const llvm::Instruction*, size_t> &distMap,
    std::unordered_set<const llvm::Instruction*> &blackList);
 
+  static bool loadReachPaths
+  (const std::vector<std::unique_ptr<llvm::Module>> &loadedModules,
+   llvm::Module *mainModule,
+   const std::string &reachPathsFile,
+   std::vector<std::vector<const llvm::Instruction*>> &paths);
+
   static void getKTestFilesInDir(std::string directoryPath,
                                  std::vector<std::string> &results);
 
   static std::string getRunTimeLibraryPath(const char *argv0);
 };
 
-KleeHandler::KleeHandler(int argc, char **argv)
-    : m_interpreter(0), m_pathWriter(0), m_symPathWriter(0),
-      m_outputDirectory(), m_numTotalTests(0), m_numGeneratedTests(0),
-      m_pathsCompleted(0), m_pathsExplored(0), m_argc(argc), m_argv(argv) {
-
-  // create output directory (OutputDir or "klee-out-<i>")
+std::string KleeHandler::createOutputDirectory() {
+  SmallString<128> outputDirectory;
   bool dir_given = OutputDir != "";
   SmallString<128> directory(dir_given ? OutputDir : InputFile);
 
@@ -389,7 +422,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
     if (mkdir(directory.c_str(), 0775) < 0)
       klee_error("cannot create \"%s\": %s", directory.c_str(), strerror(errno));
 
-    m_outputDirectory = directory;
+    outputDirectory = directory;
   } else {
     // "klee-out-<i>"
     int i = 0;
@@ -402,7 +435,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
 
       // create directory and try to link klee-last
       if (mkdir(d.c_str(), 0775) == 0) {
-        m_outputDirectory = d;
+        outputDirectory = d;
 
         SmallString<128> klee_last(directory);
         llvm::sys::path::append(klee_last, "klee-last");
@@ -412,9 +445,9 @@ KleeHandler::KleeHandler(int argc, char **argv)
                        strerror(errno));
         }
 
-        size_t offset = m_outputDirectory.size() -
-                        llvm::sys::path::filename(m_outputDirectory).size();
-        if (symlink(m_outputDirectory.c_str() + offset, klee_last.c_str()) <
+        size_t offset = outputDirectory.size() -
+                        llvm::sys::path::filename(outputDirectory).size();
+        if (symlink(outputDirectory.c_str() + offset, klee_last.c_str()) <
             0) {
           klee_warning("cannot create klee-last symlink: %s", strerror(errno));
         }
@@ -424,13 +457,35 @@ KleeHandler::KleeHandler(int argc, char **argv)
 
       // otherwise try again or exit on error
       if (errno != EEXIST)
-        klee_error("cannot create \"%s\": %s", m_outputDirectory.c_str(), strerror(errno));
+        klee_error("cannot create \"%s\": %s", outputDirectory.c_str(), strerror(errno));
     }
-    if (i == INT_MAX && m_outputDirectory.str().equals(""))
+    if (i == INT_MAX && outputDirectory.str().equals(""))
         klee_error("cannot create output directory: index out of range");
   }
 
-  klee_message("output directory is \"%s\"", m_outputDirectory.c_str());
+  klee_message("output directory is \"%s\"", outputDirectory.c_str());
+  return outputDirectory.str().str();
+}
+
+KleeHandler::KleeHandler(int argc, char **argv, WorkerConnection *worker)
+    : m_interpreter(0), m_pathWriter(0), m_symPathWriter(0),
+      m_outputDirectory(), m_numTotalTests(0), m_numGeneratedTests(0),
+      m_pathsCompleted(0), m_pathsExplored(0), m_pathsDonated(0),
+      m_worker(worker), m_argc(argc), m_argv(argv) {
+
+  if (m_worker) {
+    // Workers share the test cases, but keep everything else apart
+    m_testDirectory = m_worker->getOutputDirectory();
+    m_outputDirectory = m_testDirectory;
+    sys::path::append(m_outputDirectory,
+                      "worker-" + std::to_string(m_worker->getIndex()));
+    if (mkdir(m_outputDirectory.c_str(), 0775) < 0)
+      klee_error("cannot create \"%s\": %s", m_outputDirectory.c_str(),
+                 strerror(errno));
+  } else {
+    m_outputDirectory = createOutputDirectory();
+    m_testDirectory = m_outputDirectory;
+  }
 
   // open warnings.txt
   std::string file_path = getOutputFilename("warnings.txt");
@@ -456,7 +511,8 @@ KleeHandler::~KleeHandler() {
 void KleeHandler::setInterpreter(Interpreter *i) {
   m_interpreter = i;
 
-  if (WritePaths) {
+  // Workers hand over subtrees by the path leading to them
+  if (WritePaths || m_worker) {
     m_pathWriter = new TreeStreamWriter(getOutputFilename("paths.ts"));
     assert(m_pathWriter->good());
     m_interpreter->setPathWriter(m_pathWriter);
@@ -498,7 +554,30 @@ std::string KleeHandler::getTestFilename(const std::string &suffix, unsigned id)
 
 std::unique_ptr<llvm::raw_fd_ostream>
 KleeHandler::openTestFile(const std::string &suffix, unsigned id) {
-  return openOutputFile(getTestFilename(suffix, id));
+  if (m_testDirectory == m_outputDirectory)
+    return openOutputFile(getTestFilename(suffix, id));
+
+  std::string Error;
+  SmallString<128> path = m_testDirectory;
+  sys::path::append(path, getTestFilename(suffix, id));
+  auto f = klee_open_output_file(path.c_str(), Error);
+  if (!f)
+    klee_warning("error opening file \"%s\" (%s).", path.c_str(),
+                 Error.c_str());
+  return f;
+}
+
+bool KleeHandler::wantsStateDonation(std::size_t pendingStates) {
+  if (!m_worker)
+    return false;
+  if (m_worker->isHalted())
+    m_interpreter->setHaltExecution(true);
+  return m_worker->wantsStateDonation(pendingStates);
+}
+
+void KleeHandler::donatePath(const std::vector<bool> &path) {
+  m_worker->donatePath(path);
+  ++m_pathsDonated;
 }
 
 
@@ -506,16 +585,19 @@ KleeHandler::openTestFile(const std::string &suffix, unsigned id) {
 void KleeHandler::processTestCase(const ExecutionState &state,
                                   const char *errorMessage,
                                   const char *errorSuffix) {
-  if (!WriteNone) {
-    std::vector< std::pair<std::string, std::vector<unsigned char> > > out;
-    bool success = m_interpreter->getSymbolicSolution(state, out);
+  std::vector< std::pair<std::string, std::vector<unsigned char> > > out;
+  bool success = !WriteNone && m_interpreter->getSymbolicSolution(state, out);
+
+  // Other workers may have reached the same inputs on a different path
+  bool duplicate = success && m_worker && !m_worker->claimTestCase(out);
 
+  if (!WriteNone && !duplicate) {
     if (!success)
       klee_warning("unable to get symbolic solution, losing test case");
 
     const auto start_time = time::getWallTime();
 
-    unsigned id = ++m_numTotalTests;
+    unsigned id = m_worker ? m_worker->nextTestId() : ++m_numTotalTests;
 
     if (success) {
       KTest b;
@@ -535,10 +617,14 @@ void KleeHandler::processTestCase(const ExecutionState &state,
         std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
       }
 
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
+      SmallString<128> path = m_testDirectory;
+      sys::path::append(path, getTestFilename("ktest", id));
+      if (!kTest_toFile(&b, path.c_str())) {
         klee_warning("unable to write output test case, losing it");
       } else {
         ++m_numGeneratedTests;
+        if (m_worker)
+          m_worker->countGeneratedTest();
       }
 
       for (unsigned i=0; i<b.numObjects; i++)
@@ -552,7 +638,7 @@ void KleeHandler::processTestCase(const ExecutionState &state,
         *f << errorMessage;
     }
 
-    if (m_pathWriter) {
+    if (m_pathWriter && WritePaths) {
       std::vector<unsigned char> concreteBranches;
       m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
                                concreteBranches);
@@ -615,8 +701,12 @@ void KleeHandler::processTestCase(const ExecutionState &state,
       }
     }
 
-    if (m_numGeneratedTests == MaxTests)
+    if (m_numGeneratedTests == MaxTests ||
+        (m_worker && MaxTests && m_worker->getNumGeneratedTests() >= MaxTests)) {
+      if (m_worker)
+        m_worker->haltAll();
       m_interpreter->setHaltExecution(true);
+    }
 
     if (WriteTestInfo) {
       time::Span elapsed_time(time::getWallTime() - start_time);
@@ -673,6 +763,25 @@ void build_distmap_blacklist_for_module
   }
 }
 
+void map_nodes_to_instructions_for_module
+(resolve_facts::NodeMap<const llvm::Instruction*> &nodes,
+ const llvm::Module &M) {
+  const auto mid = resolve::facts.getModuleId(M);
+  for (const Function &F : M) {
+    if (F.isDeclaration()) {
+      continue;
+    }
+    nodes[std::make_pair(mid, resolve::facts.addNode(F))] =
+      &F.getEntryBlock().front();
+    for (const BasicBlock &BB : F) {
+      nodes[std::make_pair(mid, resolve::facts.addNode(BB))] = &BB.front();
+      for (const Instruction &I : BB) {
+        nodes[std::make_pair(mid, resolve::facts.addNode(I))] = &I;
+      }
+    }
+  }
+}
+
 // Search for function node id that matches name
 std::optional<NNodeId> findMatchingFunctionNodeId(const reach_facts::database &db,
 						      const std::string functionName) {
@@ -748,6 +857,70 @@ bool KleeHandler::buildDistMapAndBlackList
   return true;
 }
 
+// Load the paths of a reach results file, mapping each node to the first
+// instruction it executes. The node ids refer to the facts computed in
+// buildDistMapAndBlackList, which must run first.
+bool KleeHandler::loadReachPaths
+(const std::vector<std::unique_ptr<llvm::Module>> &loadedModules,
+ llvm::Module *mainModule,
+ const std::string &reachPathsFile,
+ std::vector<std::vector<const llvm::Instruction*>> &paths) {
+  std::ifstream f(reachPathsFile);
+  if (!f.is_open()) {
+    klee_warning("unable to open reach paths file %s", reachPathsFile.c_str());
+    return false;
+  }
+
+  const auto results = nlohmann::json::parse(f, nullptr, false);
+  if (!results.is_object()) {
+    klee_warning("invalid reach paths file %s", reachPathsFile.c_str());
+    return false;
+  }
+
+  resolve_facts::NodeMap<const llvm::Instruction*> nodes;
+  for (const auto &M : loadedModules) {
+    map_nodes_to_instructions_for_module(nodes, *M);
+  }
+  map_nodes_to_instructions_for_module(nodes, *mainModule);
+
+  size_t unmatched = 0;
+  for (const auto &query : results.value("query_results", nlohmann::json::array())) {
+    if (!query.is_object()) {
+      continue;
+    }
+    for (const auto &path : query.value("paths", nlohmann::json::array())) {
+      if (!path.is_object()) {
+	continue;
+      }
+      std::vector<const llvm::Instruction*> instrs;
+      for (const auto &node : path.value("nodes", nlohmann::json::array())) {
+	if (!node.is_array() || node.size() != 2 ||
+	    !node[0].is_number_unsigned() || !node[1].is_number_unsigned()) {
+	  unmatched++;
+	  continue;
+	}
+	const auto id = node.get<resolve_facts::NamespacedNodeId>();
+	const auto it = nodes.find(id);
+	if (it == nodes.end()) {
+	  unmatched++;
+	  continue;
+	}
+	instrs.push_back(it->second);
+      }
+      if (!instrs.empty()) {
+	paths.push_back(std::move(instrs));
+      }
+    }
+  }
+
+  if (unmatched) {
+    klee_warning("%zu reach path nodes do not match the loaded program",
+		 unmatched);
+  }
+  klee_message("loaded %zu reach paths", paths.size());
+  return !paths.empty();
+}
+
 void KleeHandler::getKTestFilesInDir(std::string directoryPath,
                                      std::vector<std::string> &results) {
   std::error_code ec;
@@ -1239,6 +1412,45 @@ linkWithUclibc(StringRef libDir, std::string opt_suffix,
                FortifyPath.c_str(), errorMsg.c_str());
 }
 
+static void printStats(const std::string &stats) {
+  bool useColors = llvm::errs().is_displayed();
+  if (useColors)
+    llvm::errs().changeColor(llvm::raw_ostream::GREEN,
+                             /*bold=*/true,
+                             /*bg=*/false);
+
+  llvm::errs() << stats;
+
+  if (useColors)
+    llvm::errs().resetColor();
+}
+
+static int reportWorkerTotals(const std::string &outputDirectory, int argc,
+                              char **argv, const WorkerTotals &totals) {
+  std::stringstream stats;
+  stats << '\n'
+        << "KLEE: done: total instructions = " << totals.instructions << '\n'
+        << "KLEE: done: completed paths = " << totals.completedPaths << '\n'
+        << "KLEE: done: partially completed paths = " << totals.partialPaths
+        << '\n'
+        << "KLEE: done: generated tests = " << totals.generatedTests << '\n';
+  printStats(stats.str());
+
+  SmallString<128> path(outputDirectory);
+  sys::path::append(path, "info");
+  std::string error;
+  auto info = klee_open_output_file(path.c_str(), error);
+  if (!info) {
+    klee_warning("error opening file \"%s\" (%s).", path.c_str(),
+                 error.c_str());
+    return 1;
+  }
+  for (int i = 0; i < argc; i++)
+    *info << argv[i] << (i + 1 < argc ? " " : "\n");
+  *info << "Workers: " << Workers << '\n' << stats.str();
+  return 0;
+}
+
 int main(int argc, char **argv, char **envp) {
   atexit(llvm_shutdown); // Call llvm_shutdown() on exit
 
@@ -1515,9 +1727,26 @@ int main(int argc, char **argv, char **envp) {
     pArgv[i] = pArg;
   }
 
+  // Split exploration across worker processes, each of which continues from
+  // here while this process coordinates them
+  std::unique_ptr<WorkerConnection> worker;
+  if (Workers > 1) {
+    if (!ReplayKTestDir.empty() || !ReplayKTestFile.empty() ||
+        !ReplayPathFile.empty())
+      klee_error("--workers cannot be combined with replaying");
+
+    std::string outputDirectory = KleeHandler::createOutputDirectory();
+    WorkerTotals totals;
+    worker = forkWorkers(Workers, outputDirectory, time::Span(MaxTime),
+                         totals);
+    if (!worker)
+      return reportWorkerTotals(outputDirectory, argc, argv, totals);
+  }
+
   Interpreter::InterpreterOptions IOpts;
   IOpts.MakeConcreteSymbolic = MakeConcreteSymbolic;
-  KleeHandler *handler = new KleeHandler(pArgc, pArgv);
+  IOpts.DonateStates = worker != nullptr;
+  KleeHandler *handler = new KleeHandler(pArgc, pArgv, worker.get());
   Interpreter *interpreter =
     theInterpreter = Interpreter::create(ctx, IOpts, handler);
   assert(interpreter);
@@ -1565,6 +1794,16 @@ int main(int argc, char **argv, char **envp) {
     interpreter->setBlackList(&blackList);
   }
 
+  std::vector<std::vector<const llvm::Instruction*>> reachPaths;
+  if (!ReachPathsFile.empty()) {
+    if (!success) {
+      klee_warning("--reach-paths requires a valid --target, ignoring paths");
+    } else if (KleeHandler::loadReachPaths(loadedModules, finalModule,
+					   ReachPathsFile, reachPaths)) {
+      interpreter->setReachPaths(&reachPaths);
+    }
+  }
+
   auto startTime = std::time(nullptr);
   { // output clock info and start time
     std::stringstream startInfo;
@@ -1664,7 +1903,19 @@ int main(int argc, char **argv, char **envp) {
       }
     }
 
-    interpreter->runFunctionAsMain(entryFn, pArgc, pArgv, pEnvp);
+    if (worker) {
+      // Seeds only apply to the whole program, which the first subtree is
+      std::vector<bool> prefix;
+      while (worker->nextPrefix(prefix)) {
+        interpreter->setPathPrefix(&prefix);
+        interpreter->runFunctionAsMain(entryFn, pArgc, pArgv, pEnvp);
+        interpreter->useSeeds(0);
+        if (interrupted) break;
+      }
+      interpreter->setPathPrefix(0);
+    } else {
+      interpreter->runFunctionAsMain(entryFn, pArgc, pArgv, pEnvp);
+    }
 
     while (!seeds.empty()) {
       kTest_free(seeds.back());
@@ -1739,19 +1990,22 @@ int main(int argc, char **argv, char **envp) {
         << "KLEE: done: generated tests = " << handler->getNumTestCases()
         << '\n';
 
-  bool useColors = llvm::errs().is_displayed();
-  if (useColors)
-    llvm::errs().changeColor(llvm::raw_ostream::GREEN,
-                             /*bold=*/true,
-                             /*bg=*/false);
-
-  llvm::errs() << stats.str();
-
-  if (useColors)
-    llvm::errs().resetColor();
+  // The coordinator reports the totals of all workers
+  if (!worker)
+    printStats(stats.str());
 
   handler->getInfoStream() << stats.str();
 
+  if (worker) {
+    WorkerTotals totals;
+    totals.instructions = instructions;
+    totals.completedPaths = handler->getNumPathsCompleted();
+    totals.partialPaths =
+        handler->getNumPathsExplored() - handler->getNumPathsCompleted();
+    totals.generatedTests = handler->getNumTestCases();
+    worker->finish(totals);
+  }
+
   delete handler;
 
   return 0;
@@ -0,0 +1,148 @@
+//===-- ConstraintsTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+ref<Expr> readByte(const Array *array, unsigned index) {
+  return ReadExpr::create(UpdateList(array, nullptr),
+                          ConstantExpr::alloc(index, Expr::Int32));
+}
+
+ref<Expr> isLarge(const ref<Expr> &byte) {
+  return UltExpr::create(ConstantExpr::alloc(100, Expr::Int8), byte);
+}
+
+std::vector<ref<Expr>> independent(const ConstraintSet &constraints,
+                                   const ref<Expr> &e) {
+  std::vector<ref<Expr>> result;
+  EXPECT_TRUE(constraints.getIndependentConstraints(e, result));
+  return result;
+}
+
+TEST(ConstraintsTest, SeparateBytes) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  ref<Expr> c0 = isLarge(readByte(a, 0));
+  ref<Expr> c1 = isLarge(readByte(a, 1));
+  ref<Expr> c2 = isLarge(readByte(a, 2));
+
+  ConstraintSet constraints;
+  ConstraintManager cm(constraints);
+  cm.addConstraint(c0);
+  cm.addConstraint(c1);
+  cm.addConstraint(c2);
+
+  EXPECT_EQ(std::vector<ref<Expr>>{c1},
+            independent(constraints, isLarge(readByte(a, 1))));
+  EXPECT_TRUE(independent(constraints, isLarge(readByte(a, 3))).empty());
+}
+
+TEST(ConstraintsTest, TransitiveDependencies) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  ref<Expr> c0 = isLarge(readByte(a, 0));
+  ref<Expr> c1 = isLarge(readByte(a, 2));
+  ref<Expr> c2 = UltExpr::create(readByte(a, 0), readByte(a, 1));
+  ref<Expr> c3 = UltExpr::create(readByte(a, 1), readByte(a, 2));
+
+  ConstraintSet constraints;
+  ConstraintManager cm(constraints);
+  cm.addConstraint(c0);
+  cm.addConstraint(c1);
+  cm.addConstraint(c2);
+  EXPECT_EQ(std::vector<ref<Expr>>{c1},
+            independent(constraints, isLarge(readByte(a, 2))));
+
+  // Joins both classes, which keep the order the constraints were added in
+  cm.addConstraint(c3);
+  std::vector<ref<Expr>> expected{c0, c1, c2, c3};
+  EXPECT_EQ(expected, independent(constraints, isLarge(readByte(a, 2))));
+}
+
+TEST(ConstraintsTest, SymbolicIndex) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  const Array *b = ac.CreateArray("b", 4);
+  ref<Expr> c0 = isLarge(readByte(a, 0));
+  ref<Expr> c1 = isLarge(readByte(b, 0));
+  ref<Expr> c2 = isLarge(readByte(b, 1));
+  ref<Expr> c3 = isLarge(ReadExpr::create(
+      UpdateList(a, nullptr), ZExtExpr::create(readByte(b, 0), Expr::Int32)));
+
+  ConstraintSet constraints;
+  ConstraintManager cm(constraints);
+  cm.addConstraint(c0);
+  cm.addConstraint(c1);
+  cm.addConstraint(c2);
+  cm.addConstraint(c3);
+
+  // The symbolic read stands for all of a, so a[3] depends on a[0] and b[0]
+  std::vector<ref<Expr>> expected{c0, c1, c3};
+  EXPECT_EQ(expected, independent(constraints, isLarge(readByte(a, 3))));
+  EXPECT_EQ(std::vector<ref<Expr>>{c2},
+            independent(constraints, isLarge(readByte(b, 1))));
+}
+
+TEST(ConstraintsTest, CopiesAreIndependent) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  ref<Expr> c0 = isLarge(readByte(a, 0));
+  ref<Expr> c1 = UltExpr::create(readByte(a, 0), readByte(a, 1));
+
+  ConstraintSet constraints;
+  ConstraintManager(constraints).addConstraint(c0);
+
+  ConstraintSet copy = constraints;
+  ConstraintManager(copy).addConstraint(c1);
+
+  ref<Expr> query = isLarge(readByte(a, 1));
+  EXPECT_TRUE(independent(constraints, query).empty());
+  std::vector<ref<Expr>> expected{c0, c1};
+  EXPECT_EQ(expected, independent(copy, query));
+}
+
+TEST(ConstraintsTest, CopiesMergeIndependently) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 64);
+  ConstraintSet constraints;
+  for (unsigned i = 0; i != 64; ++i)
+    constraints.push_back(isLarge(readByte(a, i)));
+
+  // A read at a symbolic index merges every class of the copy only
+  ConstraintSet copy = constraints;
+  copy.push_back(isLarge(ReadExpr::create(
+      UpdateList(a, nullptr), ZExtExpr::create(readByte(a, 0), Expr::Int32))));
+
+  ref<Expr> query = isLarge(readByte(a, 5));
+  EXPECT_EQ(std::vector<ref<Expr>>{isLarge(readByte(a, 5))},
+            independent(constraints, query));
+  std::vector<ref<Expr>> expected(copy.begin(), copy.end());
+  EXPECT_EQ(expected, independent(copy, query));
+}
+
+TEST(ConstraintsTest, UntrackedSet) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  ConstraintSet constraints(std::vector<ref<Expr>>{isLarge(readByte(a, 0))});
+
+  std::vector<ref<Expr>> result;
+  EXPECT_FALSE(constraints.getIndependentConstraints(isLarge(readByte(a, 0)),
+                                                     result));
+}
+} // namespace
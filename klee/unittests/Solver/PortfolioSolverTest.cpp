@@ -0,0 +1,79 @@
+//===-- PortfolioSolverTest.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Solver/PortfolioSolver.h"
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// Proves every query valid, or fails on every query
+class FixedSolverImpl : public SolverImpl {
+  bool answers;
+
+public:
+  explicit FixedSolverImpl(bool answers) : answers(answers) {}
+
+  bool computeTruth(const Query &, bool &isValid) override {
+    isValid = true;
+    return answers;
+  }
+  bool computeValue(const Query &, ref<Expr> &) override { return false; }
+  bool computeInitialValues(const Query &, const std::vector<const Array *> &,
+                            std::vector<std::vector<unsigned char>> &,
+                            bool &hasSolution) override {
+    hasSolution = false;
+    return answers;
+  }
+  SolverRunStatus getOperationStatusCode() override {
+    return answers ? SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE
+                   : SOLVER_RUN_STATUS_FAILURE;
+  }
+};
+
+TEST(PortfolioSolverTest, KeepsRacingRoutedQueries) {
+  std::vector<std::pair<std::string, std::unique_ptr<Solver>>> backends;
+  backends.emplace_back("answers", std::make_unique<Solver>(
+                                       std::make_unique<FixedSolverImpl>(true)));
+  backends.emplace_back("fails", std::make_unique<Solver>(
+                                     std::make_unique<FixedSolverImpl>(false)));
+  auto solver = createPortfolioSolver(std::move(backends));
+
+  // 32 races route truth queries to the backend that won them all, after
+  // which every 16th query is raced again
+  ConstraintSet constraints;
+  Query query(constraints, ConstantExpr::create(1, Expr::Bool));
+  testing::internal::CaptureStderr();
+  for (unsigned i = 0; i != 32 + 64; ++i) {
+    bool isValid = false;
+    ASSERT_TRUE(solver->impl->computeTruth(query, isValid));
+    ASSERT_TRUE(isValid);
+  }
+  solver.reset();
+  std::string messages = testing::internal::GetCapturedStderr();
+
+  EXPECT_NE(messages.find("Solver portfolio: truth queries won by "
+                          "answers 36, fails 0 (60 routed)"),
+            std::string::npos)
+      << messages;
+}
+
+} // namespace
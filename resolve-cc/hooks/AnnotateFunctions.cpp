@@ -16,8 +16,10 @@
 
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/Transforms/Instrumentation.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 #include <cstdint>
+#include <cstdlib>
 #include <map>
 #include <string>
 #include <vector>
@@ -51,7 +53,22 @@ std::string getLLVMType(Type *ty) {
   report_fatal_error("unsupported type");
 }
 
+/* Width of the inline basic block counters selected by RESOLVE_BB_COUNTERS.
+ * Returns 0 when unset, in which case every block calls libresolve_bb. */
+static unsigned getBBCounterWidth() {
+  std::string mode = std::getenv("RESOLVE_BB_COUNTERS") ?: "";
+  if (mode.empty())
+    return 0;
+  if (mode == "8")
+    return 8;
+  if (mode == "64")
+    return 64;
+
+  report_fatal_error("[ERROR]: RESOLVE_BB_COUNTERS must be 8 or 64");
+}
+
 struct AnnotateFunctions : public PassInfoMixin<AnnotateFunctions> {
+  unsigned CounterWidth = getBBCounterWidth();
 
   void getGlobalFunctionName(Module &M, Function &F, LLVMContext &ctx) {
     Value *&FnNameGlobal = FuncNames[&F];
@@ -133,6 +150,93 @@ struct AnnotateFunctions : public PassInfoMixin<AnnotateFunctions> {
     builder.CreateCall(resolve_bb_callee, {BB_count, FuncNames[F]});
   }
 
+  /* Counter mode: one counter per basic block in a module-wide array placed
+   * in the __resolve_bbcnt section. Each block bumps its own slot inline
+   * (8-bit counters saturate instead of wrapping). A parallel table maps
+   * each slot to (function name, index of the block in its function), the
+   * same numbering the facts use for BB nodes, and a module constructor
+   * hands both to libresolve, which dumps the hit counts at exit. */
+  void emitBBCounters(Module &M) {
+    LLVMContext &ctx = M.getContext();
+    IntegerType *CounterTy = IntegerType::get(ctx, CounterWidth);
+    IntegerType *Int64Ty = IntegerType::get(ctx, 64);
+    PointerType *PtrTy = PointerType::get(ctx, 0);
+    StructType *EntryTy = StructType::get(ctx, {PtrTy, Int64Ty});
+
+    std::vector<BasicBlock *> blocks;
+    std::vector<Constant *> entries;
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.isIntrinsic())
+        continue;
+
+      getGlobalFunctionName(M, F, ctx);
+
+      /* Matches LLVMFacts::getIndexInParent */
+      int64_t bb_idx = 0;
+      for (auto &BB : F) {
+        if (BB.getFirstInsertionPt() != BB.end()) {
+          blocks.push_back(&BB);
+          entries.push_back(ConstantStruct::get(
+              EntryTy, {cast<Constant>(FuncNames[&F]),
+                        ConstantInt::get(Int64Ty, bb_idx)}));
+        }
+        bb_idx++;
+      }
+    }
+
+    if (blocks.empty())
+      return;
+
+    ArrayType *CountersTy = ArrayType::get(CounterTy, blocks.size());
+    GlobalVariable *Counters = new GlobalVariable(
+        M, CountersTy, false, GlobalValue::PrivateLinkage,
+        Constant::getNullValue(CountersTy), "__resolve_bb_counters");
+    Counters->setSection("__resolve_bbcnt");
+    Counters->setAlignment(Align(CounterWidth / 8));
+
+    ArrayType *TableTy = ArrayType::get(EntryTy, entries.size());
+    GlobalVariable *Table = new GlobalVariable(
+        M, TableTy, true, GlobalValue::PrivateLinkage,
+        ConstantArray::get(TableTy, entries), "__resolve_bb_table");
+
+    Constant *One = ConstantInt::get(CounterTy, 1);
+    Constant *Zero = ConstantInt::get(CounterTy, 0);
+    for (size_t i = 0; i < blocks.size(); i++) {
+      IRBuilder<> builder(&*blocks[i]->getFirstInsertionPt());
+      Value *slot =
+          builder.CreateConstInBoundsGEP2_64(CountersTy, Counters, 0, i);
+      Value *count = builder.CreateLoad(CounterTy, slot);
+      Value *inc = builder.CreateAdd(count, One);
+      if (CounterWidth == 8) {
+        inc =
+            builder.CreateSelect(builder.CreateICmpEQ(inc, Zero), count, inc);
+      }
+      builder.CreateStore(inc, slot);
+    }
+
+    FunctionCallee registerFn = M.getOrInsertFunction(
+        "__resolve_bb_counters_register",
+        FunctionType::get(Type::getVoidTy(ctx),
+                          {PtrTy, PtrTy, PtrTy, Int64Ty,
+                           IntegerType::get(ctx, 32)},
+                          false));
+
+    Function *ctor = Function::Create(
+        FunctionType::get(Type::getVoidTy(ctx), {}, false),
+        GlobalValue::InternalLinkage, "__resolve_bb_counters_ctor", &M);
+    IRBuilder<> builder(BasicBlock::Create(ctx, "entry", ctor));
+    Value *SourceFile =
+        builder.CreateGlobalStringPtr(M.getSourceFileName(), "resolve_bb_src");
+    builder.CreateCall(registerFn,
+                       {SourceFile, Counters, Table,
+                        ConstantInt::get(Int64Ty, blocks.size()),
+                        ConstantInt::get(IntegerType::get(ctx, 32),
+                                         CounterWidth)});
+    builder.CreateRetVoid();
+
+    appendToGlobalCtors(M, ctor, 0);
+  }
+
   void runOnFunction(Module &M, Function &F) {
     LLVMContext &ctx = M.getContext();
 
@@ -153,8 +257,12 @@ struct AnnotateFunctions : public PassInfoMixin<AnnotateFunctions> {
       emitFuncArg(&F, &arg, insertBefore);
     }
 
+    /* In counter mode blocks are instrumented by emitBBCounters instead */
     int64_t bb_counter = 0;
     for (auto &BB : F) {
+      if (CounterWidth)
+        break;
+
       Instruction *insertion_pt;
 
       auto bb_it = BB.getFirstInsertionPt();
@@ -183,6 +291,10 @@ struct AnnotateFunctions : public PassInfoMixin<AnnotateFunctions> {
       runOnFunction(M, F);
     }
 
+    if (CounterWidth) {
+      emitBBCounters(M);
+    }
+
     return PreservedAnalyses::none();
   }
 };
@@ -0,0 +1,115 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+#include "IndirectCallProfile.hpp"
+
+#include "resolve_facts_llvm/resolve_facts_llvm.hpp"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <vector>
+
+using namespace llvm;
+
+// Each indirect call site gets a record
+//   { i32 module, i32 node, [ICALL_CACHE_SIZE x { ptr, i64 }], i64 overflow }
+// in a module-wide array. Before the call, __resolve_icall_profile(site,
+// callee) bumps the count of the callee's cache slot (claiming an empty
+// one if needed) or the overflow counter when the cache is full.
+//
+// Address-taken functions are listed in a second table of
+//   { ptr function, i32 module, i32 node }
+// so that libresolve can map observed callees back to facts nodes. A module
+// constructor registers both tables.
+void resolve::profileIndirectCalls(Module &M) {
+  LLVMContext &Ctx = M.getContext();
+  auto ptrType = PointerType::get(Ctx, 0);
+  auto int32Type = Type::getInt32Ty(Ctx);
+  auto int64Type = Type::getInt64Ty(Ctx);
+  auto voidType = Type::getVoidTy(Ctx);
+
+  auto slotType = StructType::get(Ctx, {ptrType, int64Type});
+  auto cacheType = ArrayType::get(slotType, ICALL_CACHE_SIZE);
+  auto siteType =
+      StructType::get(Ctx, {int32Type, int32Type, cacheType, int64Type});
+  auto targetType = StructType::get(Ctx, {ptrType, int32Type, int32Type});
+
+  std::vector<CallBase *> sites;
+  std::vector<Constant *> siteInits;
+  std::vector<Constant *> targets;
+
+  for (Function &F : M) {
+    if (F.isIntrinsic())
+      continue;
+
+    if (F.hasAddressTaken()) {
+      targets.push_back(ConstantStruct::get(
+          targetType, {&F, ConstantInt::get(int32Type, facts.getModuleId(F)),
+                       ConstantInt::get(int32Type, facts.addNode(F))}));
+    }
+
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        auto *CB = dyn_cast<CallBase>(&I);
+        if (!CB || !CB->isIndirectCall())
+          continue;
+
+        sites.push_back(CB);
+        siteInits.push_back(ConstantStruct::get(
+            siteType, {ConstantInt::get(int32Type, facts.getModuleId(I)),
+                       ConstantInt::get(int32Type, facts.addNode(I)),
+                       Constant::getNullValue(cacheType),
+                       ConstantInt::get(int64Type, 0)}));
+      }
+    }
+  }
+
+  if (sites.empty())
+    return;
+
+  auto sitesType = ArrayType::get(siteType, sites.size());
+  auto sitesGV = new GlobalVariable(M, sitesType, false,
+                                    GlobalValue::PrivateLinkage,
+                                    ConstantArray::get(sitesType, siteInits),
+                                    "__resolve_icall_sites");
+  sitesGV->setSection("__resolve_icall");
+
+  auto targetsType = ArrayType::get(targetType, targets.size());
+  auto targetsGV = new GlobalVariable(M, targetsType, true,
+                                      GlobalValue::PrivateLinkage,
+                                      ConstantArray::get(targetsType, targets),
+                                      "__resolve_icall_targets");
+
+  FunctionCallee profileFn = M.getOrInsertFunction(
+      "__resolve_icall_profile",
+      FunctionType::get(voidType, {ptrType, ptrType}, false));
+
+  for (size_t i = 0; i < sites.size(); i++) {
+    IRBuilder<> builder(sites[i]);
+    Value *site = builder.CreateConstInBoundsGEP2_64(sitesType, sitesGV, 0, i);
+    builder.CreateCall(profileFn, {site, sites[i]->getCalledOperand()});
+  }
+
+  FunctionCallee registerFn = M.getOrInsertFunction(
+      "__resolve_icall_register",
+      FunctionType::get(voidType, {ptrType, int64Type, ptrType, int64Type},
+                        false));
+
+  Function *ctor = Function::Create(FunctionType::get(voidType, {}, false),
+                                    GlobalValue::InternalLinkage,
+                                    "__resolve_icall_register_ctor", &M);
+
+  IRBuilder<> builder(BasicBlock::Create(Ctx, "entry", ctor));
+  builder.CreateCall(registerFn,
+                     {sitesGV, ConstantInt::get(int64Type, sites.size()),
+                      targetsGV, ConstantInt::get(int64Type, targets.size())});
+  builder.CreateRetVoid();
+
+  appendToGlobalCtors(M, ctor, 0);
+}
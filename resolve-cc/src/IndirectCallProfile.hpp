@@ -0,0 +1,19 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+#pragma once
+
+#include "llvm/IR/Module.h"
+
+namespace resolve {
+// Capacity of the per-site target cache. Must match ICALL_CACHE_SIZE in
+// libresolve.
+constexpr unsigned ICALL_CACHE_SIZE = 4;
+
+// Value-profile every indirect call site in M, keyed by the facts ids of
+// the call instructions. Must run after getModuleFacts so that the ids
+// have been assigned.
+void profileIndirectCalls(llvm::Module &M);
+} // namespace resolve
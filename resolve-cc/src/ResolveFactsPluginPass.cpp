@@ -5,15 +5,27 @@
 
 #include "resolve_facts_llvm/resolve_facts_llvm.hpp"
 
+#include "IndirectCallProfile.hpp"
+
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 
+#include <cstdlib>
+#include <cstring>
+
 struct ResolveFactsPluginPass : public PassInfoMixin<ResolveFactsPluginPass> {
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
     resolve::getModuleFacts(M);
     resolve::embedFacts(M);
+
+    // Instrument after embedding so the profiling code stays out of the facts.
+    if (strlen(std::getenv("RESOLVE_PROFILE_INDIRECT") ?: "") > 0) {
+      resolve::profileIndirectCalls(M);
+      return PreservedAnalyses::none();
+    }
+
     return PreservedAnalyses::all();
   }
 };
@@ -0,0 +1,198 @@
+// Copyright (c) 2025 Riverside Research.
+// LGPL-3; See LICENSE.txt in the repo root for details.
+use crate::MutexWrap;
+use crate::file::idify_file_path;
+use libc::{atexit, c_char};
+use std::ffi::CStr;
+use std::fs::{self, File};
+use std::io::{self, Write};
+use std::path::PathBuf;
+use std::{env, process, ptr};
+
+/// One entry of the per-module table emitted by AnnotateFunctions in
+/// counter mode: the function name and the index of the block within
+/// that function (the facts `node.idx` of the BB node).
+#[repr(C)]
+pub struct BBCounterEntry {
+    pub function: *const c_char,
+    pub idx: i64,
+}
+
+/// Counter array and table registered by one instrumented module
+struct BBCounterModule {
+    source_file: *const c_char,
+    counters: *const u8,
+    table: *const BBCounterEntry,
+    len: usize,
+    width: u32,
+}
+
+// SAFETY: the pointers reference module-lifetime globals of the instrumented binary
+unsafe impl Send for BBCounterModule {}
+
+impl BBCounterModule {
+    fn count(&self, i: usize) -> u64 {
+        // SAFETY: i < len, and the counters are still being bumped by
+        // other threads, so read without assuming exclusive access.
+        unsafe {
+            match self.width {
+                8 => ptr::read_volatile(self.counters.add(i)) as u64,
+                _ => ptr::read_volatile(self.counters.cast::<u64>().add(i)),
+            }
+        }
+    }
+}
+
+static BB_COUNTER_MODULES: MutexWrap<Vec<BBCounterModule>> = MutexWrap::new(Vec::new());
+
+fn cstr_or<'a>(s: *const c_char, default: &'a str) -> &'a str {
+    if s.is_null() {
+        return default;
+    }
+    unsafe { CStr::from_ptr(s) }.to_str().unwrap_or("<invalid>")
+}
+
+fn json_escape(s: &str) -> String {
+    s.replace('\\', "\\\\").replace('"', "\\\"")
+}
+
+/**
+ * @brief - Writes the non-zero counters of all registered modules as JSON
+ */
+fn write_bb_counts(out: &mut impl Write) -> io::Result<()> {
+    let modules = BB_COUNTER_MODULES.lock();
+
+    write!(out, "{{\n  \"modules\": [")?;
+    for (m, module) in modules.iter().enumerate() {
+        let sep = if m == 0 { "" } else { "," };
+        write!(
+            out,
+            "{sep}\n    {{\n      \"source_file\": \"{}\",\n      \"blocks\": [",
+            json_escape(cstr_or(module.source_file, "<unknown>"))
+        )?;
+
+        let mut first = true;
+        for i in 0..module.len {
+            let count = module.count(i);
+            if count == 0 {
+                continue;
+            }
+            // SAFETY: the table has len entries
+            let entry = unsafe { &*module.table.add(i) };
+            let sep = if first { "" } else { "," };
+            first = false;
+            write!(
+                out,
+                "{sep}\n        {{ \"function\": \"{}\", \"idx\": {}, \"count\": {count} }}",
+                json_escape(cstr_or(entry.function, "<null>")),
+                entry.idx
+            )?;
+        }
+        write!(out, "\n      ]\n    }}")?;
+    }
+    writeln!(out, "\n  ]\n}}")
+}
+
+fn open_bb_counts_file() -> Result<File, io::Error> {
+    let log_dir = env::var("RESOLVE_RUNTIME_LOG_DIR").unwrap_or_else(|_| ".".to_string());
+
+    let mut path = PathBuf::from(log_dir);
+
+    fs::create_dir_all(&path)?;
+
+    path.push("resolve_bb_counts.json");
+
+    idify_file_path(&mut path, process::id());
+    File::create(&path)
+}
+
+/**
+ * @brief - Dumps the basic block hit counts to "resolve_bb_counts.json"
+ */
+#[unsafe(no_mangle)]
+pub extern "C" fn flush_bb_counts() {
+    if let Ok(mut file) = open_bb_counts_file() {
+        let _ = write_bb_counts(&mut file);
+    }
+}
+
+fn register_bb_counters(module: BBCounterModule) -> bool {
+    let mut modules = BB_COUNTER_MODULES.lock();
+    modules.push(module);
+    modules.len() == 1
+}
+
+/**
+ * @brief - Registers a module's inline basic block counters
+ * @input
+ *  - source_file: source file name of the module
+ *  - counters: array of len 8-bit or 64-bit counters
+ *  - table: array of len (function name, block index) entries
+ *  - len: number of instrumented blocks
+ *  - width: counter width in bits
+ */
+#[unsafe(no_mangle)]
+pub extern "C" fn __resolve_bb_counters_register(
+    source_file: *const c_char,
+    counters: *const u8,
+    table: *const BBCounterEntry,
+    len: usize,
+    width: u32,
+) {
+    let first = register_bb_counters(BBCounterModule {
+        source_file,
+        counters,
+        table,
+        len,
+        width,
+    });
+
+    if first {
+        // SAFETY: flush_bb_counts is extern "C" and takes no arguments.
+        unsafe { atexit(flush_bb_counts) };
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_write_bb_counts_skips_unhit_blocks() {
+        let counters: [u64; 3] = [2, 0, 7];
+        let entries = [
+            BBCounterEntry {
+                function: c"main".as_ptr(),
+                idx: 0,
+            },
+            BBCounterEntry {
+                function: c"main".as_ptr(),
+                idx: 1,
+            },
+            BBCounterEntry {
+                function: c"f".as_ptr(),
+                idx: 3,
+            },
+        ];
+
+        BB_COUNTER_MODULES.lock().clear();
+        register_bb_counters(BBCounterModule {
+            source_file: c"test.c".as_ptr(),
+            counters: counters.as_ptr().cast(),
+            table: entries.as_ptr(),
+            len: 3,
+            width: 64,
+        });
+
+        let mut out = Vec::new();
+        write_bb_counts(&mut out).unwrap();
+        let out = String::from_utf8(out).unwrap();
+
+        assert!(out.contains("\"source_file\": \"test.c\""));
+        assert!(out.contains("{ \"function\": \"main\", \"idx\": 0, \"count\": 2 }"));
+        assert!(out.contains("{ \"function\": \"f\", \"idx\": 3, \"count\": 7 }"));
+        assert!(!out.contains("\"idx\": 1"));
+
+        BB_COUNTER_MODULES.lock().clear();
+    }
+}
@@ -8,7 +8,7 @@ use std::path::PathBuf;
 use std::sync::LazyLock;
 use std::{env, process};
 
-fn idify_file_path(path: &mut PathBuf, id: impl Display) {
+pub(crate) fn idify_file_path(path: &mut PathBuf, id: impl Display) {
     let file_name = path
         .file_name()
         .expect("Path could not be found in file system.")
@@ -63,6 +63,9 @@ pub extern "C" fn resolve_init() {
     }
 
     let _ = builder.try_init();
+
+    crate::shadowobjs::quarantine_init();
+    crate::lowfat::lowfat_init();
 }
 
 /// defer creating `resolve_log.out` until the first write
@@ -0,0 +1,295 @@
+// Copyright (c) 2025 Riverside Research.
+// LGPL-3; See LICENSE.txt in the repo root for details.
+use crate::MutexWrap;
+use crate::file::idify_file_path;
+use libc::{Dl_info, atexit, c_void, dladdr};
+use std::collections::HashMap;
+use std::ffi::CStr;
+use std::fs::{self, File};
+use std::io::{self, Write};
+use std::path::PathBuf;
+use std::ptr;
+use std::sync::atomic::{AtomicPtr, AtomicU64, Ordering};
+use std::{env, process};
+
+/// Capacity of the per-site target cache. Must match ICALL_CACHE_SIZE in
+/// resolve-cc/src/IndirectCallProfile.hpp.
+pub const ICALL_CACHE_SIZE: usize = 4;
+
+#[repr(C)]
+pub struct ICallSlot {
+    target: AtomicPtr<c_void>,
+    count: AtomicU64,
+}
+
+/// Per call site record emitted by the indirect call profiling pass,
+/// keyed by the facts id of the call instruction.
+#[repr(C)]
+pub struct ICallSite {
+    module: u32,
+    node: u32,
+    slots: [ICallSlot; ICALL_CACHE_SIZE],
+    overflow: AtomicU64,
+}
+
+/// Address-taken function and its facts id
+#[repr(C)]
+pub struct ICallTarget {
+    function: *const c_void,
+    module: u32,
+    node: u32,
+}
+
+struct ICallModule {
+    sites: *const ICallSite,
+    nsites: usize,
+    targets: *const ICallTarget,
+    ntargets: usize,
+}
+
+// SAFETY: the pointers reference module-lifetime globals of the instrumented binary
+unsafe impl Send for ICallModule {}
+
+static ICALL_MODULES: MutexWrap<Vec<ICallModule>> = MutexWrap::new(Vec::new());
+
+impl ICallSite {
+    fn record(&self, callee: *mut c_void) {
+        for slot in &self.slots {
+            let target = slot.target.load(Ordering::Relaxed);
+            if target.is_null() {
+                // Claim the empty slot, unless another thread just claimed it
+                // for a different callee.
+                match slot.target.compare_exchange(
+                    ptr::null_mut(),
+                    callee,
+                    Ordering::Relaxed,
+                    Ordering::Relaxed,
+                ) {
+                    Ok(_) => {}
+                    Err(other) if other == callee => {}
+                    Err(_) => continue,
+                }
+            } else if target != callee {
+                continue;
+            }
+
+            slot.count.fetch_add(1, Ordering::Relaxed);
+            return;
+        }
+
+        self.overflow.fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+/**
+ * @brief - Records the callee of an indirect call site
+ * @input
+ *  - site: profile record of the call site
+ *  - callee: called function pointer
+ */
+#[unsafe(no_mangle)]
+pub extern "C" fn __resolve_icall_profile(site: *mut ICallSite, callee: *mut c_void) {
+    // SAFETY: site points into the module's __resolve_icall_sites array
+    unsafe { &*site }.record(callee);
+}
+
+fn register_icall_module(module: ICallModule) -> bool {
+    let mut modules = ICALL_MODULES.lock();
+    modules.push(module);
+    modules.len() == 1
+}
+
+/**
+ * @brief - Registers a module's indirect call sites and address-taken functions
+ * @input
+ *  - sites: array of nsites call site records
+ *  - targets: array of ntargets address-taken functions
+ */
+#[unsafe(no_mangle)]
+pub extern "C" fn __resolve_icall_register(
+    sites: *const ICallSite,
+    nsites: usize,
+    targets: *const ICallTarget,
+    ntargets: usize,
+) {
+    let first = register_icall_module(ICallModule {
+        sites,
+        nsites,
+        targets,
+        ntargets,
+    });
+
+    if first {
+        // SAFETY: flush_icall_profile is extern "C" and takes no arguments.
+        unsafe { atexit(flush_icall_profile) };
+    }
+}
+
+/// Symbol name of a callee with no facts id (e.g. defined in a library)
+fn symbol_name(addr: *const c_void) -> String {
+    unsafe {
+        let mut info: Dl_info = std::mem::zeroed();
+        if dladdr(addr, &mut info) != 0 && !info.dli_sname.is_null() {
+            CStr::from_ptr(info.dli_sname)
+                .to_str()
+                .unwrap_or("<invalid>")
+                .to_string()
+        } else {
+            format!("{addr:p}")
+        }
+    }
+}
+
+/**
+ * @brief - Writes the observed targets of every executed call site as JSON
+ */
+fn write_icall_profile(out: &mut impl Write) -> io::Result<()> {
+    let modules = ICALL_MODULES.lock();
+
+    let mut ids = HashMap::new();
+    for module in modules.iter() {
+        for i in 0..module.ntargets {
+            // SAFETY: the table has ntargets entries
+            let target = unsafe { &*module.targets.add(i) };
+            ids.insert(target.function, (target.module, target.node));
+        }
+    }
+
+    write!(out, "{{\n  \"sites\": [")?;
+    let mut first_site = true;
+    for module in modules.iter() {
+        for i in 0..module.nsites {
+            // SAFETY: the array has nsites entries
+            let site = unsafe { &*module.sites.add(i) };
+            let overflow = site.overflow.load(Ordering::Relaxed);
+
+            let mut targets = Vec::new();
+            for slot in &site.slots {
+                let target = slot.target.load(Ordering::Relaxed);
+                if target.is_null() {
+                    break;
+                }
+                let count = slot.count.load(Ordering::Relaxed);
+                let target = target as *const c_void;
+                targets.push(match ids.get(&target) {
+                    Some((m, n)) => {
+                        format!("{{ \"function\": [{m}, {n}], \"count\": {count} }}")
+                    }
+                    None => format!(
+                        "{{ \"symbol\": \"{}\", \"count\": {count} }}",
+                        symbol_name(target)
+                    ),
+                });
+            }
+
+            if targets.is_empty() && overflow == 0 {
+                continue;
+            }
+
+            let sep = if first_site { "" } else { "," };
+            first_site = false;
+            write!(
+                out,
+                "{sep}\n    {{ \"site\": [{}, {}], \"targets\": [{}], \"overflow\": {overflow} }}",
+                site.module,
+                site.node,
+                targets.join(", ")
+            )?;
+        }
+    }
+    writeln!(out, "\n  ]\n}}")
+}
+
+fn open_icall_profile_file() -> Result<File, io::Error> {
+    let log_dir = env::var("RESOLVE_RUNTIME_LOG_DIR").unwrap_or_else(|_| ".".to_string());
+
+    let mut path = PathBuf::from(log_dir);
+
+    fs::create_dir_all(&path)?;
+
+    path.push("resolve_icall_profile.json");
+
+    idify_file_path(&mut path, process::id());
+    File::create(&path)
+}
+
+/**
+ * @brief - Dumps the indirect call profile to "resolve_icall_profile.json"
+ */
+#[unsafe(no_mangle)]
+pub extern "C" fn flush_icall_profile() {
+    if let Ok(mut file) = open_icall_profile_file() {
+        let _ = write_icall_profile(&mut file);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn new_site(node: u32) -> ICallSite {
+        ICallSite {
+            module: 7,
+            node,
+            slots: std::array::from_fn(|_| ICallSlot {
+                target: AtomicPtr::new(ptr::null_mut()),
+                count: AtomicU64::new(0),
+            }),
+            overflow: AtomicU64::new(0),
+        }
+    }
+
+    #[test]
+    fn test_icall_site_cache_and_overflow() {
+        let site = new_site(1);
+        let callees: Vec<*mut c_void> = (1..=ICALL_CACHE_SIZE + 1)
+            .map(|i| (i * 0x10) as *mut c_void)
+            .collect();
+
+        site.record(callees[0]);
+        site.record(callees[0]);
+        for &callee in &callees[1..] {
+            site.record(callee);
+        }
+
+        assert_eq!(site.slots[0].target.load(Ordering::Relaxed), callees[0]);
+        assert_eq!(site.slots[0].count.load(Ordering::Relaxed), 2);
+        assert_eq!(
+            site.slots[ICALL_CACHE_SIZE - 1]
+                .count
+                .load(Ordering::Relaxed),
+            1
+        );
+        assert_eq!(site.overflow.load(Ordering::Relaxed), 1);
+    }
+
+    #[test]
+    fn test_write_icall_profile() {
+        let sites = [new_site(1), new_site(2)];
+        let targets = [ICallTarget {
+            function: 0x10 as *const c_void,
+            module: 7,
+            node: 42,
+        }];
+        sites[0].record(0x10 as *mut c_void);
+
+        ICALL_MODULES.lock().clear();
+        register_icall_module(ICallModule {
+            sites: sites.as_ptr(),
+            nsites: sites.len(),
+            targets: targets.as_ptr(),
+            ntargets: targets.len(),
+        });
+
+        let mut out = Vec::new();
+        write_icall_profile(&mut out).unwrap();
+        let out = String::from_utf8(out).unwrap();
+
+        assert!(out.contains(
+            "{ \"site\": [7, 1], \"targets\": [{ \"function\": [7, 42], \"count\": 1 }], \"overflow\": 0 }"
+        ));
+        assert!(!out.contains("[7, 2]"), "unexecuted sites are skipped");
+
+        ICALL_MODULES.lock().clear();
+    }
+}
@@ -3,7 +3,10 @@
 
 #![feature(btree_cursors)]
 
+mod coverage;
 mod file;
+mod icall;
+mod lowfat;
 mod remediate;
 mod shadowobjs;
 mod trace;
@@ -0,0 +1,284 @@
+// Copyright (c) 2025 Riverside Research.
+// LGPL-3; See LICENSE.txt in the repo root for details.
+use crate::MutexWrap;
+use crate::shadowobjs::{AllocType, ShadowObject, Vaddr};
+use libc::{
+    MAP_ANONYMOUS, MAP_FAILED, MAP_NORESERVE, MAP_PRIVATE, PROT_READ, PROT_WRITE, c_void, mmap,
+};
+use log::{info, warn};
+use std::collections::VecDeque;
+use std::env;
+use std::ptr;
+use std::sync::atomic::{AtomicU32, AtomicUsize, Ordering};
+
+/// log2 of the smallest size class. Must match LOWFAT_MIN_CLASS_SHIFT in
+/// resolve-cveassert/src/BoundsCheck.cpp.
+pub const LOWFAT_MIN_CLASS_SHIFT: u32 = 4;
+/// log2 of the largest size class, larger allocations use libc
+pub const LOWFAT_MAX_CLASS_SHIFT: u32 = 20;
+/// log2 of the size of the region reserved for each size class. Must match
+/// LOWFAT_REGION_SHIFT in resolve-cveassert/src/BoundsCheck.cpp.
+pub const LOWFAT_REGION_SHIFT: u32 = 30;
+
+const NUM_CLASSES: usize = (LOWFAT_MAX_CLASS_SHIFT - LOWFAT_MIN_CLASS_SHIFT + 1) as usize;
+const REGION_SIZE: usize = 1 << LOWFAT_REGION_SHIFT;
+const HEAP_SPAN: usize = NUM_CLASSES << LOWFAT_REGION_SHIFT;
+/// One u32 object size per minimum size class granule, stored after the heap
+const SIZES_SPAN: usize = (HEAP_SPAN >> LOWFAT_MIN_CLASS_SHIFT) * size_of::<u32>();
+
+/// Start of the low-fat heap, read by the inline heap checks emitted by CVEAssert
+#[unsafe(no_mangle)]
+pub static __resolve_lowfat_base: AtomicUsize = AtomicUsize::new(0);
+
+/// Size of the low-fat heap, 0 while it is disabled
+#[unsafe(no_mangle)]
+pub static __resolve_lowfat_span: AtomicUsize = AtomicUsize::new(0);
+
+/// A heap that serves each allocation from a region holding a single size class.
+///
+/// Region `i` holds slots of `1 << (i + LOWFAT_MIN_CLASS_SHIFT)` bytes, aligned to
+/// their size, so the base of the object containing an address is computed from
+/// the address alone. The requested size of each object is kept in a flat array
+/// after the heap, indexed by slot base, so bounds stay exact. Slots are at least
+/// one byte larger than the requested size, so the one-past pointer of an object
+/// still maps to its slot.
+///
+/// Freed slots are not reused until they are passed to `recycle`, which the
+/// quarantine of freed objects does when it evicts them, so a new object never
+/// shares its base with a quarantined one. Recycled slots are reused oldest
+/// first.
+pub struct LowFatHeap {
+    base: AtomicUsize,
+    bump: [AtomicUsize; NUM_CLASSES],
+    free: [MutexWrap<VecDeque<Vaddr>>; NUM_CLASSES],
+}
+
+impl LowFatHeap {
+    pub const fn new() -> LowFatHeap {
+        LowFatHeap {
+            base: AtomicUsize::new(0),
+            bump: [const { AtomicUsize::new(0) }; NUM_CLASSES],
+            free: [const { MutexWrap::new(VecDeque::new()) }; NUM_CLASSES],
+        }
+    }
+
+    /// Reserves the address space for the heap. Pages are only backed once used.
+    pub fn init(&self) -> bool {
+        let align = 1 << LOWFAT_MAX_CLASS_SHIFT;
+        let len = HEAP_SPAN + SIZES_SPAN + align;
+        let region = unsafe {
+            mmap(
+                ptr::null_mut(),
+                len,
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                -1,
+                0,
+            )
+        };
+        if region == MAP_FAILED {
+            warn!("[LOWFAT] Could not reserve {len} bytes for the low-fat heap");
+            return false;
+        }
+
+        let base = (region as Vaddr).next_multiple_of(align);
+        self.base.store(base, Ordering::Release);
+        true
+    }
+
+    fn base(&self) -> Option<Vaddr> {
+        Some(self.base.load(Ordering::Acquire)).filter(|&b| b != 0)
+    }
+
+    /// Returns the size class index serving an allocation of `size` bytes
+    fn class_of(size: usize) -> Option<usize> {
+        let needed = size.checked_add(1)?;
+        let shift = needed
+            .next_power_of_two()
+            .trailing_zeros()
+            .max(LOWFAT_MIN_CLASS_SHIFT);
+        (shift <= LOWFAT_MAX_CLASS_SHIFT).then(|| (shift - LOWFAT_MIN_CLASS_SHIFT) as usize)
+    }
+
+    fn size_slot(base: Vaddr, slot: Vaddr) -> &'static AtomicU32 {
+        let granule = (slot - base) >> LOWFAT_MIN_CLASS_SHIFT;
+        // SAFETY: the size array is part of the reservation and never unmapped
+        unsafe { &*((base + HEAP_SPAN) as *const AtomicU32).add(granule) }
+    }
+
+    /// Returns the slot containing `addr` and its requested size, which is 0 if
+    /// the slot is free
+    fn slot_of(&self, addr: Vaddr) -> Option<(Vaddr, usize)> {
+        let base = self.base()?;
+        let offset = addr.wrapping_sub(base);
+        if offset >= HEAP_SPAN {
+            return None;
+        }
+
+        let class_size =
+            1usize << ((offset >> LOWFAT_REGION_SHIFT) as u32 + LOWFAT_MIN_CLASS_SHIFT);
+        let slot = base + (offset & !(class_size - 1));
+        let size = Self::size_slot(base, slot).load(Ordering::Acquire) as usize;
+        Some((slot, size))
+    }
+
+    /// Allocates `size` bytes, or returns None if the heap is disabled, the size
+    /// is zero or too large, or its region is exhausted
+    pub fn alloc(&self, size: usize) -> Option<*mut c_void> {
+        let base = self.base()?;
+        if size == 0 {
+            return None;
+        }
+        let class = Self::class_of(size)?;
+        let class_size = 1usize << (class as u32 + LOWFAT_MIN_CLASS_SHIFT);
+
+        let slot = match self.free[class].lock().pop_front() {
+            Some(slot) => slot,
+            None => {
+                let offset = self.bump[class].fetch_add(class_size, Ordering::Relaxed);
+                if offset + class_size > REGION_SIZE {
+                    return None;
+                }
+                base + (class << LOWFAT_REGION_SHIFT) + offset
+            }
+        };
+
+        Self::size_slot(base, slot).store(size as u32, Ordering::Release);
+        Some(slot as *mut c_void)
+    }
+
+    /// Changes the size of the object at `ptr` in place if `size` is served by the
+    /// same size class
+    pub fn resize(&self, ptr: Vaddr, size: usize) -> bool {
+        let (Some(base), Some((slot, old_size))) = (self.base(), self.slot_of(ptr)) else {
+            return false;
+        };
+        if slot != ptr || old_size == 0 || size == 0 {
+            return false;
+        }
+        if Self::class_of(size) != Self::class_of(old_size) {
+            return false;
+        }
+
+        Self::size_slot(base, slot).store(size as u32, Ordering::Release);
+        true
+    }
+
+    /// Test if `addr` lies within the low-fat heap
+    pub fn contains(&self, addr: Vaddr) -> bool {
+        self.base()
+            .is_some_and(|base| addr.wrapping_sub(base) < HEAP_SPAN)
+    }
+
+    /// Releases the object at `ptr` and returns its size, or None if `ptr` is
+    /// not the base of a live low-fat object. The slot stays unused until it is
+    /// recycled.
+    pub fn free(&self, ptr: Vaddr) -> Option<usize> {
+        let (slot, size) = self.slot_of(ptr)?;
+        if slot != ptr || size == 0 {
+            warn!("[LOWFAT] Invalid free of low-fat pointer: 0x{ptr:x}");
+            return None;
+        }
+
+        let base = self.base()?;
+        Self::size_slot(base, slot).store(0, Ordering::Release);
+        Some(size)
+    }
+
+    /// Makes the freed slot at `ptr` available to `alloc` again
+    pub fn recycle(&self, ptr: Vaddr) {
+        let (Some(base), Some((slot, 0))) = (self.base(), self.slot_of(ptr)) else {
+            return;
+        };
+        if slot == ptr {
+            let class = (slot - base) >> LOWFAT_REGION_SHIFT;
+            self.free[class].lock().push_back(slot);
+        }
+    }
+
+    /// Returns the live object whose slot contains `addr`
+    pub fn lookup(&self, addr: Vaddr) -> Option<ShadowObject> {
+        let (slot, size) = self.slot_of(addr)?;
+        (size != 0).then(|| ShadowObject::new(AllocType::Heap, slot, size))
+    }
+}
+
+pub static LOWFAT_HEAP: LowFatHeap = LowFatHeap::new();
+
+/// Enables the low-fat heap if RESOLVE_LOWFAT_HEAP is set
+pub fn lowfat_init() {
+    if env::var("RESOLVE_LOWFAT_HEAP").map_or(true, |v| v.is_empty()) {
+        return;
+    }
+
+    if LOWFAT_HEAP.init() {
+        let base = LOWFAT_HEAP.base().unwrap_or(0);
+        __resolve_lowfat_base.store(base, Ordering::Release);
+        __resolve_lowfat_span.store(HEAP_SPAN, Ordering::Release);
+        info!("[LOWFAT] Low-fat heap enabled at 0x{base:x}");
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn lowfat_bounds_are_exact() {
+        let heap = LowFatHeap::new();
+        assert!(heap.alloc(8).is_none(), "disabled until initialized");
+        assert!(heap.init());
+
+        let ptr = heap.alloc(8).unwrap() as Vaddr;
+        assert_eq!(ptr % 16, 0);
+        assert!(heap.contains(ptr));
+
+        for addr in ptr..=ptr + 8 {
+            let obj = heap.lookup(addr).expect("inside the slot");
+            assert_eq!(obj.base, ptr);
+            assert_eq!(obj.size(), 8);
+        }
+        assert_eq!(heap.lookup(ptr + 12).unwrap().past_limit(), ptr + 8);
+
+        // Sizes that fill a class exactly move up one class for the one-past byte
+        let ptr = heap.alloc(16).unwrap() as Vaddr;
+        assert_eq!(heap.lookup(ptr + 16).unwrap().base, ptr);
+        assert_eq!(ptr % 32, 0);
+    }
+
+    #[test]
+    fn lowfat_free_reuses_slots() {
+        let heap = LowFatHeap::new();
+        assert!(heap.init());
+
+        let ptr = heap.alloc(100).unwrap() as Vaddr;
+        assert_eq!(heap.free(ptr + 1), None, "interior pointers are rejected");
+        assert_eq!(heap.free(ptr), Some(100));
+        assert!(heap.lookup(ptr).is_none());
+        assert_eq!(heap.free(ptr), None, "double free is rejected");
+        assert_ne!(heap.alloc(90).unwrap() as Vaddr, ptr, "not recycled yet");
+
+        let other = heap.alloc(100).unwrap() as Vaddr;
+        assert_eq!(heap.free(other), Some(100));
+        heap.recycle(ptr);
+        heap.recycle(other);
+        assert_eq!(heap.alloc(90).unwrap() as Vaddr, ptr, "oldest first");
+        assert_eq!(heap.lookup(ptr).unwrap().size(), 90);
+
+        assert!(heap.resize(ptr, 120));
+        assert_eq!(heap.lookup(ptr).unwrap().size(), 120);
+        assert!(!heap.resize(ptr, 200), "200 bytes needs a larger class");
+    }
+
+    #[test]
+    fn lowfat_large_sizes_fall_back() {
+        let heap = LowFatHeap::new();
+        assert!(heap.init());
+
+        assert!(heap.alloc(1 << LOWFAT_MAX_CLASS_SHIFT).is_none());
+        assert!(heap.alloc((1 << LOWFAT_MAX_CLASS_SHIFT) - 1).is_some());
+        assert!(heap.alloc(0).is_none());
+        assert!(!heap.contains(0x1000));
+        assert!(heap.lookup(0x1000).is_none());
+    }
+}
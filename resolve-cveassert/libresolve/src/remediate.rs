@@ -5,9 +5,11 @@ use libc::{
     strndup, strnlen,
 };
 
+use crate::MutexWrap;
+use crate::lowfat::{LOWFAT_HEAP, LowFatHeap};
 use crate::shadowobjs::{
-    ALIVE_OBJ_LIST, AllocType, FREED_OBJ_LIST, GLOBALS, SHADOW_STACK, ShadowObject, Vaddr,
-    lookup_global,
+    ALIVE_OBJ_LIST, AllocType, FREED_OBJ_LIST, FrameSlot, GlobalDescriptor, Quarantine,
+    SHADOW_STACK, ShadowObject, Vaddr, lookup_global, register_globals,
 };
 
 use log::{info, warn};
@@ -31,6 +33,44 @@ pub extern "C" fn __resolve_alloca(ptr: *mut c_void, size: usize) -> () {
     );
 }
 
+/**
+ * @brief - Registers every array of a stack frame in shadow memory
+ * @input
+ *  - base: ptr to the frame holding the arrays
+ *  - slots: ptr to the frame descriptor, ordered by ascending offset
+ *  - count: number of slots in the descriptor
+ */
+#[unsafe(no_mangle)]
+pub extern "C" fn __resolve_push_frame(base: *mut c_void, slots: *const FrameSlot, count: usize) {
+    if slots.is_null() {
+        return;
+    }
+
+    let slots = unsafe { std::slice::from_raw_parts(slots, count) };
+    SHADOW_STACK.with_borrow_mut(|ss| ss.push_frame(base as Vaddr, slots));
+
+    info!(
+        "[STACK] Registered stack frame: addr={:p}, objects={}",
+        base, count
+    );
+}
+
+/**
+ * @brief - Unregisters every array of a stack frame from shadow memory
+ * @input
+ *  - base: ptr to the frame holding the arrays
+ *  - size: size of the frame in bytes
+ */
+#[unsafe(no_mangle)]
+pub extern "C" fn __resolve_pop_frame(base: *mut c_void, size: usize) {
+    SHADOW_STACK.with_borrow_mut(|ss| ss.pop_frame(base as Vaddr, size));
+
+    info!(
+        "[STACK] Unregistered stack frame: addr={:p}, size={}",
+        base, size
+    );
+}
+
 /**
  * @brief - Registers global allocations in shadow memory
  * @input
@@ -39,9 +79,27 @@ pub extern "C" fn __resolve_alloca(ptr: *mut c_void, size: usize) -> () {
  */
 #[unsafe(no_mangle)]
 pub extern "C" fn __resolve_register_global(ptr: *mut c_void, size: usize) {
-    GLOBALS
-        .lock()
-        .push(ShadowObject::new(AllocType::Global, ptr as Vaddr, size));
+    register_globals([ShadowObject::new(AllocType::Global, ptr as Vaddr, size)]);
+}
+
+/**
+ * @brief - Registers the global descriptor table of a module in shadow memory
+ * @input
+ *  - table: ptr to the module's array of global descriptors
+ *  - count: number of descriptors in the table
+ */
+#[unsafe(no_mangle)]
+pub extern "C" fn __resolve_register_globals(table: *const GlobalDescriptor, count: usize) {
+    if table.is_null() {
+        return;
+    }
+
+    let descriptors = unsafe { std::slice::from_raw_parts(table, count) };
+    register_globals(
+        descriptors
+            .iter()
+            .map(|d| ShadowObject::new(AllocType::Global, d.base, d.size)),
+    );
 }
 
 #[unsafe(no_mangle)]
@@ -65,16 +123,21 @@ pub extern "C" fn __resolve_invalidate_stack_range(ptr: *mut c_void, size: usize
  */
 #[unsafe(no_mangle)]
 pub extern "C" fn __resolve_malloc(size: usize) -> *mut c_void {
+    if let Some(ptr) = LOWFAT_HEAP.alloc(size) {
+        info!(
+            "[HEAP] Allocated low-fat heap object (malloc): addr={:p}, size={}",
+            ptr, size
+        );
+        return ptr;
+    }
+
     let ptr = unsafe { malloc(size + 1) };
 
     if ptr.is_null() {
         return ptr;
     }
 
-    {
-        let mut obj_list = ALIVE_OBJ_LIST.lock();
-        obj_list.add_shadow_object(AllocType::Heap, ptr as Vaddr, size);
-    }
+    ALIVE_OBJ_LIST.add_shadow_object(AllocType::Heap, ptr as Vaddr, size);
 
     info!(
         "[HEAP] Registered heap object (malloc): addr={:p}, size={}",
@@ -91,14 +154,25 @@ pub extern "C" fn __resolve_malloc(size: usize) -> *mut c_void {
  */
 #[unsafe(no_mangle)]
 pub extern "C" fn __resolve_free(ptr: *mut c_void) -> () {
-    let obj_size = {
-        let mut obj_list = ALIVE_OBJ_LIST.lock();
-        let sobj_opt = obj_list.search_intersection(ptr as Vaddr);
-        let size = sobj_opt.map(|o| o.size());
-        // remove shadow obj from live list
-        obj_list.invalidate_at(ptr as Vaddr);
-        size
-    };
+    if LOWFAT_HEAP.contains(ptr as Vaddr) {
+        let size = LOWFAT_HEAP.free(ptr as Vaddr);
+        if let Some(size) = size {
+            info!(
+                "[HEAP] Released low-fat heap object: addr={:p}, size={}",
+                ptr, size
+            );
+        }
+
+        let mut freed_guard = FREED_OBJ_LIST.lock();
+        freed_guard.add_shadow_object(ptr as Vaddr, size.unwrap_or(0));
+        return;
+    }
+
+    let obj_size = ALIVE_OBJ_LIST
+        .search_intersection(ptr as Vaddr)
+        .map(|o| o.size());
+    // remove shadow obj from live list
+    ALIVE_OBJ_LIST.invalidate_at(ptr as Vaddr);
 
     // Check if the shadow object exists
     match obj_size {
@@ -124,7 +198,7 @@ pub extern "C" fn __resolve_free(ptr: *mut c_void) -> () {
     {
         // Insert shadow object into freed object list
         let mut freed_guard = FREED_OBJ_LIST.lock();
-        freed_guard.add_shadow_object(AllocType::Unallocated, ptr as Vaddr, obj_size.unwrap_or(0));
+        freed_guard.add_shadow_object(ptr as Vaddr, obj_size.unwrap_or(0));
     }
 
     let _ = unsafe { free(ptr) };
@@ -147,18 +221,37 @@ pub extern "C" fn __resolve_realloc(ptr: *mut c_void, size: usize) -> *mut c_voi
 
     // Consideration: Pointer passed in may be invalidated so we need a mechanism
     // to remove the shadow object for the orignal allocation
+    if ptr.is_null() {
+        return __resolve_malloc(size);
+    }
+
+    if LOWFAT_HEAP.contains(ptr as Vaddr) {
+        if LOWFAT_HEAP.resize(ptr as Vaddr, size) {
+            return ptr;
+        }
+
+        // Moving out of the low-fat heap, or between size classes
+        let old_size = LOWFAT_HEAP.lookup(ptr as Vaddr).map_or(0, |o| o.size());
+        let new_ptr = __resolve_malloc(size);
+        if new_ptr.is_null() {
+            return new_ptr;
+        }
+        unsafe {
+            std::ptr::copy_nonoverlapping(ptr as *const u8, new_ptr as *mut u8, old_size.min(size))
+        };
+        __resolve_free(ptr);
+        return new_ptr;
+    }
+
     let realloc_ptr = unsafe { realloc(ptr, size + 1) };
 
     if realloc_ptr.is_null() {
         return realloc_ptr;
     }
 
-    {
-        let mut obj_list = ALIVE_OBJ_LIST.lock();
-        // Remove shadow object for original pointer
-        obj_list.invalidate_at(ptr as Vaddr); // if ptr == NULL this does not do anything
-        obj_list.add_shadow_object(AllocType::Heap, realloc_ptr as Vaddr, size);
-    }
+    // Remove shadow object for original pointer
+    ALIVE_OBJ_LIST.invalidate_at(ptr as Vaddr); // if ptr == NULL this does not do anything
+    ALIVE_OBJ_LIST.add_shadow_object(AllocType::Heap, realloc_ptr as Vaddr, size);
 
     info!(
         "[HEAP] Registered heap object (realloc): addr={:p}, size={}",
@@ -178,17 +271,27 @@ pub extern "C" fn __resolve_realloc(ptr: *mut c_void, size: usize) -> *mut c_voi
  */
 #[unsafe(no_mangle)]
 pub extern "C" fn __resolve_calloc(nelems: usize, elsize: usize) -> *mut c_void {
+    // calloc fails when the total size overflows
+    let Some(size) = nelems.checked_mul(elsize) else {
+        return std::ptr::null_mut();
+    };
+    if let Some(ptr) = LOWFAT_HEAP.alloc(size) {
+        // Slots are reused after free, so they may not be zeroed
+        unsafe { std::ptr::write_bytes(ptr as *mut u8, 0, size) };
+        info!(
+            "[HEAP] Allocated low-fat heap object (calloc): addr={:p}, size={}",
+            ptr, size
+        );
+        return ptr;
+    }
+
     let ptr = unsafe { calloc(nelems, elsize) };
-    let size = nelems * elsize;
 
     if ptr.is_null() {
         return ptr;
     }
 
-    {
-        let mut obj_list = ALIVE_OBJ_LIST.lock();
-        obj_list.add_shadow_object(AllocType::Heap, ptr as Vaddr, size);
-    }
+    ALIVE_OBJ_LIST.add_shadow_object(AllocType::Heap, ptr as Vaddr, size);
 
     info!(
         "[HEAP] Registered heap object (calloc): addr={:p}, size={}",
@@ -207,6 +310,17 @@ pub extern "C" fn __resolve_calloc(nelems: usize, elsize: usize) -> *mut c_void
  */
 #[unsafe(no_mangle)]
 pub extern "C" fn __resolve_strdup(ptr: *mut c_char) -> *mut c_char {
+    let len = unsafe { strlen(ptr) };
+    if let Some(string_ptr) = LOWFAT_HEAP.alloc(len + 1) {
+        unsafe { std::ptr::copy_nonoverlapping(ptr, string_ptr as *mut c_char, len + 1) };
+        info!(
+            "[HEAP] Allocated low-fat heap object (strdup): addr={:p}, size={}",
+            string_ptr,
+            len + 1
+        );
+        return string_ptr as *mut c_char;
+    }
+
     let string_ptr = unsafe { strdup(ptr) };
 
     if string_ptr.is_null() {
@@ -217,10 +331,7 @@ pub extern "C" fn __resolve_strdup(ptr: *mut c_char) -> *mut c_char {
     // Otherwise how would the program find the end of the string?
     // Although writing it to something else is probably a bad idea, this too should be allowed.
     let sizeofstr = unsafe { strlen(ptr) + 1 };
-    {
-        let mut obj_list = ALIVE_OBJ_LIST.lock();
-        obj_list.add_shadow_object(AllocType::Heap, string_ptr as Vaddr, sizeofstr);
-    }
+    ALIVE_OBJ_LIST.add_shadow_object(AllocType::Heap, string_ptr as Vaddr, sizeofstr);
 
     info!(
         "[HEAP] Registered heap object (strdup): addr={:p}, size={}",
@@ -241,6 +352,21 @@ pub extern "C" fn __resolve_strdup(ptr: *mut c_char) -> *mut c_char {
  */
 #[unsafe(no_mangle)]
 pub extern "C" fn __resolve_strndup(ptr: *mut c_char, size: usize) -> *mut c_char {
+    let len = unsafe { strnlen(ptr, size) };
+    if let Some(string_ptr) = LOWFAT_HEAP.alloc(len + 1) {
+        let string_ptr = string_ptr as *mut c_char;
+        unsafe {
+            std::ptr::copy_nonoverlapping(ptr, string_ptr, len);
+            *string_ptr.add(len) = 0;
+        }
+        info!(
+            "[HEAP] Allocated low-fat heap object (strndup): addr={:p}, size={}",
+            string_ptr,
+            len + 1
+        );
+        return string_ptr;
+    }
+
     let string_ptr = unsafe { strndup(ptr, size + 1) };
 
     if string_ptr.is_null() {
@@ -253,10 +379,7 @@ pub extern "C" fn __resolve_strndup(ptr: *mut c_char, size: usize) -> *mut c_cha
     // strlen(string_ptr) + 1 would also be valid I think.
     let sizeofstr = unsafe { strnlen(ptr, size) + 1 };
 
-    {
-        let mut obj_list = ALIVE_OBJ_LIST.lock();
-        obj_list.add_shadow_object(AllocType::Heap, string_ptr as Vaddr, sizeofstr);
-    }
+    ALIVE_OBJ_LIST.add_shadow_object(AllocType::Heap, string_ptr as Vaddr, sizeofstr);
 
     info!(
         "[HEAP] Registered heap object (strndup): addr={:p}, size={}",
@@ -282,10 +405,7 @@ pub extern "C" fn __resolve_mmap(
     // mapping.
     let ptr = unsafe { mmap(addr, length + 1, prot, flags, fd, offset) };
 
-    {
-        let mut obj_list = ALIVE_OBJ_LIST.lock();
-        obj_list.add_shadow_object(AllocType::Heap, ptr as Vaddr, length);
-    }
+    ALIVE_OBJ_LIST.add_shadow_object(AllocType::Heap, ptr as Vaddr, length);
 
     info!(
         "[HEAP] Registered heap object (mmap): addr={:p}, size={}",
@@ -300,14 +420,11 @@ pub extern "C" fn __resolve_mmap(
  */
 #[unsafe(no_mangle)]
 pub extern "C" fn __resolve_munmap(addr: *mut c_void, length: usize) -> c_int {
-    let obj_size = {
-        let mut obj_list = ALIVE_OBJ_LIST.lock();
-        let sobj_opt = obj_list.search_intersection(addr as Vaddr);
-        let size = sobj_opt.map(|o| o.size());
-        // remove shadow obj from live list
-        obj_list.invalidate_at(addr as Vaddr);
-        size
-    };
+    let obj_size = ALIVE_OBJ_LIST
+        .search_intersection(addr as Vaddr)
+        .map(|o| o.size());
+    // remove shadow obj from live list
+    ALIVE_OBJ_LIST.invalidate_at(addr as Vaddr);
 
     // Check if the shadow object exists
     match obj_size {
@@ -332,7 +449,7 @@ pub extern "C" fn __resolve_munmap(addr: *mut c_void, length: usize) -> c_int {
 
     {
         let mut freed_guard = FREED_OBJ_LIST.lock();
-        freed_guard.add_shadow_object(AllocType::Unallocated, addr as Vaddr, obj_size.unwrap_or(0));
+        freed_guard.add_shadow_object(addr as Vaddr, obj_size.unwrap_or(0));
     }
 
     let freed = unsafe { munmap(addr, length) };
@@ -394,12 +511,18 @@ pub extern "C" fn __resolve_get_bounds_stack(ptr: *mut c_void) -> ShadowObjBound
  */
 #[unsafe(no_mangle)]
 pub extern "C" fn __resolve_get_bounds_heap(ptr: *mut c_void) -> ShadowObjBounds {
-    let sobj_table = ALIVE_OBJ_LIST.lock();
-    let Some(sobj) = sobj_table.search_intersection(ptr as Vaddr) else {
+    if LOWFAT_HEAP.contains(ptr as Vaddr) {
+        return match LOWFAT_HEAP.lookup(ptr as Vaddr) {
+            Some(sobj) => (&sobj).into(),
+            None => ShadowObjBounds::null(),
+        };
+    }
+
+    let Some(sobj) = ALIVE_OBJ_LIST.search_intersection(ptr as Vaddr) else {
         return ShadowObjBounds::null();
     };
 
-    return sobj.into();
+    return (&sobj).into();
 }
 
 /**
@@ -443,15 +566,25 @@ pub extern "C" fn __resolve_get_bounds(ptr: *mut c_void) -> ShadowObjBounds {
 
 #[unsafe(no_mangle)]
 pub extern "C" fn resolve_obj_type(base_ptr: *mut c_void) -> AllocType {
-    let base = base_ptr as Vaddr;
+    obj_type_in(&LOWFAT_HEAP, &FREED_OBJ_LIST, base_ptr as Vaddr)
+}
 
-    let find_in = |table: &crate::MutexWrap<crate::shadowobjs::ShadowObjectTable>| {
-        let t = table.lock();
+/// Classifies `base` against the given low-fat heap and quarantine. A low-fat
+/// slot is only reused once the quarantine has evicted it, so a live low-fat
+/// object is never mistaken for the freed object it replaced.
+fn obj_type_in(heap: &LowFatHeap, freed: &MutexWrap<Quarantine>, base: Vaddr) -> AllocType {
+    let freed = || {
+        let mut t = freed.lock();
         t.search_intersection(base).map(|o| o.alloc_type)
     };
+    let alive = || {
+        heap.lookup(base)
+            .or_else(|| ALIVE_OBJ_LIST.search_intersection(base))
+            .map(|o| o.alloc_type)
+    };
 
     // Why does this search freed before alive?
-    let alloc_type = find_in(&FREED_OBJ_LIST).or_else(|| find_in(&ALIVE_OBJ_LIST));
+    let alloc_type = freed().or_else(alive);
 
     alloc_type.unwrap_or(AllocType::Unknown)
 }
@@ -494,8 +627,7 @@ mod tests {
 
         // We should track the obj correctly
         {
-            let table = ALIVE_OBJ_LIST.lock();
-            let obj = table.search_intersection(ptr as Vaddr);
+            let obj = ALIVE_OBJ_LIST.search_intersection(ptr as Vaddr);
 
             assert!(obj.is_some());
             let obj = obj.unwrap();
@@ -508,7 +640,7 @@ mod tests {
 
         // After freeing a block we should track that it has been freed
         {
-            let table = FREED_OBJ_LIST.lock();
+            let mut table = FREED_OBJ_LIST.lock();
             let obj = table.search_intersection(ptr as Vaddr);
 
             assert!(obj.is_some());
@@ -516,10 +648,41 @@ mod tests {
 
         // And it should no longer be in the alive obj list.
         {
-            let table = ALIVE_OBJ_LIST.lock();
-            let obj = table.search_intersection(ptr as Vaddr);
+            let obj = ALIVE_OBJ_LIST.search_intersection(ptr as Vaddr);
 
             assert!(obj.is_none());
         }
     }
+
+    #[test]
+    fn test_calloc_overflow() {
+        resolve_init();
+        assert!(__resolve_calloc(usize::MAX / 2, 3).is_null());
+    }
+
+    #[test]
+    fn test_lowfat_reuse_is_not_freed() {
+        let heap: &'static LowFatHeap = Box::leak(Box::new(LowFatHeap::new()));
+        assert!(heap.init());
+        let freed = MutexWrap::new(Quarantine::new(heap, usize::MAX, 1));
+
+        // malloc, then free as __resolve_free does
+        let ptr = heap.alloc(0x10).unwrap() as Vaddr;
+        assert_eq!(obj_type_in(heap, &freed, ptr), AllocType::Heap);
+        let size = heap.free(ptr).unwrap();
+        freed.lock().add_shadow_object(ptr, size);
+        assert_eq!(obj_type_in(heap, &freed, ptr), AllocType::Unallocated);
+
+        // The quarantined slot is not handed out again
+        let next = heap.alloc(0x10).unwrap() as Vaddr;
+        assert_ne!(next, ptr);
+        assert_eq!(obj_type_in(heap, &freed, next), AllocType::Heap);
+
+        // Freeing `next` evicts `ptr`, whose slot is then reused
+        let size = heap.free(next).unwrap();
+        freed.lock().add_shadow_object(next, size);
+        assert_eq!(heap.alloc(0x10).unwrap() as Vaddr, ptr);
+        assert_eq!(obj_type_in(heap, &freed, ptr), AllocType::Heap);
+        assert_eq!(obj_type_in(heap, &freed, next), AllocType::Unallocated);
+    }
 }
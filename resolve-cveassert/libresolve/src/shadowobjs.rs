@@ -2,11 +2,17 @@
 // LGPL-3; See LICENSE.txt in the repo root for details.
 
 use crate::MutexWrap;
-use log::warn;
+use crate::lowfat::{LOWFAT_HEAP, LowFatHeap};
+use libc::atexit;
+use log::{info, warn};
+use std::alloc::{Layout, alloc_zeroed, dealloc, handle_alloc_error};
 use std::cell::RefCell;
-use std::collections::BTreeMap;
+use std::collections::{BTreeMap, VecDeque};
+use std::env;
 use std::ops::Bound::Included;
 use std::ops::RangeInclusive;
+use std::ptr::null_mut;
+use std::sync::atomic::{AtomicBool, AtomicPtr, AtomicUsize, Ordering::SeqCst};
 
 /// An alias representing Virtual Address values
 pub type Vaddr = usize;
@@ -81,17 +87,23 @@ impl ShadowObjectTable {
         }
     }
 
-    /// Adds a new shadow object to the object list, replacing any existing object at `base`
-    pub fn add_shadow_object(&mut self, alloc_type: AllocType, base: Vaddr, size: usize) {
+    /// Adds a new shadow object to the object list, replacing and returning any existing
+    /// object at `base`
+    pub fn add_shadow_object(
+        &mut self,
+        alloc_type: AllocType,
+        base: Vaddr,
+        size: usize,
+    ) -> Option<ShadowObject> {
         self.table
-            .insert(base, ShadowObject::new(alloc_type, base, size));
+            .insert(base, ShadowObject::new(alloc_type, base, size))
     }
 
-    /// Removes the shadow object with base address equal to `base`.
+    /// Removes and returns the shadow object with base address equal to `base`.
     ///
     /// Does nothing if there is no shadow object at that address.
-    pub fn invalidate_at(&mut self, base: Vaddr) {
-        let _ = self.table.remove(&base);
+    pub fn invalidate_at(&mut self, base: Vaddr) -> Option<ShadowObject> {
+        self.table.remove(&base)
     }
 
     /// Removes any allocation with a base address within the supplied region
@@ -114,9 +126,565 @@ impl ShadowObjectTable {
     }
 }
 
+/// log2 of the span of user space addresses tracked per region
+const ADDRESS_BITS: u32 = 48;
+/// log2 of the region size of each level of the table, for growing object sizes
+const LEVEL_SHIFTS: [u32; 2] = [12, 20];
+/// Objects spanning more regions than this are kept at the next level
+const MAX_REGION_SPAN: usize = 4;
+/// Number of writer locks, each shared by the regions hashing to it
+const NUM_WRITER_LOCKS: usize = 1024;
+/// Number of retired arrays a writer lock holds before trying to free them
+const RECLAIM_BATCH: usize = 16;
+
+/// Epoch announced by readers of the concurrent tables, advanced by writers
+/// when they free retired arrays
+static GLOBAL_EPOCH: AtomicUsize = AtomicUsize::new(1);
+/// Reader slots of all threads that ever read a concurrent table
+static READER_SLOTS: AtomicPtr<ReaderSlot> = AtomicPtr::new(null_mut());
+
+/// The epoch a thread announced when it started reading, or 0 while it is not
+/// reading. Slots are never freed; a thread releases its slot for reuse on exit.
+#[repr(align(64))]
+struct ReaderSlot {
+    epoch: AtomicUsize,
+    in_use: AtomicBool,
+    next: AtomicPtr<ReaderSlot>,
+}
+
+impl ReaderSlot {
+    /// Claims a released slot, or registers a new one
+    fn acquire() -> &'static ReaderSlot {
+        let mut cur = READER_SLOTS.load(SeqCst);
+        // SAFETY: slots are leaked, so every pointer in the list stays valid
+        while let Some(slot) = unsafe { cur.as_ref() } {
+            if slot
+                .in_use
+                .compare_exchange(false, true, SeqCst, SeqCst)
+                .is_ok()
+            {
+                return slot;
+            }
+            cur = slot.next.load(SeqCst);
+        }
+
+        let slot: &'static ReaderSlot = Box::leak(Box::new(ReaderSlot {
+            epoch: AtomicUsize::new(0),
+            in_use: AtomicBool::new(true),
+            next: AtomicPtr::new(null_mut()),
+        }));
+        let mut head = READER_SLOTS.load(SeqCst);
+        loop {
+            slot.next.store(head, SeqCst);
+            let new = slot as *const ReaderSlot as *mut ReaderSlot;
+            match READER_SLOTS.compare_exchange(head, new, SeqCst, SeqCst) {
+                Ok(_) => return slot,
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    /// Returns the oldest epoch announced by a thread that is reading
+    fn oldest_epoch() -> usize {
+        let mut oldest = usize::MAX;
+        let mut cur = READER_SLOTS.load(SeqCst);
+        // SAFETY: slots are leaked, so every pointer in the list stays valid
+        while let Some(slot) = unsafe { cur.as_ref() } {
+            let epoch = slot.epoch.load(SeqCst);
+            if epoch != 0 {
+                oldest = oldest.min(epoch);
+            }
+            cur = slot.next.load(SeqCst);
+        }
+        oldest
+    }
+}
+
+/// Releases the reader slot of a thread when it exits
+struct ThreadReader(&'static ReaderSlot);
+
+impl Drop for ThreadReader {
+    fn drop(&mut self) {
+        self.0.epoch.store(0, SeqCst);
+        self.0.in_use.store(false, SeqCst);
+    }
+}
+
+thread_local! {
+    static THREAD_READER: ThreadReader = ThreadReader(ReaderSlot::acquire());
+}
+
+/// Runs `f` with the calling thread announced as a reader, so no array it loads
+/// from a shard is freed before `f` returns. Only the thread's own slot is
+/// written, so readers do not contend with each other.
+fn with_reader<R>(f: impl FnOnce() -> R) -> R {
+    let read = |slot: &ReaderSlot| {
+        slot.epoch.store(GLOBAL_EPOCH.load(SeqCst), SeqCst);
+        let result = f();
+        slot.epoch.store(0, SeqCst);
+        result
+    };
+    match THREAD_READER.try_with(|reader| reader.0) {
+        Ok(slot) => read(slot),
+        // The thread is exiting and its slot was already released
+        Err(_) => read(ThreadReader(ReaderSlot::acquire()).0),
+    }
+}
+
+/// Arrays replaced by writers, with the epoch at which they were unpublished
+type Retired = Vec<(usize, Box<Vec<ShadowObject>>)>;
+
+/// Queues `array` to be freed once no reader can still see it. A reader that
+/// announced an epoch after `array` was unpublished loads a newer array, so the
+/// retired arrays older than every announced epoch are freed.
+fn retire(retired: &mut Retired, array: Box<Vec<ShadowObject>>) {
+    retired.push((GLOBAL_EPOCH.load(SeqCst), array));
+    if retired.len() >= RECLAIM_BATCH {
+        GLOBAL_EPOCH.fetch_add(1, SeqCst);
+        let oldest = ReaderSlot::oldest_epoch();
+        retired.retain(|(epoch, _)| *epoch >= oldest);
+    }
+}
+
+/// A sorted array of shadow objects that is replaced, never modified, once
+/// published. Readers load it without locking; writers publish a modified copy
+/// under a writer lock and retire the old array.
+struct Shard {
+    objects: AtomicPtr<Vec<ShadowObject>>,
+}
+
+impl Shard {
+    const fn new() -> Shard {
+        Shard {
+            objects: AtomicPtr::new(null_mut()),
+        }
+    }
+
+    /// Runs `f` on the currently published objects. Must be called from
+    /// `with_reader`.
+    fn read<R>(&self, f: impl FnOnce(&[ShadowObject]) -> R) -> R {
+        let ptr = self.objects.load(SeqCst);
+        // SAFETY: arrays are only freed once every reader that could have
+        // loaded them has left with_reader
+        let objects = if ptr.is_null() {
+            &[][..]
+        } else {
+            unsafe { (*ptr).as_slice() }
+        };
+        f(objects)
+    }
+
+    /// Publishes a copy of the objects modified by `f`. Must be called with the
+    /// writer lock owning `retired` held.
+    fn update(&self, retired: &mut Retired, f: impl FnOnce(&mut Vec<ShadowObject>)) {
+        let old = self.objects.load(SeqCst);
+        let mut objects = if old.is_null() {
+            Vec::new()
+        } else {
+            // SAFETY: only writers retire arrays and we hold the writer lock
+            unsafe { (*old).clone() }
+        };
+        f(&mut objects);
+
+        let new = if objects.is_empty() {
+            null_mut()
+        } else {
+            Box::into_raw(Box::new(objects))
+        };
+        self.objects.store(new, SeqCst);
+
+        if !old.is_null() {
+            retire(retired, unsafe { Box::from_raw(old) });
+        }
+    }
+
+    /// Frees the published array. Requires exclusive access to the table.
+    fn clear(&mut self) {
+        let ptr = *self.objects.get_mut();
+        if !ptr.is_null() {
+            drop(unsafe { Box::from_raw(ptr) });
+        }
+    }
+}
+
+/// Returns the array stored in `slot`, allocating `len` zeroed elements for it
+/// if it is empty
+fn get_or_alloc<T>(slot: &AtomicPtr<T>, len: usize) -> *mut T {
+    let cur = slot.load(SeqCst);
+    if !cur.is_null() {
+        return cur;
+    }
+
+    let layout = Layout::array::<T>(len).expect("shard index size");
+    // SAFETY: the layout is not empty, and all zeroes is a valid AtomicPtr
+    let new = unsafe { alloc_zeroed(layout) } as *mut T;
+    if new.is_null() {
+        handle_alloc_error(layout);
+    }
+    match slot.compare_exchange(null_mut(), new, SeqCst, SeqCst) {
+        Ok(_) => new,
+        Err(existing) => {
+            unsafe { dealloc(new as *mut u8, layout) };
+            existing
+        }
+    }
+}
+
+/// One shard per region of `1 << shift` bytes, found through a directory of
+/// lazily allocated leaves indexed by region number. Shards are not shared
+/// between regions, so an update copies the objects of a single region.
+struct RegionIndex {
+    shift: u32,
+    directory: AtomicPtr<AtomicPtr<Shard>>,
+}
+
+impl RegionIndex {
+    const fn new(shift: u32) -> RegionIndex {
+        RegionIndex {
+            shift,
+            directory: AtomicPtr::new(null_mut()),
+        }
+    }
+
+    fn leaf_bits(&self) -> u32 {
+        (ADDRESS_BITS - self.shift) / 2
+    }
+
+    fn directory_len(&self) -> usize {
+        1 << (ADDRESS_BITS - self.shift - self.leaf_bits())
+    }
+
+    /// Returns the regions covering `obj` and its past_limit value, or None if
+    /// it spans too many of them or lies outside the tracked addresses
+    fn regions_of(&self, obj: &ShadowObject) -> Option<RangeInclusive<usize>> {
+        let first = obj.base >> self.shift;
+        let last = obj.limit.saturating_add(1) >> self.shift;
+        (last - first < MAX_REGION_SPAN && last >> (ADDRESS_BITS - self.shift) == 0)
+            .then_some(first..=last)
+    }
+
+    /// Returns the shard of the region containing `addr`, if any object was
+    /// ever stored near it
+    fn shard_of(&self, addr: Vaddr) -> Option<&Shard> {
+        let region = addr >> self.shift;
+        if region >> (ADDRESS_BITS - self.shift) != 0 {
+            return None;
+        }
+        let directory = self.directory.load(SeqCst);
+        if directory.is_null() {
+            return None;
+        }
+        // SAFETY: the directory holds directory_len() leaves and region is in
+        // range, and leaves hold 1 << leaf_bits() shards
+        let leaf = unsafe { &*directory.add(region >> self.leaf_bits()) }.load(SeqCst);
+        if leaf.is_null() {
+            return None;
+        }
+        Some(unsafe { &*leaf.add(region & ((1 << self.leaf_bits()) - 1)) })
+    }
+
+    /// Returns the shard of `region`, allocating its leaf if needed
+    fn shard_mut(&self, region: usize) -> &Shard {
+        let directory = get_or_alloc(&self.directory, self.directory_len());
+        // SAFETY: as in shard_of, for a region returned by regions_of
+        let leaf = get_or_alloc(
+            unsafe { &*directory.add(region >> self.leaf_bits()) },
+            1 << self.leaf_bits(),
+        );
+        unsafe { &*leaf.add(region & ((1 << self.leaf_bits()) - 1)) }
+    }
+}
+
+impl Drop for RegionIndex {
+    fn drop(&mut self) {
+        let directory = *self.directory.get_mut();
+        if directory.is_null() {
+            return;
+        }
+        let leaf_len = 1usize << self.leaf_bits();
+        for i in 0..self.directory_len() {
+            let leaf = unsafe { *(*directory.add(i)).get_mut() };
+            if leaf.is_null() {
+                continue;
+            }
+            for j in 0..leaf_len {
+                unsafe { (*leaf.add(j)).clear() };
+            }
+            unsafe { dealloc(leaf as *mut u8, Layout::array::<Shard>(leaf_len).unwrap()) };
+        }
+        let layout = Layout::array::<AtomicPtr<Shard>>(self.directory_len()).unwrap();
+        unsafe { dealloc(directory as *mut u8, layout) };
+    }
+}
+
+/// Finds the object with the greatest base not above `addr` in a sorted array,
+/// if it contains `addr` or `addr` is its past_limit value
+fn search_sorted(objects: &[ShadowObject], addr: Vaddr) -> Option<ShadowObject> {
+    let idx = objects.partition_point(|o| o.base <= addr);
+    idx.checked_sub(1)
+        .map(|i| objects[i])
+        .filter(|o| o.contains(addr) || o.past_limit() == addr)
+}
+
+/// Shadow object table for heap objects that is safe to query concurrently.
+///
+/// Each level splits the address space into regions, 4 KiB for the first and
+/// 1 MiB for the second. An object is stored at the first level where it spans
+/// at most `MAX_REGION_SPAN` regions, in the shard of every region it overlaps,
+/// including its past_limit value, so a lookup visits one shard per level.
+/// Larger objects are stored once in a separate shard that is searched last.
+/// A shard therefore holds the objects of one region, which bounds the copy made
+/// by each insert or removal. Lookups take no lock and write only to the reader
+/// slot of their thread; inserts and removals lock only the affected shards.
+pub struct ConcurrentShadowTable {
+    levels: [RegionIndex; LEVEL_SHIFTS.len()],
+    large: Shard,
+    writers: [MutexWrap<Retired>; NUM_WRITER_LOCKS],
+}
+
+impl ConcurrentShadowTable {
+    pub const fn new() -> ConcurrentShadowTable {
+        ConcurrentShadowTable {
+            levels: [
+                RegionIndex::new(LEVEL_SHIFTS[0]),
+                RegionIndex::new(LEVEL_SHIFTS[1]),
+            ],
+            large: Shard::new(),
+            writers: [const { MutexWrap::new(Vec::new()) }; NUM_WRITER_LOCKS],
+        }
+    }
+
+    /// Returns the writer lock of `region` at `level`
+    fn writer(&self, level: usize, region: usize) -> &MutexWrap<Retired> {
+        let hash = (region ^ (level << 56)).wrapping_mul(0x9e37_79b9_7f4a_7c15);
+        &self.writers[hash >> (usize::BITS - NUM_WRITER_LOCKS.trailing_zeros())]
+    }
+
+    /// Applies `f` to every shard `obj` is stored in, holding its writer lock
+    fn update_shards(&self, obj: &ShadowObject, f: impl Fn(&mut Vec<ShadowObject>)) {
+        for (level, index) in self.levels.iter().enumerate() {
+            if let Some(regions) = index.regions_of(obj) {
+                for region in regions {
+                    let mut retired = self.writer(level, region).lock();
+                    index.shard_mut(region).update(&mut retired, &f);
+                }
+                return;
+            }
+        }
+        let mut retired = self.writer(self.levels.len(), 0).lock();
+        self.large.update(&mut retired, &f);
+    }
+
+    /// Returns the first result of `f` on the shards that may hold `addr`
+    fn search<R>(&self, addr: Vaddr, f: impl Fn(&[ShadowObject]) -> Option<R>) -> Option<R> {
+        with_reader(|| {
+            self.levels
+                .iter()
+                .find_map(|index| index.shard_of(addr).and_then(|shard| shard.read(&f)))
+                .or_else(|| self.large.read(&f))
+        })
+    }
+
+    /// Returns the shadow object with base address equal to `base`
+    fn find_exact(&self, base: Vaddr) -> Option<ShadowObject> {
+        self.search(base, |objects| {
+            objects
+                .binary_search_by_key(&base, |o| o.base)
+                .ok()
+                .map(|i| objects[i])
+        })
+    }
+
+    /// Adds a new shadow object to the table, replacing any existing object at `base`
+    pub fn add_shadow_object(&self, alloc_type: AllocType, base: Vaddr, size: usize) {
+        self.invalidate_at(base);
+
+        let obj = ShadowObject::new(alloc_type, base, size);
+        self.update_shards(&obj, |objects| {
+            let idx = objects.partition_point(|o| o.base < base);
+            objects.insert(idx, obj);
+        });
+    }
+
+    /// Removes the shadow object with base address equal to `base` and returns it.
+    ///
+    /// Does nothing if there is no shadow object at that address.
+    pub fn invalidate_at(&self, base: Vaddr) -> Option<ShadowObject> {
+        let obj = self.find_exact(base)?;
+        self.update_shards(&obj, |objects| {
+            if let Ok(idx) = objects.binary_search_by_key(&base, |o| o.base) {
+                objects.remove(idx);
+            }
+        });
+        Some(obj)
+    }
+
+    /// Finds a shadow object that contains 'addr' in its bounds OR a shadow object with
+    /// a past_limit value matching the input
+    pub fn search_intersection(&self, addr: Vaddr) -> Option<ShadowObject> {
+        self.search(addr, |objects| search_sorted(objects, addr))
+    }
+}
+
+impl Drop for ConcurrentShadowTable {
+    fn drop(&mut self) {
+        self.large.clear();
+    }
+}
+
 // static object lists to store all objects
-pub static ALIVE_OBJ_LIST: MutexWrap<ShadowObjectTable> = MutexWrap::new(ShadowObjectTable::new());
-pub static FREED_OBJ_LIST: MutexWrap<ShadowObjectTable> = MutexWrap::new(ShadowObjectTable::new());
+pub static ALIVE_OBJ_LIST: ConcurrentShadowTable = ConcurrentShadowTable::new();
+pub static FREED_OBJ_LIST: MutexWrap<Quarantine> = MutexWrap::new(Quarantine::new(
+    &LOWFAT_HEAP,
+    DEFAULT_QUARANTINE_BYTES,
+    DEFAULT_QUARANTINE_ENTRIES,
+));
+
+const DEFAULT_QUARANTINE_BYTES: usize = 256 << 20;
+const DEFAULT_QUARANTINE_ENTRIES: usize = 1 << 20;
+
+/// Bounded record of recently freed objects.
+///
+/// Freed objects are kept in free order and the oldest are evicted once the
+/// quarantine holds more than `max_entries` objects or `max_bytes` bytes. Freeing
+/// an address that is already quarantined updates its entry in place, so every
+/// quarantined base appears exactly once in `order`. Evicted low-fat objects are
+/// recycled to `heap`, which does not reuse their slots before that.
+///
+/// Objects are looked up in a B-tree rather than a sorted array. Every free
+/// inserts one object and usually evicts another, which would shift up to the
+/// whole array, while lookups only happen when a pointer is classified. See
+/// `bench_quarantine_table`.
+pub struct Quarantine {
+    heap: &'static LowFatHeap,
+    table: ShadowObjectTable,
+    order: VecDeque<Vaddr>,
+    bytes: usize,
+    max_bytes: usize,
+    max_entries: usize,
+    lookups: u64,
+    hits: u64,
+    evictions: u64,
+}
+
+impl Quarantine {
+    pub const fn new(
+        heap: &'static LowFatHeap,
+        max_bytes: usize,
+        max_entries: usize,
+    ) -> Quarantine {
+        Quarantine {
+            heap,
+            table: ShadowObjectTable::new(),
+            order: VecDeque::new(),
+            bytes: 0,
+            max_bytes,
+            max_entries,
+            lookups: 0,
+            hits: 0,
+            evictions: 0,
+        }
+    }
+
+    /// Changes the capacity of the quarantine, evicting objects if needed
+    pub fn set_limits(&mut self, max_bytes: usize, max_entries: usize) {
+        self.max_bytes = max_bytes;
+        self.max_entries = max_entries;
+        self.evict();
+    }
+
+    /// Records the freed object at `base`
+    pub fn add_shadow_object(&mut self, base: Vaddr, size: usize) {
+        match self
+            .table
+            .add_shadow_object(AllocType::Unallocated, base, size)
+        {
+            Some(old) => self.bytes -= old.size(),
+            None => self.order.push_back(base),
+        }
+        self.bytes += size;
+        self.evict();
+    }
+
+    fn evict(&mut self) {
+        while self.order.len() > self.max_entries || self.bytes > self.max_bytes {
+            let Some(base) = self.order.pop_front() else {
+                break;
+            };
+            if let Some(obj) = self.table.invalidate_at(base) {
+                self.bytes -= obj.size();
+                self.evictions += 1;
+                self.heap.recycle(base);
+            }
+        }
+    }
+
+    /// Finds a quarantined object that contains 'addr' in its bounds OR an object with
+    /// a past_limit value matching the input
+    pub fn search_intersection(&mut self, addr: Vaddr) -> Option<&ShadowObject> {
+        self.lookups += 1;
+        let found = self.table.search_intersection(addr);
+        if found.is_some() {
+            self.hits += 1;
+        }
+        found
+    }
+
+    /// Returns the number of quarantined objects
+    pub fn len(&self) -> usize {
+        self.order.len()
+    }
+
+    /// Returns the total size of the quarantined objects
+    pub fn bytes(&self) -> usize {
+        self.bytes
+    }
+}
+
+fn env_limit(name: &str, default: usize) -> usize {
+    env::var(name)
+        .ok()
+        .and_then(|v| v.parse().ok())
+        .unwrap_or(default)
+}
+
+extern "C" fn log_quarantine_stats() {
+    let q = FREED_OBJ_LIST.lock();
+    let hit_rate = if q.lookups == 0 {
+        0.0
+    } else {
+        q.hits as f64 * 100.0 / q.lookups as f64
+    };
+    info!(
+        "[QUARANTINE] {} objects, {} bytes, {} evicted, {}/{} lookups hit ({:.1}%)",
+        q.len(),
+        q.bytes(),
+        q.evictions,
+        q.hits,
+        q.lookups,
+        hit_rate
+    );
+}
+
+/// Reads the quarantine limits from RESOLVE_QUARANTINE_BYTES and
+/// RESOLVE_QUARANTINE_ENTRIES and logs quarantine statistics at exit
+pub fn quarantine_init() {
+    FREED_OBJ_LIST.lock().set_limits(
+        env_limit("RESOLVE_QUARANTINE_BYTES", DEFAULT_QUARANTINE_BYTES),
+        env_limit("RESOLVE_QUARANTINE_ENTRIES", DEFAULT_QUARANTINE_ENTRIES),
+    );
+
+    // SAFETY: log_quarantine_stats is extern "C" and takes no arguments.
+    unsafe { atexit(log_quarantine_stats) };
+}
+
+/// Position of an array in a stack frame. Must match the frame descriptors
+/// emitted by CVEAssert.
+#[repr(C)]
+pub struct FrameSlot {
+    pub offset: usize,
+    pub size: usize,
+}
 
 // data must be ordered descending (downward growing stack on x86)
 // so push/pop are O(1) at the end.
@@ -347,6 +915,63 @@ impl ShadowStack {
         self.assert_descending();
     }
 
+    /// Registers every array of a stack frame at once. `slots` are ordered by
+    /// ascending offset from `base`, as emitted by CVEAssert.
+    ///
+    /// Frames skipped by longjmp are never popped and stay tracked below their
+    /// caller. The next frame pushed over one of their objects evicts the whole
+    /// object (newest-wins); until then they only answer lookups for addresses
+    /// no live frame has registered.
+    pub fn push_frame(&mut self, base: Vaddr, slots: &[FrameSlot]) {
+        let Some(frame_end) = slots.iter().map(|s| base + s.offset + s.size).max() else {
+            return;
+        };
+        let objects = slots
+            .iter()
+            .rev()
+            .filter(|s| s.size > 0)
+            .map(|s| ShadowObject::new(AllocType::Stack, base + s.offset, s.size));
+
+        if self.data.last().map_or(true, |top| frame_end <= top.base) {
+            // common case: the frame lies below everything tracked. O(1) per slot
+            self.data.extend(objects);
+        } else {
+            // the frame reuses the slots of stale frames. Their objects are dead
+            // as a whole, even where they stick out of the frame. newest-wins.
+            let start = self.data.partition_point(|o| o.base >= frame_end);
+            let stale = self.data[start..]
+                .iter()
+                .take_while(|o| o.base + o.size() > base)
+                .count();
+            self.data.splice(start..start + stale, objects);
+        }
+        self.assert_descending();
+    }
+
+    /// Drops every object of the frame [base, base + size) at once. No dead
+    /// markers are left, the frame is gone and its slots are free for reuse.
+    ///
+    /// Stale frames below `base` are left alone: they may belong to another
+    /// stack, such as the frames a signal handler on an alternate stack
+    /// interrupted, and are evicted by the next push over them instead.
+    pub fn pop_frame(&mut self, base: Vaddr, size: usize) {
+        let end = base
+            .checked_add(size)
+            .expect("pop_frame: frame overflows the address space"); // exclusive
+
+        match self.data.last() {
+            // common case: the frame is the top of the stack
+            Some(top) if top.base >= base => {
+                let start = self.data.partition_point(|o| o.base >= end);
+                self.data.truncate(start);
+            }
+            _ => {
+                self.clear_interval(base, end);
+            }
+        }
+        self.assert_descending();
+    }
+
     // TODO: Does it make more sense to return something explicit
     //       when we search and get an invalidated stack object?
     pub fn search_intersection(&self, addr: Vaddr) -> Option<&ShadowObject> {
@@ -374,19 +999,76 @@ thread_local! {
     pub static SHADOW_STACK: RefCell<ShadowStack> = RefCell::new(ShadowStack::new());
 }
 
-pub static GLOBALS: MutexWrap<Vec<ShadowObject>> = MutexWrap::new(Vec::new());
+/// A global object in the descriptor table CVEAssert emits for each module
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct GlobalDescriptor {
+    pub base: Vaddr,
+    pub size: usize,
+}
+
+/// Globals registered since the global index was last rebuilt
+static GLOBALS: MutexWrap<Vec<ShadowObject>> = MutexWrap::new(Vec::new());
+/// Every registered global, sorted by base.
+///
+/// Rebuilt by the first lookup after new globals are registered. Replaced
+/// indices are leaked, since lookups never lock and may still be reading them;
+/// this happens at most once per registering module.
+static GLOBAL_INDEX: AtomicPtr<Vec<ShadowObject>> = AtomicPtr::new(null_mut());
+static GLOBAL_INDEX_STALE: AtomicBool = AtomicBool::new(false);
+
+pub fn register_globals(objects: impl IntoIterator<Item = ShadowObject>) {
+    let mut globals = GLOBALS.lock();
+    globals.extend(objects);
+    GLOBAL_INDEX_STALE.store(true, SeqCst);
+}
+
+fn rebuild_global_index() {
+    let mut globals = GLOBALS.lock();
+    if !GLOBAL_INDEX_STALE.load(SeqCst) {
+        return;
+    }
+
+    let old = GLOBAL_INDEX.load(SeqCst);
+    let mut objects = if old.is_null() {
+        Vec::new()
+    } else {
+        unsafe { (*old).clone() }
+    };
+    objects.append(&mut globals);
+    objects.sort_unstable_by_key(|o| o.base);
+
+    GLOBAL_INDEX.store(Box::into_raw(Box::new(objects)), SeqCst);
+    GLOBAL_INDEX_STALE.store(false, SeqCst);
+}
 
 pub fn lookup_global(p: Vaddr) -> Option<ShadowObject> {
-    GLOBALS
-        .lock()
-        .iter()
-        .find(|obj| obj.contains(p) || obj.past_limit() == p)
-        .copied()
+    if GLOBAL_INDEX_STALE.load(SeqCst) {
+        rebuild_global_index();
+    }
+
+    let index = GLOBAL_INDEX.load(SeqCst);
+    // SAFETY: published indices are never freed
+    let objects = if index.is_null() {
+        &[][..]
+    } else {
+        unsafe { (*index).as_slice() }
+    };
+    search_sorted(objects, p)
+}
+
+#[cfg(test)]
+fn clear_globals() {
+    let mut globals = GLOBALS.lock();
+    globals.clear();
+    GLOBAL_INDEX.store(null_mut(), SeqCst);
+    GLOBAL_INDEX_STALE.store(false, SeqCst);
 }
 
 #[cfg(test)]
 mod tests {
-    use crate::shadowobjs::{AllocType, ShadowObjectTable};
+    use crate::lowfat::LOWFAT_HEAP;
+    use crate::shadowobjs::{AllocType, Quarantine, ShadowObjectTable};
 
     #[test]
     fn test_add_and_print_shadow_objects() {
@@ -427,12 +1109,10 @@ mod tests {
 
     #[test]
     fn test_lookup_global_in_bounds_one_past_and_miss() {
-        use crate::shadowobjs::{GLOBALS, ShadowObject, lookup_global};
+        use crate::shadowobjs::{ShadowObject, clear_globals, lookup_global, register_globals};
 
-        GLOBALS.lock().clear();
-        GLOBALS
-            .lock()
-            .push(ShadowObject::new(AllocType::Global, 0x7000, 4));
+        clear_globals();
+        register_globals([ShadowObject::new(AllocType::Global, 0x7000, 4)]);
 
         assert!(lookup_global(0x7000).is_some(), "base is in bounds");
         assert!(
@@ -442,7 +1122,17 @@ mod tests {
         assert!(lookup_global(0x7004).is_some(), "one-past is resolvable");
         assert!(lookup_global(0x7005).is_none(), "beyond one-past misses");
 
-        GLOBALS.lock().clear();
+        // Globals registered later are merged into the sorted index
+        register_globals([
+            ShadowObject::new(AllocType::Global, 0x7010, 8),
+            ShadowObject::new(AllocType::Global, 0x6000, 0x100),
+        ]);
+        assert_eq!(lookup_global(0x7003).unwrap().base, 0x7000);
+        assert_eq!(lookup_global(0x7017).unwrap().base, 0x7010);
+        assert_eq!(lookup_global(0x60ff).unwrap().base, 0x6000);
+        assert!(lookup_global(0x7008).is_none());
+
+        clear_globals();
     }
 
     #[test]
@@ -466,7 +1156,330 @@ mod tests {
         assert!(table.search_intersection(0x7FFF).is_none());
     }
 
-    use super::ShadowStack;
+    #[test]
+    fn quarantine_evicts_oldest_by_count() {
+        let mut q = Quarantine::new(&LOWFAT_HEAP, usize::MAX, 2);
+        q.add_shadow_object(0x1000, 8);
+        q.add_shadow_object(0x2000, 8);
+        q.add_shadow_object(0x3000, 8);
+
+        assert_eq!(q.len(), 2);
+        assert_eq!(q.bytes(), 16);
+        assert!(q.search_intersection(0x1000).is_none());
+        assert!(q.search_intersection(0x2004).is_some());
+        assert_eq!((q.hits, q.lookups, q.evictions), (1, 2, 1));
+    }
+
+    #[test]
+    fn quarantine_evicts_oldest_by_bytes() {
+        let mut q = Quarantine::new(&LOWFAT_HEAP, 100, usize::MAX);
+        q.add_shadow_object(0x1000, 60);
+        q.add_shadow_object(0x2000, 30);
+        // Freeing the same address again replaces the entry in place
+        q.add_shadow_object(0x2000, 40);
+        assert_eq!((q.len(), q.bytes()), (2, 100));
+
+        q.add_shadow_object(0x3000, 10);
+        assert_eq!((q.len(), q.bytes()), (2, 50));
+        assert!(q.search_intersection(0x1000).is_none());
+        assert_eq!(q.search_intersection(0x2000).unwrap().size(), 40);
+
+        q.set_limits(0, 0);
+        assert_eq!((q.len(), q.bytes()), (0, 0));
+    }
+
+    #[test]
+    fn quarantine_memory_stays_flat() {
+        let mut q = Quarantine::new(&LOWFAT_HEAP, usize::MAX, 1000);
+        for i in 0..100_000 {
+            q.add_shadow_object(0x10_0000 + i * 0x20, 0x10);
+        }
+        assert_eq!(q.len(), 1000);
+        assert!(q.order.capacity() < 2048);
+        assert_eq!(q.table.table.len(), 1000);
+    }
+
+    use super::ConcurrentShadowTable;
+
+    #[test]
+    fn concurrent_table_add_search_remove() {
+        let table = Box::new(ConcurrentShadowTable::new());
+        table.add_shadow_object(AllocType::Heap, 0x8000, 8);
+
+        for x in 0x8000..=0x8008 {
+            assert!(table.search_intersection(x).is_some());
+        }
+        assert!(table.search_intersection(0x8009).is_none());
+        assert!(table.search_intersection(0x7FFF).is_none());
+
+        // Re-adding at the same base replaces the object
+        table.add_shadow_object(AllocType::Heap, 0x8000, 4);
+        assert!(table.search_intersection(0x8006).is_none());
+
+        let removed = table.invalidate_at(0x8000).expect("object is tracked");
+        assert_eq!(removed.size(), 4);
+        assert!(table.search_intersection(0x8000).is_none());
+        assert!(table.invalidate_at(0x8000).is_none());
+    }
+
+    #[test]
+    fn concurrent_table_objects_spanning_regions() {
+        let table = Box::new(ConcurrentShadowTable::new());
+        // Straddles a region boundary, and one-past lands in the next region
+        table.add_shadow_object(AllocType::Heap, 0x1_fff0, 0x20);
+        table.add_shadow_object(AllocType::Heap, 0x2_fff0, 0x10);
+        // Spans too many small regions, so it is kept at the second level
+        table.add_shadow_object(AllocType::Heap, 0x40_0000, 0x8000);
+        // Large enough to go to the large object shard
+        table.add_shadow_object(AllocType::Heap, 0x100_0000, 0x100_0000);
+
+        assert_eq!(table.search_intersection(0x2_0008).unwrap().base, 0x1_fff0);
+        assert_eq!(table.search_intersection(0x3_0000).unwrap().base, 0x2_fff0);
+        assert_eq!(
+            table.search_intersection(0x1ff_ffff).unwrap().base,
+            0x100_0000
+        );
+        assert!(table.search_intersection(0x200_0001).is_none());
+        assert_eq!(
+            table.search_intersection(0x40_7fff).unwrap().base,
+            0x40_0000
+        );
+        assert_eq!(
+            table.search_intersection(0x40_8000).unwrap().base,
+            0x40_0000
+        );
+        assert!(table.search_intersection(0x40_8001).is_none());
+
+        table.invalidate_at(0x1_fff0);
+        table.invalidate_at(0x100_0000);
+        assert!(table.search_intersection(0x2_0008).is_none());
+        assert!(table.search_intersection(0x180_0000).is_none());
+        assert!(table.search_intersection(0x3_0000).is_some());
+    }
+
+    #[test]
+    fn concurrent_table_lookups_during_updates() {
+        let table = Box::new(ConcurrentShadowTable::new());
+        table.add_shadow_object(AllocType::Heap, 0x10_0000, 0x100);
+
+        std::thread::scope(|s| {
+            for t in 0..4 {
+                let table = &table;
+                s.spawn(move || {
+                    let base = 0x10_0100 + t * 0x40;
+                    for _ in 0..1000 {
+                        table.add_shadow_object(AllocType::Heap, base, 0x20);
+                        assert!(table.search_intersection(base + 0x10).is_some());
+                        table.invalidate_at(base);
+                    }
+                });
+            }
+            for _ in 0..4 {
+                let table = &table;
+                s.spawn(move || {
+                    for _ in 0..10000 {
+                        let obj = table.search_intersection(0x10_0080);
+                        assert_eq!(obj.map(|o| o.base), Some(0x10_0000));
+                    }
+                });
+            }
+        });
+
+        assert!(table.search_intersection(0x10_0110).is_none());
+    }
+
+    #[test]
+    fn concurrent_table_frees_retired_arrays() {
+        let table = Box::new(ConcurrentShadowTable::new());
+        for i in 0..10_000 {
+            table.add_shadow_object(AllocType::Heap, 0x10_0000 + i % 64 * 0x40, 0x20);
+        }
+        // Other tests may be reading while the last arrays are retired
+        let retired: usize = table.writers.iter().map(|w| w.lock().len()).sum();
+        assert!(
+            retired <= 2 * super::RECLAIM_BATCH,
+            "{retired} arrays retired"
+        );
+    }
+
+    /// Compares heap lookup and update throughput of the mutex protected table
+    /// with the concurrent table. Run with
+    /// `RUST_LOG=info cargo test --release -- --ignored --nocapture bench_heap_table_scaling`
+    #[test]
+    #[ignore = "benchmark"]
+    fn bench_heap_table_scaling() {
+        use crate::MutexWrap;
+        use log::info;
+        use std::time::Instant;
+
+        const OBJECTS: usize = 50_000;
+        const LOOKUPS: usize = 1_000_000;
+        const BASE: usize = 0x7f00_0000_0000;
+
+        crate::file::resolve_init();
+        let locked = MutexWrap::new(ShadowObjectTable::new());
+        let concurrent = Box::new(ConcurrentShadowTable::new());
+        for i in 0..OBJECTS {
+            let base = BASE + i * 0x40;
+            locked.lock().add_shadow_object(AllocType::Heap, base, 0x30);
+            concurrent.add_shadow_object(AllocType::Heap, base, 0x30);
+        }
+
+        // Returns millions of operations per second over all threads
+        let run = |threads: usize, op: &(dyn Fn(usize) -> bool + Sync)| {
+            let start = Instant::now();
+            std::thread::scope(|s| {
+                for t in 0..threads {
+                    s.spawn(move || {
+                        let mut x = 0x9e37_79b9_7f4a_7c15usize ^ t;
+                        for _ in 0..LOOKUPS {
+                            x ^= x << 13;
+                            x ^= x >> 7;
+                            x ^= x << 17;
+                            std::hint::black_box(op(x));
+                        }
+                    });
+                }
+            });
+            (threads * LOOKUPS) as f64 / start.elapsed().as_secs_f64() / 1e6
+        };
+        let addr = |x: usize| BASE + x % (OBJECTS * 0x40);
+        // Frees an object and allocates it again
+        let object = |x: usize| BASE + x % OBJECTS * 0x40;
+
+        info!("threads  mutex btree (M/s)  concurrent (M/s)");
+        for threads in [1, 2, 4, 8, 16] {
+            let mutex = run(threads, &|x| {
+                locked.lock().search_intersection(addr(x)).is_some()
+            });
+            let lock_free = run(threads, &|x| {
+                concurrent.search_intersection(addr(x)).is_some()
+            });
+            info!("{threads:>7}  {mutex:>17.2}  {lock_free:>16.2}");
+        }
+
+        info!("threads  mutex btree (M free+malloc/s)  concurrent (M free+malloc/s)");
+        for threads in [1, 4] {
+            let mutex = run(threads, &|x| {
+                let mut table = locked.lock();
+                let removed = table.invalidate_at(object(x)).is_some();
+                table.add_shadow_object(AllocType::Heap, object(x), 0x30);
+                removed
+            });
+            let lock_free = run(threads, &|x| {
+                let removed = concurrent.invalidate_at(object(x)).is_some();
+                concurrent.add_shadow_object(AllocType::Heap, object(x), 0x30);
+                removed
+            });
+            info!("{threads:>7}  {mutex:>33.2}  {lock_free:>28.2}");
+        }
+    }
+
+    /// Compares the quarantine's B-tree with a sorted array and the concurrent
+    /// table, for frees into a full quarantine and for lookups. Run with
+    /// `RUST_LOG=info cargo test --release -- --ignored --nocapture bench_quarantine_table`
+    #[test]
+    #[ignore = "benchmark"]
+    fn bench_quarantine_table() {
+        use super::{ShadowObject, search_sorted};
+        use log::info;
+        use std::collections::{HashSet, VecDeque};
+        use std::time::Instant;
+
+        const OPS: usize = 1_000_000;
+        const BASE: usize = 0x7f00_0000_0000;
+
+        crate::file::resolve_init();
+        // Returns millions of operations per second, numbering them from `first`
+        let run = |first: usize, ops: usize, op: &mut dyn FnMut(usize) -> bool| {
+            let start = Instant::now();
+            for i in first..first + ops {
+                std::hint::black_box(op(i));
+            }
+            ops as f64 / start.elapsed().as_secs_f64() / 1e6
+        };
+
+        info!(
+            "entries  free (M/s): btree  array  concurrent  lookup (M/s): btree  array  concurrent"
+        );
+        for entries in [1_000, 64_000, 1_000_000] {
+            // Frees cycle through four times as many objects as are quarantined
+            let object = |i: usize| BASE + i.wrapping_mul(0x9e37_79b9) % (entries * 4) * 0x40;
+            // Start every structure from the same full quarantine
+            let mut seen = HashSet::new();
+            let freed: VecDeque<usize> = (0..entries)
+                .map(object)
+                .filter(|&base| seen.insert(base))
+                .collect();
+            // Shifting a large array is slow enough to time fewer frees
+            let array_ops = (OPS * 1000 / entries).min(OPS);
+
+            let mut q = Quarantine::new(&LOWFAT_HEAP, usize::MAX, entries);
+            freed
+                .iter()
+                .for_each(|&base| q.add_shadow_object(base, 0x30));
+            let btree_free = run(entries, OPS, &mut |i| {
+                q.add_shadow_object(object(i), 0x30);
+                true
+            });
+            let btree_lookup = run(0, OPS, &mut |i| {
+                q.search_intersection(object(i * 7) + 8).is_some()
+            });
+
+            let mut order = freed.clone();
+            let mut array: Vec<ShadowObject> = order
+                .iter()
+                .map(|&base| ShadowObject::new(AllocType::Unallocated, base, 0x30))
+                .collect();
+            array.sort_by_key(|o| o.base);
+            let array_free = run(entries, array_ops, &mut |i| {
+                let obj = ShadowObject::new(AllocType::Unallocated, object(i), 0x30);
+                match array.binary_search_by_key(&obj.base, |o| o.base) {
+                    Ok(idx) => array[idx] = obj,
+                    Err(idx) => {
+                        array.insert(idx, obj);
+                        order.push_back(obj.base);
+                    }
+                }
+                while order.len() > entries {
+                    let base = order.pop_front().unwrap();
+                    if let Ok(idx) = array.binary_search_by_key(&base, |o| o.base) {
+                        array.remove(idx);
+                    }
+                }
+                true
+            });
+            let array_lookup = run(0, OPS, &mut |i| {
+                search_sorted(&array, object(i * 7) + 8).is_some()
+            });
+
+            let table = Box::new(ConcurrentShadowTable::new());
+            let mut order = freed.clone();
+            order
+                .iter()
+                .for_each(|&base| table.add_shadow_object(AllocType::Unallocated, base, 0x30));
+            let table_free = run(entries, OPS, &mut |i| {
+                if table.invalidate_at(object(i)).is_none() {
+                    order.push_back(object(i));
+                }
+                table.add_shadow_object(AllocType::Unallocated, object(i), 0x30);
+                while order.len() > entries {
+                    table.invalidate_at(order.pop_front().unwrap());
+                }
+                true
+            });
+            let table_lookup = run(0, OPS, &mut |i| {
+                table.search_intersection(object(i * 7) + 8).is_some()
+            });
+
+            info!(
+                "{entries:>7}  {btree_free:>17.2}  {array_free:>5.3}  {table_free:>10.2}  \
+                 {btree_lookup:>19.2}  {array_lookup:>5.2}  {table_lookup:>10.2}"
+            );
+        }
+    }
+
+    use super::{FrameSlot, ShadowStack};
 
     /// (alloc_type, base, size) of each entry, top-of-Vec (highest addr) first.
     fn layout(s: &ShadowStack) -> Vec<(AllocType, usize, usize)> {
@@ -719,6 +1732,113 @@ mod tests {
         assert!(s.search_intersection(0x2000).is_some()); // X still live
     }
 
+    #[test]
+    fn stack_frame_push_pop() {
+        let mut s = ShadowStack::new();
+        s.add_shadow_object(0x2000, 0x100); // caller array
+
+        let slots = [
+            FrameSlot {
+                offset: 0,
+                size: 0x10,
+            },
+            FrameSlot {
+                offset: 0x20,
+                size: 0,
+            },
+            FrameSlot {
+                offset: 0x20,
+                size: 0x40,
+            },
+        ];
+        s.push_frame(0x1000, &slots);
+        assert_eq!(
+            layout(&s),
+            vec![
+                (AllocType::Stack, 0x2000, 0x100),
+                (AllocType::Stack, 0x1020, 0x40),
+                (AllocType::Stack, 0x1000, 0x10),
+            ]
+        );
+
+        // padding between slots is not part of any object
+        assert!(s.search_intersection(0x1018).is_none());
+        // one-past pointers still resolve to their slot
+        assert_eq!(s.search_intersection(0x1010).unwrap().base, 0x1000);
+
+        s.pop_frame(0x1000, 0x68);
+        assert_eq!(layout(&s), vec![(AllocType::Stack, 0x2000, 0x100)]);
+    }
+
+    #[test]
+    fn stack_frame_reuses_stale_frame() {
+        let mut s = ShadowStack::new();
+        s.add_shadow_object(0x2000, 0x100);
+        s.add_shadow_object(0x1000, 0x100); // stale, never invalidated
+        s.add_shadow_object(0x0800, 0x100); // stale, deeper
+
+        s.push_frame(
+            0x0F80,
+            &[FrameSlot {
+                offset: 0,
+                size: 0x20,
+            }],
+        );
+        assert_eq!(
+            layout(&s),
+            vec![
+                (AllocType::Stack, 0x2000, 0x100),
+                (AllocType::Stack, 0x1000, 0x100),
+                (AllocType::Stack, 0x0F80, 0x20),
+                (AllocType::Stack, 0x0800, 0x100),
+            ]
+        );
+
+        s.pop_frame(0x0F80, 0x28);
+        assert!(s.search_intersection(0x0F80).is_none());
+        assert!(s.search_intersection(0x0800).is_some());
+    }
+
+    /// longjmp from `inner` back to `outer` skips the pops of `inner` and
+    /// `middle`. The next call reuses their slots and must see only its own.
+    #[test]
+    fn stack_frame_longjmp_through_frames() {
+        let mut s = ShadowStack::new();
+        let slot = |size| [FrameSlot { offset: 0, size }];
+
+        s.push_frame(0x2000, &slot(0x100)); // outer, calls setjmp
+        s.push_frame(0x1E00, &slot(0x100)); // middle
+        s.push_frame(0x1C00, &slot(0x100)); // inner, calls longjmp
+
+        // back in outer: a smaller frame lands on middle's slot
+        s.push_frame(0x1E80, &slot(0x40));
+        assert_eq!(
+            layout(&s),
+            vec![
+                (AllocType::Stack, 0x2000, 0x100),
+                (AllocType::Stack, 0x1E80, 0x40),
+                (AllocType::Stack, 0x1C00, 0x100),
+            ]
+        );
+
+        // middle's bounds are gone around the new frame
+        assert!(s.search_intersection(0x1E00).is_none());
+        assert_eq!(s.search_intersection(0x1EC0).unwrap().base, 0x1E80);
+        assert!(s.search_intersection(0x1EF0).is_none());
+
+        s.pop_frame(0x1E80, 0x48);
+
+        // a deeper frame evicts inner, including the part above the frame
+        s.push_frame(0x1B80, &slot(0x100));
+        assert_eq!(s.search_intersection(0x1C00).unwrap().base, 0x1B80);
+        assert!(s.search_intersection(0x1CC0).is_none());
+
+        // nothing of the skipped frames is left once both frames return
+        s.pop_frame(0x1B80, 0x108);
+        s.pop_frame(0x2000, 0x108);
+        assert!(layout(&s).is_empty());
+    }
+
     #[test]
     #[should_panic]
     #[ignore = "not implemented"]
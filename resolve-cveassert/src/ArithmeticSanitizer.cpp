@@ -3,28 +3,181 @@
  *   LGPL-3; See LICENSE.txt in the repo root for details.
  */
 
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Twine.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LazyValueInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
 
 #include "CVEAssert.hpp"
 #include "IRUtils.hpp"
+#include "RemediationReport.hpp"
 #include "Vulnerability.hpp"
 
 #include <deque>
 #include <memory>
 #include <optional>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 using namespace llvm;
 
+namespace {
+
+/// Ranges of the integer values of a function, used to skip checks of
+/// arithmetic that cannot fail.
+///
+/// The analyses run on a copy of the function in a scratch module, so the
+/// function itself is left as it is. The no-wrap flags of the copy are
+/// dropped: they are what the overflow checks verify, so ranges must not be
+/// derived from them. Its stack slots are promoted to registers, so values
+/// reloaded from them at -O0, such as loop counters, still get ranges.
+class RangeAnalysis {
+  Module scratch;
+  ValueToValueMapTy VMap;
+  Function *copy;
+  DominatorTree DT;
+  AssumptionCache AC;
+  TargetLibraryInfoImpl TLII;
+  TargetLibraryInfo TLI;
+  LoopInfo LI;
+  std::unique_ptr<ScalarEvolution> SE;
+  std::unique_ptr<LazyValueInfo> LVI;
+
+  /// Clones `F` into `M`, recording the mapping of its values in `VMap`
+  static Function *cloneInto(Function &F, Module &M, ValueToValueMapTy &VMap) {
+    M.setDataLayout(F.getParent()->getDataLayout());
+    M.setTargetTriple(F.getParent()->getTargetTriple());
+    Function *copy = Function::Create(F.getFunctionType(), F.getLinkage(),
+                                      F.getName(), M);
+    for (auto [arg, copiedArg] : zip(F.args(), copy->args())) {
+      VMap[&arg] = &copiedArg;
+    }
+    SmallVector<ReturnInst *> returns;
+    CloneFunctionInto(copy, &F, VMap, CloneFunctionChangeType::DifferentModule,
+                      returns);
+    return copy;
+  }
+
+public:
+  explicit RangeAnalysis(Function &F)
+      : scratch("ranges", F.getContext()),
+        copy(cloneInto(F, scratch, VMap)), DT(*copy), AC(*copy),
+        TLII(Triple(scratch.getTargetTriple())), TLI(TLII) {
+    for (auto &BB : *copy) {
+      for (auto &I : BB) {
+        if (isa<OverflowingBinaryOperator>(&I)) {
+          I.setHasNoSignedWrap(false);
+          I.setHasNoUnsignedWrap(false);
+        }
+      }
+    }
+
+    // Promotion replaces the loads of the copy, and the value map follows
+    std::vector<AllocaInst *> promotable;
+    for (auto &I : copy->getEntryBlock()) {
+      if (auto *alloca = dyn_cast<AllocaInst>(&I)) {
+        if (isAllocaPromotable(alloca)) {
+          promotable.push_back(alloca);
+        }
+      }
+    }
+    if (!promotable.empty()) {
+      PromoteMemToReg(promotable, DT, &AC);
+    }
+
+    LI.analyze(DT);
+    SE = std::make_unique<ScalarEvolution>(*copy, TLI, AC, DT, LI);
+    LVI = std::make_unique<LazyValueInfo>(&AC, &scratch.getDataLayout());
+  }
+
+  ~RangeAnalysis() {
+    LVI.reset();
+    SE.reset();
+  }
+
+  /// Returns the range of the integer `V` when `at` executes
+  ConstantRange getRange(Value *V, Instruction *at, bool isSigned) {
+    if (Value *copied = VMap.lookup(V)) {
+      V = copied;
+    }
+    at = cast<Instruction>(VMap[at]);
+    ConstantRange range =
+        LVI->getConstantRange(V, at, /*UndefAllowed=*/false);
+    if (SE->isSCEVable(V->getType())) {
+      const SCEV *S = SE->getSCEV(V);
+      range = range.intersectWith(
+          isSigned ? SE->getSignedRange(S) : SE->getUnsignedRange(S),
+          isSigned ? ConstantRange::Signed : ConstantRange::Unsigned);
+    }
+    return range;
+  }
+};
+
+} // end anonymous namespace
+
+/// Returns true if the divisor of `binaryOp` is never zero
+static bool hasNonZeroDivisor(BinaryOperator *binaryOp,
+                              RangeAnalysis &ranges) {
+  Value *divisor = binaryOp->getOperand(1);
+  if (auto *fpDivisor = dyn_cast<ConstantFP>(divisor)) {
+    return !fpDivisor->isZero();
+  }
+  if (!divisor->getType()->isIntegerTy()) {
+    return false;
+  }
+  return !ranges.getRange(divisor, binaryOp, false).contains(
+      APInt::getZero(divisor->getType()->getIntegerBitWidth()));
+}
+
+/// Returns true if `binaryOp` never wraps in the signedness its overflow
+/// check uses
+static bool cannotOverflow(BinaryOperator *binaryOp, bool isUnsigned,
+                           RangeAnalysis &ranges) {
+  if (!binaryOp->getType()->isIntegerTy()) {
+    return false;
+  }
+
+  ConstantRange lhs = ranges.getRange(binaryOp->getOperand(0), binaryOp,
+                                      !isUnsigned);
+  ConstantRange rhs = ranges.getRange(binaryOp->getOperand(1), binaryOp,
+                                      !isUnsigned);
+  unsigned noWrapKind = isUnsigned ? OverflowingBinaryOperator::NoUnsignedWrap
+                                   : OverflowingBinaryOperator::NoSignedWrap;
+  return ConstantRange::makeGuaranteedNoWrapRegion(binaryOp->getOpcode(), rhs,
+                                                   noWrapKind)
+      .contains(lhs);
+}
+
+/// Returns true if the shift amount of `binaryOp` is always below the bit
+/// width of the shifted value
+static bool hasShiftInRange(BinaryOperator *binaryOp, RangeAnalysis &ranges) {
+  if (!binaryOp->getType()->isIntegerTy()) {
+    return false;
+  }
+
+  unsigned bitWidth = binaryOp->getType()->getIntegerBitWidth();
+  return ranges.getRange(binaryOp->getOperand(1), binaryOp, false)
+      .getUnsignedMax()
+      .ult(bitWidth);
+}
+
 static void widenIntOverflow(Function *F) {
   // Basic algorithm:
   // Find the pattern of overflowing op -> sext
@@ -125,8 +278,31 @@ void sanitizeDivideByZero(Function *F,
     }
   }
 
+  SmallPtrSet<Instruction *, 16> provenSafe;
+  if (!worklist.empty()) {
+    RangeAnalysis ranges(*F);
+    for (auto *binaryOp : worklist) {
+      if (hasNonZeroDivisor(cast<BinaryOperator>(binaryOp), ranges)) {
+        provenSafe.insert(binaryOp);
+      }
+    }
+  }
+
+  unsigned inserted = worklist.size() - provenSafe.size();
+  reportInsertedChecks(F, "divide-by-zero", inserted);
+  reportRemovedChecks(F, "divide-by-zero", provenSafe.size());
+  if (CVE_ASSERT_DEBUG) {
+    errs() << "[CVEAssert] Divide by zero checks in " << F->getName() << ": "
+           << inserted << " inserted, " << provenSafe.size()
+           << " proven safe\n";
+  }
+
   // Loop over each instruction in the list
   for (auto *binaryOp : worklist) {
+    if (provenSafe.contains(binaryOp)) {
+      continue;
+    }
+
     Value *dividend;
     Value *divisor;
     Value *isZero;
@@ -284,17 +460,46 @@ void sanitizeIntOverflow(Function *F,
         if (BinOp->getOpcode() == Instruction::Add ||
             BinOp->getOpcode() == Instruction::Sub ||
             BinOp->getOpcode() == Instruction::Mul) {
-          worklist.push_back(BinOp);
+          if (BinOp->hasNoSignedWrap() || BinOp->hasNoUnsignedWrap()) {
+            worklist.push_back(BinOp);
+          }
         }
       }
     }
   }
 
+  // Signedness of each check, read before the analyses drop the flags
+  SmallVector<bool> isUnsignedOp;
+  for (auto *binaryOp : worklist) {
+    isUnsignedOp.push_back(binaryOp->hasNoUnsignedWrap() &&
+                           !binaryOp->hasNoSignedWrap());
+  }
+
+  SmallPtrSet<Instruction *, 16> provenSafe;
+  if (!worklist.empty()) {
+    RangeAnalysis ranges(*F);
+    for (auto [binaryOp, isUnsigned] : zip(worklist, isUnsignedOp)) {
+      if (cannotOverflow(cast<BinaryOperator>(binaryOp), isUnsigned,
+                         ranges)) {
+        provenSafe.insert(binaryOp);
+      }
+    }
+  }
+
+  unsigned inserted = worklist.size() - provenSafe.size();
+  reportInsertedChecks(F, "integer-overflow", inserted);
+  reportRemovedChecks(F, "integer-overflow", provenSafe.size());
+  if (CVE_ASSERT_DEBUG) {
+    errs() << "[CVEAssert] Integer overflow checks in " << F->getName() << ": "
+           << inserted << " inserted, " << provenSafe.size()
+           << " proven safe\n";
+  }
+
   Value *op1;
   Value *op2;
 
   for (auto *binaryOp : worklist) {
-    if (!binaryOp->hasNoSignedWrap() && !binaryOp->hasNoUnsignedWrap()) {
+    if (provenSafe.contains(binaryOp)) {
       continue;
     }
 
@@ -457,7 +662,30 @@ void sanitizeBitShift(Function *F,
     }
   }
 
+  SmallPtrSet<Instruction *, 16> provenSafe;
+  if (!worklist.empty()) {
+    RangeAnalysis ranges(*F);
+    for (auto *binaryOp : worklist) {
+      if (hasShiftInRange(cast<BinaryOperator>(binaryOp), ranges)) {
+        provenSafe.insert(binaryOp);
+      }
+    }
+  }
+
+  unsigned inserted = worklist.size() - provenSafe.size();
+  reportInsertedChecks(F, "bit-shift", inserted);
+  reportRemovedChecks(F, "bit-shift", provenSafe.size());
+  if (CVE_ASSERT_DEBUG) {
+    errs() << "[CVEAssert] Bit shift checks in " << F->getName() << ": "
+           << inserted << " inserted, " << provenSafe.size()
+           << " proven safe\n";
+  }
+
   for (auto *binaryOp : worklist) {
+    if (provenSafe.contains(binaryOp)) {
+      continue;
+    }
+
     Value *isNegative;
     Value *isGreaterThanBitwidth;
     Value *CheckShiftAmtCond;
@@ -3,11 +3,19 @@
  *   LGPL-3; See LICENSE.txt in the repo root for details.
  */
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Twine.h"
+#include "llvm/Analysis/AssumptionCache.h"
 #include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/Attributes.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/IntrinsicInst.h"
@@ -15,12 +23,19 @@
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/ModRef.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
 
+#include "BoundsCheck.hpp"
 #include "CVEAssert.hpp"
+#include "CheckOptimizer.hpp"
 #include "IRUtils.hpp"
+#include "InstrumentAllocators.hpp"
+#include "RemediationReport.hpp"
 #include "Vulnerability.hpp"
 
 #include <map>
+#include <optional>
 #include <unordered_set>
 
 using namespace llvm;
@@ -107,6 +122,67 @@ static FunctionCallee getOrCreateReportAccessViolation(Module *M) {
       FunctionType::get(voidType, {ptrType, sizeType, ptrType}, false));
 }
 
+// Layout of the low-fat heap. Must match libresolve/src/lowfat.rs.
+static constexpr unsigned LOWFAT_MIN_CLASS_SHIFT = 4;
+static constexpr unsigned LOWFAT_REGION_SHIFT = 30;
+
+/// Emits the access check for pointers into the low-fat heap of libresolve.
+/// Slots in region i of the heap are 1 << (i + LOWFAT_MIN_CLASS_SHIFT) bytes
+/// and aligned to their size, so the slot of a pointer follows from its value.
+/// The requested size of each slot is stored as an i32 after the heap, one per
+/// minimum size slot, and is 0 for free slots. Pointers outside of the heap
+/// branch to lookupBB.
+static void emitLowFatCheck(IRBuilder<> &builder, Value *ptr, Value *accessSize,
+                            BasicBlock *lookupBB, BasicBlock *allowedBB,
+                            BasicBlock *deniedBB) {
+  Function *F = builder.GetInsertBlock()->getParent();
+  Module *M = F->getParent();
+  LLVMContext &Ctx = M->getContext();
+  auto ptrType = PointerType::get(Ctx, 0);
+  auto sizeType = Type::getInt64Ty(Ctx);
+
+  Value *base = builder.CreateLoad(
+      sizeType, M->getOrInsertGlobal("__resolve_lowfat_base", sizeType),
+      "lowfat.base");
+  Value *span = builder.CreateLoad(
+      sizeType, M->getOrInsertGlobal("__resolve_lowfat_span", sizeType),
+      "lowfat.span");
+  Value *offset = builder.CreateSub(builder.CreatePtrToInt(ptr, sizeType),
+                                    base, "lowfat.offset");
+  BasicBlock *lowFatBB = BasicBlock::Create(Ctx, "lowfat.check", F, lookupBB);
+  builder.CreateCondBr(builder.CreateICmpULT(offset, span), lowFatBB,
+                       lookupBB);
+
+  builder.SetInsertPoint(lowFatBB);
+  Value *classShift =
+      builder.CreateAdd(builder.CreateLShr(offset, LOWFAT_REGION_SHIFT),
+                        ConstantInt::get(sizeType, LOWFAT_MIN_CLASS_SHIFT));
+  Value *classMask = builder.CreateSub(
+      builder.CreateShl(ConstantInt::get(sizeType, 1), classShift),
+      ConstantInt::get(sizeType, 1));
+  Value *slotOffset = builder.CreateAnd(offset, classMask, "lowfat.slot.off");
+  Value *slot = builder.CreateSub(offset, slotOffset);
+
+  // Each size is 4 bytes per 1 << LOWFAT_MIN_CLASS_SHIFT bytes of heap
+  Value *sizeAddr = builder.CreateAdd(
+      builder.CreateAdd(base, span),
+      builder.CreateLShr(slot, LOWFAT_MIN_CLASS_SHIFT - 2));
+  Value *objSize = builder.CreateZExt(
+      builder.CreateLoad(Type::getInt32Ty(Ctx),
+                         builder.CreateIntToPtr(sizeAddr, ptrType),
+                         "lowfat.size"),
+      sizeType);
+
+  // Free slots are untracked, like objects missing from the shadow table
+  Value *freeSlot =
+      builder.CreateICmpEQ(objSize, ConstantInt::get(sizeType, 0));
+  Value *fits = builder.CreateAnd(
+      builder.CreateICmpULE(accessSize, objSize),
+      builder.CreateICmpULE(slotOffset,
+                            builder.CreateSub(objSize, accessSize)));
+  builder.CreateCondBr(builder.CreateOr(freeSlot, fits), allowedBB, deniedBB);
+}
+
 static Function *getOrCreateAccessOk(Module *M, BoundsClass cls) {
   std::string handlerName = std::string("__resolve_access_ok_") + classTag(cls);
   LLVMContext &Ctx = M->getContext();
@@ -143,6 +219,15 @@ static Function *getOrCreateAccessOk(Module *M, BoundsClass cls) {
   Value *ptr = accessOkFn->getArg(0);
   Value *accessSize = accessOkFn->getArg(1);
 
+  // Stack objects never live in the low-fat heap
+  if (CVE_ASSERT_LOWFAT_HEAP && cls != BoundsClass::Stack) {
+    BasicBlock *lookupBB =
+        BasicBlock::Create(Ctx, "lookup", accessOkFn, checkBoundsBB);
+    emitLowFatCheck(builder, ptr, accessSize, lookupBB, accessAllowedBB,
+                    accessDeniedBB);
+    builder.SetInsertPoint(lookupBB);
+  }
+
   Value *bounds =
       builder.CreateCall(getOrCreateGetBounds(M, cls), {ptr}, "resolve.bounds");
   Value *upperBound = builder.CreateExtractValue(bounds, 1);
@@ -575,7 +660,604 @@ static Function *getOrCreateGepWrapper(Function *F, BoundsClass cls) {
   return gepWrapper;
 }
 
-void instrumentGep(Function *F) {
+/// Like getUnderlyingObject, but stops at the slots of a merged stack frame,
+/// which the runtime tracks as objects of their own.
+static const Value *getTrackedObject(const Value *ptr) {
+  while (!getFrameSlotSize(ptr)) {
+    if (auto *gep = dyn_cast<GEPOperator>(ptr)) {
+      ptr = gep->getPointerOperand();
+    } else if (isa<BitCastOperator>(ptr) || isa<AddrSpaceCastOperator>(ptr)) {
+      ptr = cast<Operator>(ptr)->getOperand(0);
+    } else {
+      return getUnderlyingObject(ptr);
+    }
+  }
+  return ptr;
+}
+
+/// Size in bytes of the allocation `obj` as tracked by the runtime, if it is
+/// known at compile time. Array allocas padded by instrumentAlloca report
+/// their original size.
+static std::optional<uint64_t> getTrackedObjectSize(const Value *obj,
+                                                    const DataLayout &DL) {
+  if (std::optional<uint64_t> slotSize = getFrameSlotSize(obj)) {
+    return slotSize;
+  }
+
+  if (auto *alloca = dyn_cast<AllocaInst>(obj)) {
+    // A merged stack frame holds several objects, it is never one itself
+    if (alloca->getMetadata("cve.frame")) {
+      return std::nullopt;
+    }
+
+    auto size = alloca->getAllocationSize(DL);
+    if (!size || size->isScalable()) {
+      return std::nullopt;
+    }
+
+    uint64_t bytes = size->getFixedValue();
+    if (alloca->getMetadata("cve.noinstrument")) {
+      Type *allocatedType = alloca->getAllocatedType();
+      if (auto *arrType = dyn_cast<ArrayType>(allocatedType)) {
+        bytes -= DL.getTypeAllocSize(arrType->getElementType()).getFixedValue();
+      } else if (alloca->isArrayAllocation()) {
+        bytes -= DL.getTypeAllocSize(allocatedType).getFixedValue();
+      }
+    }
+    return bytes;
+  }
+
+  if (auto *global = dyn_cast<GlobalVariable>(obj)) {
+    if (global->isDeclaration() || global->isInterposable()) {
+      return std::nullopt;
+    }
+    return DL.getTypeAllocSize(global->getValueType()).getFixedValue();
+  }
+
+  if (auto *call = dyn_cast<CallInst>(obj)) {
+    Function *callee = call->getCalledFunction();
+    if (!callee) {
+      return std::nullopt;
+    }
+
+    StringRef n = callee->getName();
+    if (n == "malloc" || n == "__resolve_malloc") {
+      if (auto *size = dyn_cast<ConstantInt>(call->getArgOperand(0))) {
+        return size->getZExtValue();
+      }
+    }
+
+    if (n == "calloc" || n == "__resolve_calloc") {
+      auto *count = dyn_cast<ConstantInt>(call->getArgOperand(0));
+      auto *size = dyn_cast<ConstantInt>(call->getArgOperand(1));
+      bool overflow = true;
+      if (count && size) {
+        APInt bytes = count->getValue().umul_ov(size->getValue(), overflow);
+        if (!overflow) {
+          return bytes.getZExtValue();
+        }
+      }
+    }
+  }
+
+  return std::nullopt;
+}
+
+/// Returns true if `ptr` provably stays within [obj, obj + size - accessSize]
+/// of its underlying object. An accessSize of 0 allows the one-past pointer,
+/// which is what the GEP wrapper clamps to.
+static bool isProvablyInBounds(Value *ptr, uint64_t accessSize,
+                               const DataLayout &DL, ScalarEvolution &SE) {
+  const Value *obj = getTrackedObject(ptr);
+  std::optional<uint64_t> size = getTrackedObjectSize(obj, DL);
+  if (!size || *size < accessSize) {
+    return false;
+  }
+  uint64_t limit = *size - accessSize;
+
+  // Constant offsets from the object
+  APInt offset(DL.getIndexTypeSizeInBits(ptr->getType()), 0);
+  const Value *base = ptr->stripAndAccumulateConstantOffsets(
+      DL, offset, /*AllowNonInbounds=*/true);
+  if (base != obj && getFrameSlotSize(obj)) {
+    // Stripping walks through the slot to its frame, rebase onto the slot
+    APInt slotOffset(offset.getBitWidth(), 0);
+    if (obj->stripAndAccumulateConstantOffsets(DL, slotOffset, true) == base) {
+      offset -= slotOffset;
+      base = obj;
+    }
+  }
+  if (base == obj) {
+    return offset.isNonNegative() && offset.ule(limit);
+  }
+
+  // Offsets bounded by scalar evolution, e.g. induction variables
+  if (!SE.isSCEVable(ptr->getType())) {
+    return false;
+  }
+  const SCEV *offsetSCEV = SE.getMinusSCEV(
+      SE.getSCEV(ptr), SE.getSCEV(const_cast<Value *>(obj)));
+  if (isa<SCEVCouldNotCompute>(offsetSCEV)) {
+    return false;
+  }
+
+  ConstantRange range = SE.getSignedRange(offsetSCEV);
+  return range.getSignedMin().isNonNegative() &&
+         range.getSignedMax().ule(limit);
+}
+
+/// Decides, before any instrumentation is inserted, which bounds checks in
+/// `F` can be dropped:
+///  - GEPs and accesses proven in bounds from object sizes and SCEV ranges;
+///  - GEPs and accesses covered by a dominating check with no call that may
+///    free memory in between, when a failed check stops execution. Checks
+///    of neighbouring fields of one base in a block are merged into one;
+///  - with `hoistLoops`, accesses whose pointer is loop invariant or an
+///    affine recurrence of a loop with a computable trip count. These are
+///    covered by one range check in the loop preheader, and only fall back
+///    to the per-access check when that range check fails.
+static BoundsCheckPlan
+planBoundsChecks(Function *F, Vulnerability::RemediationStrategies strategy,
+                 bool hoistLoops) {
+  Module *M = F->getParent();
+  LLVMContext &Ctx = M->getContext();
+  const DataLayout &DL = M->getDataLayout();
+  auto ptrType = PointerType::get(Ctx, 0);
+  auto sizeType = Type::getInt64Ty(Ctx);
+
+  BoundsCheckPlan plan;
+
+  DominatorTree DT(*F);
+  LoopInfo LI(DT);
+  AssumptionCache AC(*F);
+  TargetLibraryInfoImpl TLII(Triple(M->getTargetTriple()));
+  TargetLibraryInfo TLI(TLII);
+  ScalarEvolution SE(*F, TLI, AC, DT, LI);
+  SCEVExpander expander(SE, DL, "resolve.range");
+
+  // Range checks already emitted, keyed by pointer and access size
+  std::map<std::pair<const SCEV *, uint64_t>, Value *> rangeChecks;
+
+  auto hoistRangeCheck = [&](Instruction *access, Value *ptr,
+                             uint64_t accessSize) -> Value * {
+    Loop *L = LI.getLoopFor(access->getParent());
+    if (!L || !L->getLoopPreheader() || !SE.isSCEVable(ptr->getType())) {
+      return nullptr;
+    }
+
+    const SCEV *ptrSCEV = SE.getSCEV(ptr);
+    const SCEV *lo = ptrSCEV;
+    const SCEV *hi = ptrSCEV;
+    if (!SE.isLoopInvariant(ptrSCEV, L)) {
+      auto *rec = dyn_cast<SCEVAddRecExpr>(ptrSCEV);
+      if (!rec || rec->getLoop() != L || !rec->isAffine()) {
+        return nullptr;
+      }
+
+      const SCEV *backedges = SE.getBackedgeTakenCount(L);
+      if (isa<SCEVCouldNotCompute>(backedges)) {
+        return nullptr;
+      }
+
+      const SCEV *first = rec->getStart();
+      const SCEV *last = rec->evaluateAtIteration(backedges, SE);
+      const SCEV *step = rec->getStepRecurrence(SE);
+      if (SE.isKnownNonNegative(step)) {
+        lo = first;
+        hi = last;
+      } else if (SE.isKnownNonPositive(step)) {
+        lo = last;
+        hi = first;
+      } else {
+        return nullptr;
+      }
+    }
+
+    auto key = std::make_pair(ptrSCEV, accessSize);
+    if (auto it = rangeChecks.find(key); it != rangeChecks.end()) {
+      return it->second;
+    }
+
+    Instruction *insertPt = L->getLoopPreheader()->getTerminator();
+    if (!expander.isSafeToExpandAt(lo, insertPt) ||
+        !expander.isSafeToExpandAt(hi, insertPt)) {
+      return nullptr;
+    }
+
+    Value *loPtr = expander.expandCodeFor(lo, ptrType, insertPt);
+    Value *hiPtr = expander.expandCodeFor(hi, ptrType, insertPt);
+
+    IRBuilder<> builder(insertPt);
+    Value *span = builder.CreateSub(builder.CreatePtrToInt(hiPtr, sizeType),
+                                    builder.CreatePtrToInt(loPtr, sizeType));
+    Value *rangeSize =
+        builder.CreateAdd(span, ConstantInt::get(sizeType, accessSize));
+
+    // Checking both ends keeps the result identical to the per-access
+    // checks when the range starts outside any tracked object.
+    Function *accessOkFn = getOrCreateAccessOk(M, classifyPointer(ptr));
+    Value *noName = ConstantPointerNull::get(ptrType);
+    Value *loOk = builder.CreateCall(accessOkFn, {loPtr, rangeSize, noName});
+    Value *hiOk = builder.CreateCall(
+        accessOkFn, {hiPtr, ConstantInt::get(sizeType, accessSize), noName});
+    Value *ok = builder.CreateAnd(loOk, hiOk, "resolve.range.ok");
+
+    rangeChecks[key] = ok;
+    return ok;
+  };
+
+  // Checks that are not proven unnecessary, in program order
+  SmallVector<CheckedAccess> candidates;
+
+  for (auto &BB : *F) {
+    for (auto &I : BB) {
+      if (I.getMetadata("cve.noinstrument")) {
+        continue;
+      }
+
+      if (auto *gep = dyn_cast<GetElementPtrInst>(&I)) {
+        if (isProvablyInBounds(gep, 0, DL, SE)) {
+          plan.elided.insert(gep);
+        } else {
+          candidates.push_back({gep, gep->getPointerOperand(), 0, gep});
+        }
+        continue;
+      }
+
+      Value *ptr;
+      Type *valueType;
+      if (auto *load = dyn_cast<LoadInst>(&I)) {
+        ptr = load->getPointerOperand();
+        valueType = load->getType();
+      } else if (auto *store = dyn_cast<StoreInst>(&I)) {
+        ptr = store->getPointerOperand();
+        valueType = store->getValueOperand()->getType();
+      } else {
+        continue;
+      }
+
+      // Whole stack values are skipped by instrumentLoadStore
+      auto *alloca = dyn_cast<AllocaInst>(ptr);
+      uint64_t accessSize = DL.getTypeStoreSize(valueType).getFixedValue();
+      if ((alloca && alloca->getAllocatedType() == valueType) ||
+          isProvablyInBounds(ptr, accessSize, DL, SE)) {
+        plan.elided.insert(&I);
+      } else {
+        candidates.push_back({&I, ptr, accessSize});
+      }
+    }
+  }
+
+  // Checks that terminate on failure make later checks they cover redundant.
+  // Any other strategy is instrumented as continue, which falls through.
+  if (strategy == Vulnerability::RemediationStrategies::EXIT ||
+      strategy == Vulnerability::RemediationStrategies::RECOVER) {
+    CheckOptimization optimized =
+        optimizeChecks(*F, DT, candidates, CheckFact::InBounds);
+    plan.redundant = std::move(optimized.redundant);
+    plan.widened = std::move(optimized.widened);
+    plan.merged = optimized.merged;
+  }
+
+  if (hoistLoops) {
+    for (const CheckedAccess &access : candidates) {
+      // Widened checks cover more than the hoisted range check would
+      if (access.derived || plan.redundant.contains(access.inst) ||
+          plan.widened.count(access.inst)) {
+        continue;
+      }
+
+      if (Value *ok = hoistRangeCheck(access.inst, access.ptr, access.size)) {
+        plan.hoisted[access.inst] = ok;
+      }
+    }
+  }
+
+  // Expanded range computations must not be instrumented themselves
+  for (Instruction *I : expander.getAllInsertedInstructions()) {
+    I->setMetadata("cve.noinstrument", MDNode::get(Ctx, {}));
+  }
+
+  return plan;
+}
+
+/// Keeps `access` on the fast path when its preheader range check `ok`
+/// passed and falls back to the checked access built by `emitChecked`
+/// otherwise.
+static void
+guardHoistedAccess(Instruction *access, Value *ok,
+                   function_ref<Value *(IRBuilder<> &)> emitChecked) {
+  Instruction *thenTerm;
+  Instruction *elseTerm;
+  SplitBlockAndInsertIfThenElse(ok, access, &thenTerm, &elseTerm);
+
+  Instruction *fast = access->clone();
+  fast->insertBefore(thenTerm);
+
+  IRBuilder<> builder(elseTerm);
+  Value *checked = emitChecked(builder);
+
+  if (!access->getType()->isVoidTy()) {
+    builder.SetInsertPoint(access);
+    PHINode *phi = builder.CreatePHI(access->getType(), 2);
+    phi->addIncoming(fast, thenTerm->getParent());
+    phi->addIncoming(checked, elseTerm->getParent());
+    access->replaceAllUsesWith(phi);
+  }
+  access->eraseFromParent();
+}
+
+/// Returns the bounds of the object `ptr` may access. Bounds are looked up
+/// once where a pointer enters the function (allocation, argument, load or
+/// call result) and follow it through GEPs, casts, phis and selects.
+static PointerBounds getPointerBounds(Function *F, BoundsCheckPlan &plan,
+                                      Value *ptr, BoundsCheckStats &stats) {
+  if (auto it = plan.bounds.find(ptr); it != plan.bounds.end()) {
+    return it->second;
+  }
+
+  Module *M = F->getParent();
+  LLVMContext &Ctx = M->getContext();
+  const DataLayout &DL = M->getDataLayout();
+  auto sizeType = Type::getInt64Ty(Ctx);
+  IRBuilder<> builder(Ctx);
+
+  // Derived pointers share the bounds of the pointer they are derived from.
+  // Slots of a merged stack frame are objects of their own.
+  if (auto *gep = dyn_cast<GEPOperator>(ptr); gep && !getFrameSlotSize(gep)) {
+    PointerBounds bounds =
+        getPointerBounds(F, plan, gep->getPointerOperand(), stats);
+    plan.bounds[ptr] = bounds;
+    return bounds;
+  }
+
+  if (isa<BitCastOperator>(ptr) || isa<AddrSpaceCastOperator>(ptr)) {
+    PointerBounds bounds = getPointerBounds(
+        F, plan, cast<Operator>(ptr)->getOperand(0), stats);
+    plan.bounds[ptr] = bounds;
+    return bounds;
+  }
+
+  if (auto *phi = dyn_cast<PHINode>(ptr)) {
+    builder.SetInsertPoint(phi);
+    unsigned numIncoming = phi->getNumIncomingValues();
+    PHINode *base = builder.CreatePHI(sizeType, numIncoming, "resolve.base");
+    PHINode *limit = builder.CreatePHI(sizeType, numIncoming, "resolve.limit");
+
+    // Register the phis first so pointer recurrences terminate
+    plan.bounds[ptr] = {base, limit};
+    for (unsigned i = 0; i < numIncoming; i++) {
+      PointerBounds incoming =
+          getPointerBounds(F, plan, phi->getIncomingValue(i), stats);
+      base->addIncoming(incoming.base, phi->getIncomingBlock(i));
+      limit->addIncoming(incoming.limit, phi->getIncomingBlock(i));
+    }
+    return {base, limit};
+  }
+
+  if (auto *select = dyn_cast<SelectInst>(ptr)) {
+    PointerBounds onTrue =
+        getPointerBounds(F, plan, select->getTrueValue(), stats);
+    PointerBounds onFalse =
+        getPointerBounds(F, plan, select->getFalseValue(), stats);
+    builder.SetInsertPoint(select);
+    Value *cond = select->getCondition();
+    PointerBounds bounds = {
+        builder.CreateSelect(cond, onTrue.base, onFalse.base, "resolve.base"),
+        builder.CreateSelect(cond, onTrue.limit, onFalse.limit,
+                             "resolve.limit")};
+    plan.bounds[ptr] = bounds;
+    return bounds;
+  }
+
+  // Null and undefined pointers are never tracked by the runtime
+  if (isa<ConstantPointerNull>(ptr) || isa<UndefValue>(ptr)) {
+    Value *zero = ConstantInt::get(sizeType, 0);
+    plan.bounds[ptr] = {zero, zero};
+    return {zero, zero};
+  }
+
+  // Otherwise the pointer enters the function here. Fetch its bounds right
+  // after it is defined, or on entry for arguments and constants.
+  Instruction *insertPt;
+  if (auto *invoke = dyn_cast<InvokeInst>(ptr)) {
+    BasicBlock *normalDest = invoke->getNormalDest();
+    if (!normalDest->getSinglePredecessor()) {
+      normalDest = SplitEdge(invoke->getParent(), normalDest);
+    }
+    insertPt = &*normalDest->getFirstInsertionPt();
+  } else if (auto *inst = dyn_cast<Instruction>(ptr)) {
+    insertPt = inst->getNextNode();
+  } else {
+    insertPt = &*F->getEntryBlock().getFirstInsertionPt();
+  }
+  builder.SetInsertPoint(insertPt);
+
+  PointerBounds bounds;
+
+  // Padded stack objects and frame slots have a fixed size, no lookup needed
+  auto *alloca = dyn_cast<AllocaInst>(ptr);
+  std::optional<uint64_t> size;
+  if (alloca && alloca->getMetadata("cve.noinstrument")) {
+    size = getTrackedObjectSize(alloca, DL);
+  } else {
+    size = getFrameSlotSize(ptr);
+  }
+
+  if (size && *size > 0) {
+    Value *base = builder.CreatePtrToInt(ptr, sizeType, "resolve.base");
+    Value *lastOffset = ConstantInt::get(sizeType, *size - 1);
+    bounds = {base, builder.CreateAdd(base, lastOffset, "resolve.limit")};
+  } else if (!size && alloca && alloca->getMetadata("cve.noinstrument") &&
+             alloca->isArrayAllocation()) {
+    // Padded VLAs are registered after this point, so take their bounds from
+    // the element count, less the padding element, instead of a lookup
+    uint64_t elemSize =
+        DL.getTypeAllocSize(alloca->getAllocatedType()).getFixedValue();
+    Value *count = builder.CreateZExtOrTrunc(alloca->getArraySize(), sizeType);
+    Value *bytes = builder.CreateMul(
+        builder.CreateSub(count, ConstantInt::get(sizeType, 1)),
+        ConstantInt::get(sizeType, elemSize));
+    Value *base = builder.CreatePtrToInt(ptr, sizeType, "resolve.base");
+    Value *lastOffset = builder.CreateSub(bytes, ConstantInt::get(sizeType, 1));
+    bounds = {base, builder.CreateAdd(base, lastOffset, "resolve.limit")};
+  } else {
+    Value *objBounds = builder.CreateCall(
+        getOrCreateGetBounds(M, classifyPointer(ptr)), {ptr}, "resolve.bounds");
+    bounds = {builder.CreatePtrToInt(builder.CreateExtractValue(objBounds, 0),
+                                     sizeType, "resolve.base"),
+              builder.CreatePtrToInt(builder.CreateExtractValue(objBounds, 1),
+                                     sizeType, "resolve.limit")};
+    stats.lookups++;
+  }
+
+  plan.bounds[ptr] = bounds;
+  return bounds;
+}
+
+/// Clamps `derivedPtr` to one past the end of the object `ptr` points into,
+/// using propagated bounds. This is the inline equivalent of the
+/// __resolve_gep_* wrappers.
+static Value *createInlineGepClamp(IRBuilder<> &builder, Function *F,
+                                   Value *ptr, Value *derivedPtr,
+                                   BoundsCheckPlan &plan,
+                                   BoundsCheckStats &stats) {
+  LLVMContext &Ctx = F->getContext();
+  auto ptrType = PointerType::get(Ctx, 0);
+  auto sizeType = Type::getInt64Ty(Ctx);
+
+  PointerBounds bounds = getPointerBounds(F, plan, ptr, stats);
+
+  Value *enabled =
+      createSanitizerEnabledCheck(builder, F, SanitizerFlag::BoundsCheck);
+  Value *derivedInt = builder.CreatePtrToInt(derivedPtr, sizeType);
+  Value *untracked =
+      builder.CreateICmpEQ(bounds.limit, ConstantInt::get(sizeType, 0));
+  Value *inBounds =
+      builder.CreateAnd(builder.CreateICmpUGE(derivedInt, bounds.base),
+                        builder.CreateICmpULE(derivedInt, bounds.limit));
+  Value *keep = builder.CreateOr(builder.CreateNot(enabled),
+                                 builder.CreateOr(untracked, inBounds));
+
+  // Return a pointer that is clamped at one past the last valid byte address
+  Value *onePastPtr = builder.CreateIntToPtr(
+      builder.CreateAdd(bounds.limit, ConstantInt::get(sizeType, 1)), ptrType);
+  Value *clamped =
+      builder.CreateSelect(keep, derivedPtr, onePastPtr, "resolve.gep");
+
+  plan.bounds[derivedPtr] = bounds;
+  plan.bounds[clamped] = bounds;
+  return clamped;
+}
+
+/// Guards `access` with an inline check of `ptr` against its propagated
+/// bounds, applying the remediation strategy when the check fails.
+static void
+insertInlineAccessCheck(Instruction *access, Value *ptr, uint64_t accessSize,
+                        PointerBounds bounds,
+                        Vulnerability::RemediationStrategies strategy) {
+  BasicBlock *head = access->getParent();
+  Function *F = head->getParent();
+  Module *M = F->getParent();
+  LLVMContext &Ctx = M->getContext();
+  auto sizeType = Type::getInt64Ty(Ctx);
+
+  BasicBlock *tail = head->splitBasicBlock(access, "bounds.cont");
+  head->getTerminator()->eraseFromParent();
+  BasicBlock *checkBoundsBB =
+      BasicBlock::Create(Ctx, "bounds.check", F, tail);
+  BasicBlock *safeAccessBB = BasicBlock::Create(Ctx, "bounds.ok", F, tail);
+  BasicBlock *unsafeAccessBB =
+      BasicBlock::Create(Ctx, "bounds.fail", F, tail);
+
+  IRBuilder<> builder(head);
+  createSanitizerGateBranch(builder, F, SanitizerFlag::BoundsCheck,
+                            safeAccessBB, checkBoundsBB);
+
+  builder.SetInsertPoint(checkBoundsBB);
+  Value *ptrInt = builder.CreatePtrToInt(ptr, sizeType);
+  Value *lastByte =
+      builder.CreateAdd(ptrInt, ConstantInt::get(sizeType, accessSize - 1));
+  Value *untracked =
+      builder.CreateICmpEQ(bounds.limit, ConstantInt::get(sizeType, 0));
+  Value *inBounds =
+      builder.CreateAnd(builder.CreateICmpUGE(ptrInt, bounds.base),
+                        builder.CreateICmpULE(lastByte, bounds.limit));
+  builder.CreateCondBr(builder.CreateOr(untracked, inBounds), safeAccessBB,
+                       unsafeAccessBB);
+
+  builder.SetInsertPoint(safeAccessBB);
+  Instruction *safeAccess = access->clone();
+  builder.Insert(safeAccess);
+  builder.CreateBr(tail);
+
+  builder.SetInsertPoint(unsafeAccessBB);
+  Function *remediate = getOrCreateRemediationBehavior(M, strategy);
+  if (remediate) {
+    builder.CreateCall(remediate);
+    builder.CreateUnreachable();
+  } else {
+    builder.CreateBr(tail);
+  }
+
+  if (!access->getType()->isVoidTy()) {
+    Value *result = safeAccess;
+    if (!remediate) {
+      builder.SetInsertPoint(access);
+      PHINode *phi = builder.CreatePHI(access->getType(), 2);
+      phi->addIncoming(safeAccess, safeAccessBB);
+      phi->addIncoming(Constant::getNullValue(access->getType()),
+                       unsafeAccessBB);
+      result = phi;
+    }
+    access->replaceAllUsesWith(result);
+  }
+  access->eraseFromParent();
+}
+
+/// Guards `access` with a check that `size` bytes at `ptr` lie within one
+/// object, covering the accesses to neighbouring fields merged into it. Only
+/// used with strategies that stop execution when the check fails.
+static void
+insertWidenedAccessCheck(Instruction *access, Value *ptr, uint64_t size,
+                         Vulnerability::RemediationStrategies strategy) {
+  BasicBlock *head = access->getParent();
+  Function *F = head->getParent();
+  Module *M = F->getParent();
+  LLVMContext &Ctx = M->getContext();
+  auto ptrType = PointerType::get(Ctx, 0);
+  auto sizeType = Type::getInt64Ty(Ctx);
+
+  BasicBlock *tail = head->splitBasicBlock(access, "bounds.cont");
+  head->getTerminator()->eraseFromParent();
+  BasicBlock *checkBoundsBB =
+      BasicBlock::Create(Ctx, "bounds.check", F, tail);
+  BasicBlock *unsafeAccessBB =
+      BasicBlock::Create(Ctx, "bounds.fail", F, tail);
+
+  IRBuilder<> builder(head);
+  createSanitizerGateBranch(builder, F, SanitizerFlag::BoundsCheck, tail,
+                            checkBoundsBB);
+
+  builder.SetInsertPoint(checkBoundsBB);
+  Function *accessOkFn = getOrCreateAccessOk(M, classifyPointer(ptr));
+  Value *noName = ConstantPointerNull::get(ptrType);
+  Value *inBounds = builder.CreateCall(
+      accessOkFn, {ptr, ConstantInt::get(sizeType, size), noName},
+      "resolve.wide.ok");
+  builder.CreateCondBr(inBounds, tail, unsafeAccessBB);
+
+  builder.SetInsertPoint(unsafeAccessBB);
+  if (Function *fn = getOrCreateRemediationBehavior(M, strategy)) {
+    builder.CreateCall(fn);
+    builder.CreateUnreachable();
+  } else {
+    builder.CreateBr(tail);
+  }
+}
+
+void instrumentGep(Function *F, BoundsCheckPlan &plan,
+                   BoundsCheckStats &stats) {
   Module *M = F->getParent();
   LLVMContext &Ctx = M->getContext();
   IRBuilder<> builder(Ctx);
@@ -594,29 +1276,54 @@ void instrumentGep(Function *F) {
 
     Value *ptr = gep->getPointerOperand();
     GetElementPtrInst *derivedPtr = gep;
-    gep->setIsInBounds(false);
+    SmallVector<GetElementPtrInst *, 4> chain = {gep};
 
     // If we are chaining geps we do not need to check each individually,
     // only the total range
     while (derivedPtr->hasOneUser()) {
       if (auto *gep2 = dyn_cast<GetElementPtrInst>(derivedPtr->user_back())) {
-        gep2->setIsInBounds(false);
         visitedGep.insert(gep2);
+        chain.push_back(gep2);
         derivedPtr = gep2;
       } else {
         break;
       }
     }
 
+    visitedGep.insert(gep);
+    if (plan.elided.contains(derivedPtr)) {
+      stats.elided++;
+      return;
+    }
+
+    // Every step of the chain must stay within the object a dominating
+    // check covered, starting from the pointer the wrapper looks up
+    if (all_of(chain, [&](auto *chained) {
+          return plan.redundant.contains(chained);
+        })) {
+      stats.redundant++;
+      return;
+    }
+
+    for (auto *chained : chain) {
+      chained->setIsInBounds(false);
+    }
+
     SmallVector<User *, 8> gep_users;
     for (User *U : derivedPtr->users()) {
       gep_users.push_back(U);
     }
 
     builder.SetInsertPoint(derivedPtr->getNextNode());
-    BoundsClass cls = classifyPointer(ptr);
-    auto resolveGepCall =
-        builder.CreateCall(getOrCreateGepWrapper(F, cls), {ptr, derivedPtr});
+    Value *resolveGepCall;
+    if (plan.propagateBounds) {
+      resolveGepCall =
+          createInlineGepClamp(builder, F, ptr, derivedPtr, plan, stats);
+    } else {
+      BoundsClass cls = classifyPointer(ptr);
+      resolveGepCall =
+          builder.CreateCall(getOrCreateGepWrapper(F, cls), {ptr, derivedPtr});
+    }
 
     // Iterate over all the users of the gep instruction and
     // replace their operands with resolve_gep result
@@ -626,7 +1333,7 @@ void instrumentGep(Function *F) {
       }
     }
 
-    visitedGep.insert(gep);
+    stats.inserted++;
   };
 
   for (auto &BB : *F) {
@@ -669,6 +1376,8 @@ void instrumentMemcpy(Function *F,
     }
   }
 
+  reportInsertedChecks(F, "bounds", memcpyList.size());
+
   for (auto *memcpy : memcpyList) {
     builder.SetInsertPoint(memcpy);
 
@@ -726,6 +1435,8 @@ void instrumentMemset(Function *F,
     }
   }
 
+  reportInsertedChecks(F, "bounds", memsetList.size());
+
   for (auto *memset : memsetList) {
     builder.SetInsertPoint(memset);
 
@@ -794,6 +1505,8 @@ void instrumentMemmove(Function *F,
     }
   }
 
+  reportInsertedChecks(F, "bounds", memmoveList.size());
+
   for (auto *memmove : memmoveList) {
     builder.SetInsertPoint(memmove);
 
@@ -821,8 +1534,15 @@ void instrumentMemmove(Function *F,
 }
 
 void instrumentLoadStore(Function *F,
-                         Vulnerability::RemediationStrategies strategy) {
+                         Vulnerability::RemediationStrategies strategy,
+                         BoundsCheckPlan *plan, BoundsCheckStats *stats) {
+  BoundsCheckStats localStats;
+  if (!stats) {
+    stats = &localStats;
+  }
+
   LLVMContext &Ctx = F->getContext();
+  const DataLayout &DL = F->getParent()->getDataLayout();
   IRBuilder<> builder(Ctx);
 
   SmallVector<LoadInst *> loadList;
@@ -867,13 +1587,52 @@ void instrumentLoadStore(Function *F,
     // Skip trivially correct accesses to stack values in this function (i.e.,
     // most automatic variables) Skip if ptr is an alloca and types are the same
     if (auto *alloca = dyn_cast<AllocaInst>(ptr)) {
-      if (alloca->getAllocatedType() == valueType)
+      if (alloca->getAllocatedType() == valueType) {
+        stats->elided++;
         continue;
+      }
+    }
+
+    if (plan && plan->elided.contains(load)) {
+      stats->elided++;
+      continue;
+    }
+
+    if (plan && plan->redundant.contains(load)) {
+      stats->redundant++;
+      continue;
+    }
+
+    uint64_t accessSize = DL.getTypeStoreSize(valueType).getFixedValue();
+    uint64_t widenedSize = plan ? plan->widened.lookup(load) : 0;
+
+    if (plan && plan->propagateBounds) {
+      PointerBounds bounds = getPointerBounds(F, *plan, ptr, *stats);
+      insertInlineAccessCheck(load, ptr,
+                              widenedSize ? widenedSize : accessSize, bounds,
+                              strategy);
+      stats->inserted++;
+      continue;
+    }
+
+    if (widenedSize) {
+      insertWidenedAccessCheck(load, ptr, widenedSize, strategy);
+      stats->inserted++;
+      continue;
     }
 
     BoundsClass cls = classifyPointer(ptr);
     auto wrapperFn = getOrCreateLoadWrapper(F, valueType, strategy, cls);
 
+    if (Value *ok = plan ? plan->hoisted.lookup(load) : nullptr) {
+      guardHoistedAccess(load, ok, [&](IRBuilder<> &checked) {
+        return checked.CreateCall(wrapperFn, {ptr});
+      });
+      stats->hoisted++;
+      continue;
+    }
+
+    stats->inserted++;
     auto wrapperCall = builder.CreateCall(wrapperFn, {ptr});
     load->replaceAllUsesWith(wrapperCall);
     load->removeFromParent();
@@ -888,13 +1647,53 @@ void instrumentLoadStore(Function *F,
     // Skip trivially correct accesses to stack values in this function (i.e.,
     // most automatic variables) Skip if ptr is an alloca and types are the same
     if (auto *alloca = dyn_cast<AllocaInst>(ptr)) {
-      if (alloca->getAllocatedType() == valueType)
+      if (alloca->getAllocatedType() == valueType) {
+        stats->elided++;
         continue;
+      }
+    }
+
+    if (plan && plan->elided.contains(store)) {
+      stats->elided++;
+      continue;
+    }
+
+    if (plan && plan->redundant.contains(store)) {
+      stats->redundant++;
+      continue;
+    }
+
+    uint64_t accessSize = DL.getTypeStoreSize(valueType).getFixedValue();
+    uint64_t widenedSize = plan ? plan->widened.lookup(store) : 0;
+
+    if (plan && plan->propagateBounds) {
+      PointerBounds bounds = getPointerBounds(F, *plan, ptr, *stats);
+      insertInlineAccessCheck(store, ptr,
+                              widenedSize ? widenedSize : accessSize, bounds,
+                              strategy);
+      stats->inserted++;
+      continue;
+    }
+
+    if (widenedSize) {
+      insertWidenedAccessCheck(store, ptr, widenedSize, strategy);
+      stats->inserted++;
+      continue;
     }
 
     BoundsClass cls = classifyPointer(ptr);
     auto wrapperFn = getOrCreateStoreWrapper(F, valueType, strategy, cls);
 
+    if (Value *ok = plan ? plan->hoisted.lookup(store) : nullptr) {
+      Value *storedValue = store->getValueOperand();
+      guardHoistedAccess(store, ok, [&](IRBuilder<> &checked) {
+        return checked.CreateCall(wrapperFn, {ptr, storedValue});
+      });
+      stats->hoisted++;
+      continue;
+    }
+
+    stats->inserted++;
     auto wrapperCall =
         builder.CreateCall(wrapperFn, {ptr, store->getValueOperand()});
     store->replaceAllUsesWith(wrapperCall);
@@ -905,9 +1704,32 @@ void instrumentLoadStore(Function *F,
 
 void sanitizeMemInstBounds(Function *F,
                            Vulnerability::RemediationStrategies strategy) {
-  instrumentGep(F);
+  // Plan on the uninstrumented IR, before wrapper calls hide the pointers.
+  // Propagated bounds make per-access checks cheap enough that preheader
+  // range checks are not worth their extra lookups.
+  BoundsCheckPlan plan =
+      planBoundsChecks(F, strategy, !CVE_ASSERT_BOUNDS_PROPAGATION);
+  plan.propagateBounds = CVE_ASSERT_BOUNDS_PROPAGATION;
+  BoundsCheckStats stats;
+
+  instrumentGep(F, plan, stats);
   instrumentMemcpy(F, strategy);
   instrumentMemmove(F, strategy);
   instrumentMemset(F, strategy);
-  instrumentLoadStore(F, strategy);
+  instrumentLoadStore(F, strategy, &plan, &stats);
+  reportInsertedChecks(F, "bounds", stats.inserted + stats.hoisted);
+  reportRemovedChecks(F, "bounds", stats.redundant);
+
+  stats.merged = plan.merged;
+  if (CVE_ASSERT_DEBUG) {
+    errs() << "[CVEAssert] Bounds checks in " << F->getName() << ": "
+           << stats.inserted << " inserted, " << stats.elided << " elided, "
+           << stats.hoisted << " hoisted to loop preheaders, "
+           << stats.redundant << " redundant (" << stats.merged
+           << " merged into wider checks)";
+    if (plan.propagateBounds) {
+      errs() << ", " << stats.lookups << " bounds lookups";
+    }
+    errs() << "\n";
+  }
 }
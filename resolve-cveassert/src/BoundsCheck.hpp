@@ -6,9 +6,55 @@
 #pragma once
 
 #include "Vulnerability.hpp"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/Function.h"
+
+/// Base address and last valid byte of the object a pointer may access, as
+/// integers. A zero limit marks an object the runtime does not track.
+struct PointerBounds {
+  llvm::Value *base;
+  llvm::Value *limit;
+};
+
+/// Bounds checks that sanitizeMemInstBounds can drop in a function
+struct BoundsCheckPlan {
+  /// GEPs and accesses proven in bounds
+  llvm::SmallPtrSet<llvm::Instruction *, 32> elided;
+  /// GEPs and accesses covered by a dominating check
+  llvm::SmallPtrSet<llvm::Instruction *, 32> redundant;
+  /// Accesses whose check also covers the neighbouring fields accessed after
+  /// them, mapped to the number of bytes checked
+  llvm::DenseMap<llvm::Instruction *, uint64_t> widened;
+  /// Number of redundant checks merged into a widened check
+  unsigned merged = 0;
+  /// Accesses covered by a range check in their loop preheader, mapped to
+  /// the result of that check
+  llvm::DenseMap<llvm::Instruction *, llvm::Value *> hoisted;
+  /// Check GEPs and accesses inline against bounds carried alongside each
+  /// pointer instead of looking them up in the runtime every time
+  bool propagateBounds = false;
+  /// Bounds of each pointer seen so far when propagateBounds is set
+  llvm::DenseMap<llvm::Value *, PointerBounds> bounds;
+};
+
+/// Number of bounds checks per function
+struct BoundsCheckStats {
+  unsigned inserted = 0;
+  unsigned elided = 0;
+  unsigned hoisted = 0;
+  /// Checks dropped because a dominating check covers them
+  unsigned redundant = 0;
+  /// Redundant checks of field accesses merged into a wider check
+  unsigned merged = 0;
+  /// Runtime bounds lookups emitted for propagated bounds
+  unsigned lookups = 0;
+};
+
 void instrumentLoadStore(llvm::Function *F,
-                         Vulnerability::RemediationStrategies strategy);
+                         Vulnerability::RemediationStrategies strategy,
+                         BoundsCheckPlan *plan = nullptr,
+                         BoundsCheckStats *stats = nullptr);
 void instrumentMemcpy(llvm::Function *F,
                       Vulnerability::RemediationStrategies strategy);
 void instrumentMemmove(llvm::Function *F,
@@ -4,8 +4,10 @@
  */
 
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
 #include "llvm/Analysis/MemorySSA.h"
-#include "llvm/Demangle/Demangle.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalAlias.h"
 #include "llvm/IR/IRBuilder.h"
@@ -15,10 +17,11 @@
 #include "llvm/IR/Verifier.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
@@ -35,13 +38,19 @@
 #include "InstrumentAllocators.hpp"
 #include "NullPointerSanitizer.hpp"
 #include "OperationMasking.hpp"
+#include "RemediationReport.hpp"
 #include "Vulnerability.hpp"
+#include "VulnerabilityMatcher.hpp"
 
 using namespace llvm;
 
 // Global env var
 bool CVE_ASSERT_DEBUG;
-DenseMap<Function *, GlobalVariable *> SanitizerMaps;
+bool CVE_ASSERT_BOUNDS_PROPAGATION;
+bool CVE_ASSERT_GATE_MULTIVERSION;
+bool CVE_ASSERT_LOWFAT_HEAP;
+bool CVE_ASSERT_STACK_FRAMES;
+thread_local DenseMap<Function *, GlobalVariable *> SanitizerMaps;
 
 GlobalVariable *getSanitizerMap(Function *F) {
   auto it = SanitizerMaps.find(F);
@@ -81,6 +90,13 @@ struct InstrumentMemInst {
   bool instrumentAlloca = false;
 };
 
+/// Gated function whose unchecked body is selected once on entry
+struct GatedVersions {
+  GlobalVariable *sanitizerMap;
+  SanitizerFlag flag;
+  Function *unchecked = nullptr;
+};
+
 struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
   std::vector<Vulnerability> vulnerabilities;
 
@@ -110,6 +126,14 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
   LabelCVEPass() {
     // Initialize env var
     CVE_ASSERT_DEBUG = strlen(std::getenv("CVE_ASSERT_DEBUG") ?: "") > 0;
+    CVE_ASSERT_BOUNDS_PROPAGATION =
+        strlen(std::getenv("RESOLVE_BOUNDS_PROPAGATION") ?: "") > 0;
+    CVE_ASSERT_GATE_MULTIVERSION =
+        strlen(std::getenv("RESOLVE_GATE_MULTIVERSION") ?: "") > 0;
+    CVE_ASSERT_LOWFAT_HEAP =
+        strlen(std::getenv("RESOLVE_LOWFAT_HEAP") ?: "") > 0;
+    CVE_ASSERT_STACK_FRAMES =
+        strlen(std::getenv("RESOLVE_STACK_FRAMES") ?: "") > 0;
 
     vulnerabilities = Vulnerability::parseVulnerabilityFile();
   }
@@ -125,78 +149,60 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
     sanitizeBitShift(&F, strategy);
   }
 
-  /// Return true if F's name (raw or demangled) matches or contains targetName.
-  /// Caret/dollar anchors request exact matching
-  /// Always returns true if targetName is empty
-  bool nameMatches(Function &F, const std::string &demangledName,
-                   const std::string &targetName) {
-    // Empty function name matches all functions
-    if (targetName.empty()) {
-      return true;
-    }
-
-    if (targetName.size() >= 2 && targetName.front() == '^' &&
-        targetName.back() == '$') {
-      std::string exactName = targetName.substr(1, targetName.size() - 2);
-      return demangledName == exactName || F.getName() == exactName;
-    }
-
-    // First check demangled name
-    if (demangledName.find(targetName) != std::string::npos) {
-      return true;
-    }
-
-    // Next fallback to raw symbols
-    if (F.getName().str().find(targetName) != std::string::npos) {
-      return true;
-    }
-
-    return false;
-  }
-
-  /// Return true if `F` meets instrumentation critera for vuln
-  bool shouldInstrument(Function &F, Vulnerability &vuln) {
-    // Skip noinstrument functions
-    if (F.getMetadata("cve.noinstrument")) {
-      return false;
-    }
-
-    char *demangledNamePtr = llvm::itaniumDemangle(F.getName().str(), false);
-    std::string demangledName(demangledNamePtr ?: "");
-
-    if (CVE_ASSERT_DEBUG) {
-      errs() << "[CVEAssert] Trying fn " << F.getName()
-             << " Demangled name: " << demangledName << "\n";
+  /// Return the sanitizer flag that gates the checks inserted for vuln, if
+  /// they are gated by a single flag
+  std::optional<SanitizerFlag> getGateFlag(Vulnerability &vuln) {
+    switch (vuln.WeaknessID) {
+    case VulnID::STACK_BASED_BUF_OVERFLOW:
+    case VulnID::HEAP_BASED_BUF_OVERFLOW:
+    case VulnID::OOB_WRITE:
+    case VulnID::OOB:
+    case VulnID::WRITE_WHAT_WHERE:
+    case VulnID::OOB_READ:
+    case VulnID::INCORRECT_BUF_SIZE:
+      return SanitizerFlag::BoundsCheck;
+    case VulnID::DIVIDE_BY_ZERO:
+      return SanitizerFlag::DivideByZero;
+    case VulnID::INT_OVERFLOW:
+      return SanitizerFlag::IntegerOverflow;
+    case VulnID::NULL_PTR_DEREF:
+      return SanitizerFlag::NullPtr;
+    case VulnID::STACK_FREE:
+      return SanitizerFlag::FreeNonHeap;
+    case VulnID::INCORRECT_BITWISE_SHIFT:
+      return SanitizerFlag::BitShift;
+    default:
+      return std::nullopt;
     }
-
-    return nameMatches(F, demangledName, vuln.TargetFunctionName);
   }
 
-  /// For each function, if it matches the target function name, insert calls to
-  /// the vulnerability handlers as specified in the JSON. Each call receives
+  /// Insert calls to the vulnerability handlers in `F`, which matches the
+  /// target function of `vuln`, as specified in the JSON. Each call receives
   /// the triggering argument parsed from the JSON.
   PreservedAnalyses runOnFunction(Function &F, ModuleAnalysisManager &MAM,
                                   Vulnerability &vuln) {
     auto result = PreservedAnalyses::all();
 
-    if (!shouldInstrument(F, vuln)) {
-      return result;
-    }
-
     raw_ostream &out = errs();
+    auto start = std::chrono::steady_clock::now();
+    size_t numFunctions = F.getParent()->size();
 
-    out << "[CVEAssert] === Pre Instrumented IR === \n";
-    out << F;
-    out << "[CVEAssert] === Inserted Sanitizer Helpers === \n";
+    if (CVE_ASSERT_DEBUG) {
+      out << "[CVEAssert] === Pre Instrumented IR === \n";
+      out << F;
+      out << "[CVEAssert] === Inserted Sanitizer Helpers === \n";
+    }
 
     if (vuln.UndesirableFunction.has_value()) {
       /* NOTE: We are using '0' as a temporary this will be updated future PRs
        */
       sanitizeUndesirableOperationInFunction(&F, *vuln.UndesirableFunction, 0);
       result = PreservedAnalyses::none();
-      out << "[CVEAssert] === Post Sanitization of Undesirable Operation IR "
-             "=== \n";
-      out << F;
+      if (CVE_ASSERT_DEBUG) {
+        out << "[CVEAssert] === Post Sanitization of Undesirable Operation "
+               "IR === \n";
+        out << F;
+      }
     }
 
     if (vuln.Strategy == Vulnerability::RemediationStrategies::NONE) {
@@ -263,11 +269,15 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
       break;
     }
 
-    out << "[CVEAssert] === Post Instrumented IR === \n";
+    if (CVE_ASSERT_DEBUG) {
+      out << "[CVEAssert] === Post Instrumented IR === \n";
+    }
     validateIR(&F);
 
-    out << "[CVEAssert] Inserted vulnerability handler calls in function "
-        << vuln.TargetFileName << ":" << vuln.TargetFunctionName << "\n";
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    reportInstrumentedFunction(&F, F.getParent()->size() - numFunctions,
+                               elapsed.count());
     return result;
   }
 
@@ -282,7 +292,7 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
     auto voidType = Type::getVoidTy(Ctx);
 
     FunctionCallee registerGlobalsFn = M.getOrInsertFunction(
-        "__resolve_register_global",
+        "__resolve_register_globals",
         FunctionType::get(voidType, {ptrType, intType}, false));
 
     SmallVector<GlobalVariable *, 16> globalsToRegister;
@@ -306,6 +316,22 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
     if (globalsToRegister.empty())
       return;
 
+    // One { address, size } descriptor per global, registered with a single
+    // call so the runtime can sort every module's globals once
+    StructType *descType = StructType::get(Ctx, {ptrType, intType});
+    SmallVector<Constant *, 16> descriptors;
+    for (GlobalVariable *global : globalsToRegister) {
+      uint64_t size = DL.getTypeAllocSize(global->getValueType());
+      descriptors.push_back(ConstantStruct::get(
+          descType, {global, ConstantInt::get(intType, size)}));
+    }
+
+    ArrayType *tableType = ArrayType::get(descType, descriptors.size());
+    auto *table = new GlobalVariable(
+        M, tableType, true, GlobalValue::PrivateLinkage,
+        ConstantArray::get(tableType, descriptors), "__resolve_global_table");
+    table->setSection("resolve_globals");
+
     Function *ctor = Function::Create(FunctionType::get(voidType, {}, false),
                                       GlobalValue::InternalLinkage,
                                       "__resolve_register_globals_ctor", &M);
@@ -314,12 +340,8 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
 
     BasicBlock *entryBB = BasicBlock::Create(Ctx, "entry", ctor);
     IRBuilder<> builder(entryBB);
-
-    for (GlobalVariable *global : globalsToRegister) {
-      uint64_t size = DL.getTypeAllocSize(global->getValueType());
-      builder.CreateCall(registerGlobalsFn,
-                         {global, ConstantInt::get(intType, size)});
-    }
+    builder.CreateCall(registerGlobalsFn,
+                       {table, ConstantInt::get(intType, descriptors.size())});
     builder.CreateRetVoid();
 
     appendToGlobalCtors(M, ctor, 0);
@@ -328,21 +350,51 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
   PreservedAnalyses
   runInstrumentationPipeline(Module &M, ModuleAnalysisManager &MAM,
                              std::vector<Vulnerability> &vulns,
-                             bool writePatch) {
+                             DemangleCache &demangled,
+                             std::string *patchIR = nullptr) {
     auto result = PreservedAnalyses::all();
     InstrumentMemInst instrument_mem_inst;
+    VulnerabilityMatcher matcher(vulns, M.getSourceFileName(), demangled);
+    MapVector<Function *, SmallVector<unsigned, 4>> matches;
 
     SanitizerMaps.clear();
+    MapVector<Function *, GatedVersions> multiversioned;
 
     /// Precompute globals before instrumentation
     for (auto &F : M) {
-      for (auto &vuln : vulns) {
-        if (F.isDeclaration())
+      if (F.isDeclaration())
+        continue;
+
+      // Match every function once, before instrumentation adds helpers
+      auto &fnMatches = matches[&F] = matcher.match(F);
+
+      bool gated = false;
+      std::optional<SanitizerFlag> gateFlag;
+      bool singleFlag = true;
+      for (unsigned i : fnMatches) {
+        Vulnerability &vuln = vulns[i];
+        if (!vuln.Gated)
           continue;
 
-        if (vuln.Gated && shouldInstrument(F, vuln)) {
-          SanitizerMaps[&F] = initSanitizerMap(F);
+        std::optional<SanitizerFlag> flag = getGateFlag(vuln);
+        if (!flag || (gateFlag && *gateFlag != *flag)) {
+          singleFlag = false;
         }
+        gated = true;
+        gateFlag = flag;
+      }
+
+      if (!gated)
+        continue;
+
+      // Functions gated by a single flag can select a checked or unchecked
+      // body once on entry. Otherwise every check reads its own flag.
+      GlobalVariable *map = initSanitizerMap(F);
+      if (CVE_ASSERT_GATE_MULTIVERSION && !patchIR && singleFlag &&
+          canMultiversion(&F)) {
+        multiversioned[&F] = {map, *gateFlag};
+      } else {
+        SanitizerMaps[&F] = map;
       }
     }
 
@@ -388,25 +440,32 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
       }
     }
 
-    for (auto &F : M) {
-      if (F.isDeclaration())
-        continue;
-
-      for (auto &vuln : vulns) {
-        if (writePatch) {
-          if (!shouldInstrument(F, vuln))
-            continue;
+    // Clone after allocation instrumentation so the unchecked body still
+    // registers its objects with the runtime
+    for (auto &[F, versions] : multiversioned) {
+      versions.unchecked = cloneUncheckedVersion(F);
+    }
 
+    for (auto &[F, fnMatches] : matches) {
+      for (unsigned i : fnMatches) {
+        Vulnerability &vuln = vulns[i];
+        if (patchIR) {
           beginPatchRecording();
-          result.intersect(runOnFunction(F, MAM, vuln));
-          endPatchRecordingAndWrite(&F);
+          result.intersect(runOnFunction(*F, MAM, vuln));
+          *patchIR += endPatchRecording(F);
         } else {
-          result.intersect(runOnFunction(F, MAM, vuln));
+          result.intersect(runOnFunction(*F, MAM, vuln));
         }
       }
     }
 
-    if (!writePatch && (instrument_mem_inst.instrumentAlloca ||
+    for (auto &[F, versions] : multiversioned) {
+      createSanitizerDispatch(F, versions.unchecked, versions.sanitizerMap,
+                              versions.flag);
+      result = PreservedAnalyses::none();
+    }
+
+    if (!patchIR && (instrument_mem_inst.instrumentAlloca ||
                         instrument_mem_inst.instrumentMemAllocator)) {
       registerGlobals(M);
       result = PreservedAnalyses::none();
@@ -414,7 +473,33 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
     return result;
   }
 
+  /// Instruments the functions matched by a patch vulnerability in a module
+  /// of their own, parsed from `bitcode` into a fresh LLVMContext, and
+  /// returns their patch IR
+  std::string instrumentPatch(StringRef bitcode, Vulnerability vuln) {
+    LLVMContext Ctx;
+    Expected<std::unique_ptr<Module>> patchModule =
+        parseBitcodeFile(MemoryBufferRef(bitcode, "resolve-patch"), Ctx);
+    if (!patchModule) {
+      errs() << "[CVEAssert] Error: Could not extract patch for "
+             << vuln.TargetFunctionName << ": "
+             << toString(patchModule.takeError()) << "\n";
+      return "";
+    }
+
+    std::string patchIR;
+    ModuleAnalysisManager patchMAM;
+    DemangleCache patchDemangled;
+    std::vector<Vulnerability> singleVuln = {vuln};
+    runInstrumentationPipeline(**patchModule, patchMAM, singleVuln,
+                               patchDemangled, &patchIR);
+    return patchIR;
+  }
+
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM) {
+    auto start = std::chrono::steady_clock::now();
+    resetRemediationReport();
+
     std::vector<Vulnerability> patchVulns;
     std::vector<Vulnerability> moduleVulns;
 
@@ -426,19 +511,63 @@ struct LabelCVEPass : public PassInfoMixin<LabelCVEPass> {
       }
     }
 
+    // Each patch vulnerability only needs the functions it matches. Extract
+    // those into a minimal module, serialized so that it can be instrumented
+    // in an LLVMContext of its own while the rest of the module is.
+    DemangleCache demangled;
+    std::vector<SmallVector<Function *, 4>> patchTargets(patchVulns.size());
     if (!patchVulns.empty()) {
-      std::error_code EC;
-      raw_fd_ostream patchFile("resolve-patch.ll", EC);
-      patchFile.close();
+      VulnerabilityMatcher matcher(patchVulns, M.getSourceFileName(),
+                                   demangled);
+      for (auto &F : M) {
+        if (F.isDeclaration())
+          continue;
+        for (unsigned i : matcher.match(F)) {
+          patchTargets[i].push_back(&F);
+        }
+      }
     }
 
-    for (auto &vuln : patchVulns) {
-      auto patchModule = CloneModule(M);
-      std::vector<Vulnerability> singleVuln = {vuln};
-      runInstrumentationPipeline(*patchModule, MAM, singleVuln, true);
+    std::vector<SmallVector<char, 0>> patchBitcode(patchVulns.size());
+    for (size_t i = 0; i < patchVulns.size(); i++) {
+      if (!patchTargets[i].empty()) {
+        raw_svector_ostream bitcodeOS(patchBitcode[i]);
+        WriteBitcodeToFile(*extractPatchModule(M, patchTargets[i]), bitcodeOS);
+      }
+    }
+
+    std::vector<std::string> patches(patchVulns.size());
+    ThreadPool patchPool;
+    for (size_t i = 0; i < patchVulns.size(); i++) {
+      if (patchBitcode[i].empty()) {
+        continue;
+      }
+      patchPool.async([this, i, &patchBitcode, &patchVulns, &patches] {
+        StringRef bitcode(patchBitcode[i].data(), patchBitcode[i].size());
+        patches[i] = instrumentPatch(bitcode, patchVulns[i]);
+      });
     }
 
-    return runInstrumentationPipeline(M, MAM, moduleVulns, false);
+    auto result = runInstrumentationPipeline(M, MAM, moduleVulns, demangled);
+    patchPool.wait();
+
+    if (!patchVulns.empty()) {
+      std::error_code EC;
+      raw_fd_ostream patchFile("resolve-patch.ll", EC);
+      if (EC) {
+        errs() << "[CVEAssert] Error: COULD NOT OPEN PATCH FILE.\n";
+      } else {
+        for (const std::string &patch : patches) {
+          patchFile << patch;
+        }
+        errs() << "[CVEAssert] Wrote to patch file (resolve-patch.ll).\n";
+      }
+    }
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    writeRemediationReport(M, elapsed.count());
+    return result;
   }
 };
 
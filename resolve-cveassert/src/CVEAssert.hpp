@@ -24,6 +24,23 @@ constexpr auto NumSanitizerFlags = static_cast<unsigned>(SanitizerFlag::Count);
 // Set value to true to get more verbose printouts
 extern bool CVE_ASSERT_DEBUG;
 
-extern llvm::DenseMap<llvm::Function *, llvm::GlobalVariable *> SanitizerMaps;
+// Set value to true to carry bounds alongside pointers instead of looking
+// them up at every access (RESOLVE_BOUNDS_PROPAGATION)
+extern bool CVE_ASSERT_BOUNDS_PROPAGATION;
+
+// Set value to true to dispatch gated functions once on entry to checked and
+// unchecked bodies instead of gating every check (RESOLVE_GATE_MULTIVERSION)
+extern bool CVE_ASSERT_GATE_MULTIVERSION;
+
+// Set value to true to check pointers into the low-fat heap of libresolve
+// inline, from the pointer value alone (RESOLVE_LOWFAT_HEAP)
+extern bool CVE_ASSERT_LOWFAT_HEAP;
+
+// Set value to true to merge static stack arrays into one frame registered
+// with a single runtime call (RESOLVE_STACK_FRAMES)
+extern bool CVE_ASSERT_STACK_FRAMES;
+
+extern thread_local llvm::DenseMap<llvm::Function *, llvm::GlobalVariable *>
+    SanitizerMaps;
 llvm::GlobalVariable *getSanitizerMap(llvm::Function *F);
 llvm::GlobalVariable *initSanitizerMap(llvm::Function &F);
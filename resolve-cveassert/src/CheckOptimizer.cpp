@@ -0,0 +1,371 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "CheckOptimizer.hpp"
+
+using namespace llvm;
+
+namespace {
+
+/// Bytes [begin, end) at a constant offset from a base pointer
+struct ByteRange {
+  int64_t begin;
+  int64_t end;
+};
+
+/// Facts holding at a program point, as checked ranges per base pointer
+using FactMap = DenseMap<const Value *, SmallVector<ByteRange, 2>>;
+
+/// Blocks searched between a block and its immediate dominator before
+/// assuming memory may be freed on the way
+constexpr unsigned MaxPathBlocks = 256;
+
+class CheckOptimizer {
+  Function &F;
+  const DominatorTree &DT;
+  const DataLayout &DL;
+  ArrayRef<CheckedAccess> accesses;
+  CheckFact fact;
+
+  /// Position of each checked instruction in `accesses`
+  DenseMap<const Instruction *, unsigned> index;
+  /// The only store to each stack slot, or null if it has several or escapes
+  DenseMap<const AllocaInst *, const StoreInst *> slotStores;
+  /// Blocks containing an instruction that may free memory
+  SmallPtrSet<const BasicBlock *, 16> freeingBlocks;
+  /// Checks covered by the widened check of an earlier field access
+  SmallPtrSet<const Instruction *, 16> members;
+
+  CheckOptimization result;
+
+public:
+  CheckOptimizer(Function &F, const DominatorTree &DT,
+                 ArrayRef<CheckedAccess> accesses, CheckFact fact)
+      : F(F), DT(DT), DL(F.getParent()->getDataLayout()), accesses(accesses),
+        fact(fact) {}
+
+  CheckOptimization run();
+
+private:
+  const StoreInst *getSingleStore(const AllocaInst *slot);
+  const Value *getReloadedValue(const LoadInst *load);
+  const Value *splitPointer(const Value *ptr, int64_t &offset);
+  bool getRange(const CheckedAccess &access, const Value *&base,
+                ByteRange &range);
+
+  bool isCovered(const FactMap &facts, const Value *base,
+                 ByteRange range) const;
+  void addFact(FactMap &facts, const Value *base, ByteRange range) const;
+  bool mayFreeBetween(const BasicBlock *dom, const BasicBlock *BB) const;
+
+  void widenFieldChecks();
+  void eliminateDominatedChecks();
+};
+
+} // end anonymous namespace
+
+/// Returns true if `I` may free memory, which ends all InBounds facts
+static bool mayFreeMemory(const Instruction &I) {
+  auto *call = dyn_cast<CallBase>(&I);
+  return call && !call->hasFnAttr(Attribute::NoFree) &&
+         !call->onlyReadsMemory();
+}
+
+/// Stack slots that are only loaded from and stored to once hold the same
+/// value at every load dominated by that store, like the parameters and
+/// locals of unoptimized code.
+const StoreInst *CheckOptimizer::getSingleStore(const AllocaInst *slot) {
+  auto [it, inserted] = slotStores.try_emplace(slot, nullptr);
+  if (!inserted) {
+    return it->second;
+  }
+
+  const StoreInst *single = nullptr;
+  for (const User *U : slot->users()) {
+    if (auto *load = dyn_cast<LoadInst>(U)) {
+      if (load->isVolatile()) {
+        return nullptr;
+      }
+      continue;
+    }
+
+    if (auto *store = dyn_cast<StoreInst>(U)) {
+      if (single || store->isVolatile() ||
+          store->getPointerOperand() != slot) {
+        return nullptr;
+      }
+      single = store;
+      continue;
+    }
+
+    if (auto *intrinsic = dyn_cast<IntrinsicInst>(U)) {
+      if (intrinsic->isLifetimeStartOrEnd()) {
+        continue;
+      }
+    }
+    return nullptr;
+  }
+
+  it->second = single;
+  return single;
+}
+
+/// Returns the value `load` reads if it reloads a stack slot stored once
+const Value *CheckOptimizer::getReloadedValue(const LoadInst *load) {
+  auto *slot = dyn_cast<AllocaInst>(load->getPointerOperand());
+  if (!slot || load->isVolatile()) {
+    return nullptr;
+  }
+
+  const StoreInst *store = getSingleStore(slot);
+  if (!store || store->getValueOperand()->getType() != load->getType() ||
+      !DT.dominates(store, load)) {
+    return nullptr;
+  }
+  return store->getValueOperand();
+}
+
+/// Splits `ptr` into a base pointer and a constant offset from it
+const Value *CheckOptimizer::splitPointer(const Value *ptr, int64_t &offset) {
+  offset = 0;
+
+  // Reloads may chain through a few slots, but not indefinitely
+  for (unsigned depth = 0; depth < 8; ++depth) {
+    APInt delta(DL.getIndexTypeSizeInBits(ptr->getType()), 0);
+    ptr = ptr->stripAndAccumulateConstantOffsets(DL, delta,
+                                                 /*AllowNonInbounds=*/false);
+    offset += delta.getSExtValue();
+
+    auto *load = dyn_cast<LoadInst>(ptr);
+    const Value *reloaded = load ? getReloadedValue(load) : nullptr;
+    if (!reloaded) {
+      break;
+    }
+    ptr = reloaded;
+  }
+  return ptr;
+}
+
+/// Computes the base and byte range checked by `access`. Pointer arithmetic
+/// checks span from their pointer to the derived pointer, and fail if the
+/// two do not share a base.
+bool CheckOptimizer::getRange(const CheckedAccess &access, const Value *&base,
+                              ByteRange &range) {
+  int64_t offset;
+  base = splitPointer(access.ptr, offset);
+  range = {offset, offset + static_cast<int64_t>(access.size)};
+  if (!access.derived) {
+    return true;
+  }
+
+  int64_t derivedOffset;
+  if (splitPointer(access.derived, derivedOffset) != base ||
+      derivedOffset < offset) {
+    return false;
+  }
+  range.end = derivedOffset;
+  return true;
+}
+
+bool CheckOptimizer::isCovered(const FactMap &facts, const Value *base,
+                               ByteRange range) const {
+  auto it = facts.find(base);
+  if (it == facts.end()) {
+    return false;
+  }
+
+  return any_of(it->second, [&](ByteRange checked) {
+    if (fact == CheckFact::NonNull) {
+      return range.begin >= checked.begin;
+    }
+    return range.begin >= checked.begin && range.end <= checked.end &&
+           range.begin < checked.end;
+  });
+}
+
+void CheckOptimizer::addFact(FactMap &facts, const Value *base,
+                             ByteRange range) const {
+  SmallVector<ByteRange, 2> &ranges = facts[base];
+
+  // The lowest checked offset implies all others
+  if (fact == CheckFact::NonNull) {
+    if (ranges.empty()) {
+      ranges.push_back(range);
+    } else {
+      ranges.front().begin = std::min(ranges.front().begin, range.begin);
+    }
+    return;
+  }
+
+  if (range.begin >= range.end) {
+    return;
+  }
+
+  // Ranges sharing a byte lie in the same object, so their union does too.
+  // Ranges that only touch may belong to neighbouring objects.
+  erase_if(ranges, [&](ByteRange checked) {
+    if (checked.begin >= range.end || range.begin >= checked.end) {
+      return false;
+    }
+    range.begin = std::min(range.begin, checked.begin);
+    range.end = std::max(range.end, checked.end);
+    return true;
+  });
+  ranges.push_back(range);
+}
+
+/// Returns true if memory may be freed on a path from the end of `dom` to
+/// the start of `BB`, which it immediately dominates
+bool CheckOptimizer::mayFreeBetween(const BasicBlock *dom,
+                                    const BasicBlock *BB) const {
+  if (BB->getSinglePredecessor() == dom) {
+    return false;
+  }
+
+  SmallVector<const BasicBlock *, 8> worklist(pred_begin(BB), pred_end(BB));
+  SmallPtrSet<const BasicBlock *, 16> visited;
+  while (!worklist.empty()) {
+    const BasicBlock *pred = worklist.pop_back_val();
+    if (pred == dom || !visited.insert(pred).second) {
+      continue;
+    }
+
+    if (freeingBlocks.contains(pred) || visited.size() > MaxPathBlocks) {
+      return true;
+    }
+    worklist.append(pred_begin(pred), pred_end(pred));
+  }
+  return false;
+}
+
+/// Widens the check of a field access to cover the accesses to neighbouring
+/// fields of the same base that follow it in its block, so that a single
+/// check covers the whole group. Groups end where memory may be freed or
+/// execution may not reach the next instruction, so the widened check only
+/// fails when one of the accesses it covers would.
+void CheckOptimizer::widenFieldChecks() {
+  for (BasicBlock &BB : F) {
+    // First check and covered range of the open group of each base
+    DenseMap<const Value *, std::pair<Instruction *, ByteRange>> groups;
+
+    for (Instruction &I : BB) {
+      auto it = index.find(&I);
+      if (it != index.end() && !accesses[it->second].derived) {
+        const CheckedAccess &access = accesses[it->second];
+        const Value *base;
+        ByteRange range;
+        getRange(access, base, range);
+
+        auto group = groups.find(base);
+        if (group == groups.end() ||
+            range.begin < group->second.second.begin ||
+            range.begin > group->second.second.end) {
+          groups[base] = {&I, range};
+        } else {
+          auto &[lead, covered] = group->second;
+          covered.end = std::max(covered.end, range.end);
+          uint64_t size = covered.end - covered.begin;
+          if (size > accesses[index.lookup(lead)].size) {
+            result.widened[lead] = size;
+          }
+          members.insert(&I);
+        }
+      }
+
+      if (mayFreeMemory(I) || !isGuaranteedToTransferExecutionToSuccessor(&I)) {
+        groups.clear();
+      }
+    }
+  }
+}
+
+/// Walks the dominator tree, handing the facts at the end of each block to
+/// the blocks it immediately dominates
+void CheckOptimizer::eliminateDominatedChecks() {
+  SmallVector<std::pair<const DomTreeNode *, FactMap>, 16> worklist;
+  worklist.emplace_back(DT.getRootNode(), FactMap());
+
+  while (!worklist.empty()) {
+    auto [node, facts] = worklist.pop_back_val();
+    const BasicBlock *BB = node->getBlock();
+
+    for (const Instruction &I : *BB) {
+      if (fact == CheckFact::InBounds && mayFreeMemory(I)) {
+        facts.clear();
+        continue;
+      }
+
+      auto it = index.find(&I);
+      if (it == index.end()) {
+        continue;
+      }
+
+      const CheckedAccess &access = accesses[it->second];
+      const Value *base;
+      ByteRange range;
+      if (!getRange(access, base, range)) {
+        continue;
+      }
+      if (uint64_t size = result.widened.lookup(access.inst)) {
+        range.end = range.begin + static_cast<int64_t>(size);
+      }
+
+      if (isCovered(facts, base, range)) {
+        result.redundant.insert(access.inst);
+        result.merged += members.contains(&I);
+        continue;
+      }
+
+      if (!access.derived) {
+        addFact(facts, base, range);
+      }
+    }
+
+    for (const DomTreeNode *child : node->children()) {
+      if (fact == CheckFact::InBounds &&
+          mayFreeBetween(BB, child->getBlock())) {
+        worklist.emplace_back(child, FactMap());
+      } else {
+        worklist.emplace_back(child, facts);
+      }
+    }
+  }
+}
+
+CheckOptimization CheckOptimizer::run() {
+  for (unsigned i = 0; i < accesses.size(); ++i) {
+    index[accesses[i].inst] = i;
+  }
+
+  if (fact == CheckFact::InBounds) {
+    for (BasicBlock &BB : F) {
+      if (any_of(BB, mayFreeMemory)) {
+        freeingBlocks.insert(&BB);
+      }
+    }
+    widenFieldChecks();
+  }
+
+  eliminateDominatedChecks();
+  return std::move(result);
+}
+
+CheckOptimization optimizeChecks(Function &F, const DominatorTree &DT,
+                                 ArrayRef<CheckedAccess> accesses,
+                                 CheckFact fact) {
+  return CheckOptimizer(F, DT, accesses, fact).run();
+}
@@ -0,0 +1,54 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+
+/// What a passed check establishes about the pointer it was made on
+enum class CheckFact {
+  /// The pointer is outside of the first page. Checks of the same base at an
+  /// equal or higher offset pass as well.
+  NonNull,
+  /// The accessed bytes lie within one object. Checks of the same base
+  /// within those bytes pass as well, until memory may be freed.
+  InBounds,
+};
+
+/// A check a sanitizer is about to insert
+struct CheckedAccess {
+  llvm::Instruction *inst;
+  /// Pointer the check is made on
+  llvm::Value *ptr;
+  /// Number of bytes accessed at `ptr`
+  uint64_t size;
+  /// For checks of pointer arithmetic, the pointer derived from `ptr` that
+  /// must stay within the object of `ptr`. These checks only consume facts.
+  llvm::Value *derived = nullptr;
+};
+
+/// Checks that optimizeChecks found unnecessary
+struct CheckOptimization {
+  /// Checks implied by an equal or stronger check dominating them
+  llvm::SmallPtrSet<llvm::Instruction *, 32> redundant;
+  /// Checks widened to also cover the accesses to neighbouring fields of the
+  /// same base that follow them in their block, mapped to the widened size
+  llvm::DenseMap<llvm::Instruction *, uint64_t> widened;
+  /// Redundant checks that were merged into a widened check
+  unsigned merged = 0;
+};
+
+/// Finds the checks among `accesses` made redundant by the facts established
+/// by dominating checks. Pointers are compared as a base plus a constant
+/// offset, looking through reloads of stack slots that are stored once. Only
+/// valid when a failed check stops execution.
+CheckOptimization optimizeChecks(llvm::Function &F,
+                                 const llvm::DominatorTree &DT,
+                                 llvm::ArrayRef<CheckedAccess> accesses,
+                                 CheckFact fact);
@@ -9,6 +9,7 @@
 #include "llvm/IR/InlineAsm.h"
 
 #include "IRUtils.hpp"
+#include "RemediationReport.hpp"
 #include "Vulnerability.hpp"
 
 using namespace llvm;
@@ -126,6 +127,8 @@ void sanitizeFreeOfNonHeap(Function *F,
     }
   }
 
+  reportInsertedChecks(F, "free-nonheap", workList.size());
+
   for (auto call : workList) {
     builder.SetInsertPoint(call);
     auto sanitizerFn = getOrCreateFreeOfNonHeapSanitizer(F, strategy);
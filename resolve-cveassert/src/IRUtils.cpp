@@ -3,6 +3,7 @@
  *   LGPL-3; See LICENSE.txt in the repo root for details.
  */
 
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Twine.h"
@@ -13,9 +14,9 @@
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
-#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 
 #include "CVEAssert.hpp"
 #include "IRUtils.hpp"
@@ -34,15 +35,18 @@ using namespace llvm;
 /// in the getOrCreate* functions
 void validateIR(Function *F) {
   raw_ostream &out = errs();
-  out << *F;
+  if (CVE_ASSERT_DEBUG) {
+    out << *F;
+  }
   if (verifyFunction(*F, &out)) {
     return;
   }
 }
 
-static bool patchRecording = false;
-static SmallVector<llvm::Function *> patchHelpers;
-static SmallVector<llvm::GlobalVariable *> patchGlobals;
+// Patches are instrumented in parallel, one thread per vulnerability
+static thread_local bool patchRecording = false;
+static thread_local SmallVector<llvm::Function *> patchHelpers;
+static thread_local SmallVector<llvm::GlobalVariable *> patchGlobals;
 
 static void collectReferencedGlobals(Value *V, std::set<std::string> &Names,
                                      SmallPtrSetImpl<Value *> &Visited) {
@@ -276,6 +280,149 @@ static std::string renderPatchModule(Module &SourceModule, Function *Target) {
   return FilteredIR;
 }
 
+/// Collects the global values `V` refers to, looking through constant
+/// expressions and metadata arguments
+static void collectReferencedGlobalValues(Value *V,
+                                          SetVector<GlobalValue *> &Referenced,
+                                          SmallPtrSetImpl<Value *> &Visited) {
+  if (!V || !Visited.insert(V).second) {
+    return;
+  }
+
+  if (auto *GV = dyn_cast<GlobalValue>(V)) {
+    Referenced.insert(GV);
+    return;
+  }
+
+  if (auto *MAV = dyn_cast<MetadataAsValue>(V)) {
+    if (auto *VAM = dyn_cast<ValueAsMetadata>(MAV->getMetadata())) {
+      collectReferencedGlobalValues(VAM->getValue(), Referenced, Visited);
+    }
+    return;
+  }
+
+  if (auto *C = dyn_cast<Constant>(V)) {
+    for (Value *Op : C->operands()) {
+      collectReferencedGlobalValues(Op, Referenced, Visited);
+    }
+  }
+}
+
+static void copyComdat(GlobalObject *To, const GlobalObject *From) {
+  if (const Comdat *C = From->getComdat()) {
+    Comdat *PatchComdat = To->getParent()->getOrInsertComdat(C->getName());
+    PatchComdat->setSelectionKind(C->getSelectionKind());
+    To->setComdat(PatchComdat);
+  }
+}
+
+std::unique_ptr<Module> extractPatchModule(Module &M,
+                                           ArrayRef<Function *> Targets) {
+  // The targets, the global values they reference, and everything referenced
+  // from the initializers of those globals
+  SetVector<GlobalValue *> Referenced;
+  SmallPtrSet<Value *, 32> Visited;
+  for (Function *F : Targets) {
+    Referenced.insert(F);
+    if (F->hasPersonalityFn()) {
+      collectReferencedGlobalValues(F->getPersonalityFn(), Referenced,
+                                    Visited);
+    }
+    if (F->hasPrefixData()) {
+      collectReferencedGlobalValues(F->getPrefixData(), Referenced, Visited);
+    }
+    if (F->hasPrologueData()) {
+      collectReferencedGlobalValues(F->getPrologueData(), Referenced, Visited);
+    }
+    for (Instruction &I : instructions(F)) {
+      for (Value *Op : I.operands()) {
+        collectReferencedGlobalValues(Op, Referenced, Visited);
+      }
+    }
+  }
+  for (size_t i = 0; i < Referenced.size(); i++) {
+    auto *G = dyn_cast<GlobalVariable>(Referenced[i]);
+    if (G && G->hasInitializer()) {
+      collectReferencedGlobalValues(G->getInitializer(), Referenced, Visited);
+    }
+  }
+
+  auto Patch =
+      std::make_unique<Module>(M.getModuleIdentifier(), M.getContext());
+  Patch->setSourceFileName(M.getSourceFileName());
+  Patch->setDataLayout(M.getDataLayout());
+  Patch->setTargetTriple(M.getTargetTriple());
+  if (NamedMDNode *Flags = M.getModuleFlagsMetadata()) {
+    NamedMDNode *PatchFlags = Patch->getOrInsertModuleFlagsMetadata();
+    for (MDNode *Flag : Flags->operands()) {
+      PatchFlags->addOperand(Flag);
+    }
+  }
+
+  // Global variables keep their definitions, functions other than the
+  // targets and aliases become declarations
+  SmallPtrSet<Function *, 8> TargetSet(Targets.begin(), Targets.end());
+  ValueToValueMapTy VMap;
+  for (GlobalValue *GV : Referenced) {
+    auto *F = dyn_cast<Function>(GV);
+    auto *G = dyn_cast<GlobalVariable>(GV);
+    GlobalValue *PatchGV;
+
+    if (auto *FnType = dyn_cast<FunctionType>(GV->getValueType())) {
+      bool IsTarget = F && TargetSet.contains(F);
+      auto *PatchF = Function::Create(
+          FnType, IsTarget ? F->getLinkage() : GlobalValue::ExternalLinkage,
+          GV->getAddressSpace(), GV->getName(), Patch.get());
+      if (F) {
+        PatchF->copyAttributesFrom(F);
+        // These still refer to values of M. Declarations cannot have them,
+        // and CloneFunctionInto maps them for the targets
+        PatchF->setPersonalityFn(nullptr);
+        PatchF->setPrefixData(nullptr);
+        PatchF->setPrologueData(nullptr);
+      }
+      PatchGV = PatchF;
+    } else {
+      auto *PatchG = new GlobalVariable(
+          *Patch, GV->getValueType(), G && G->isConstant(),
+          G && G->hasInitializer() ? G->getLinkage()
+                                   : GlobalValue::ExternalLinkage,
+          nullptr, GV->getName(), nullptr, GV->getThreadLocalMode(),
+          GV->getAddressSpace());
+      if (G) {
+        PatchG->copyAttributesFrom(G);
+      }
+      PatchGV = PatchG;
+    }
+    VMap[GV] = PatchGV;
+  }
+
+  for (GlobalValue *GV : Referenced) {
+    auto *G = dyn_cast<GlobalVariable>(GV);
+    if (G && G->hasInitializer()) {
+      auto *PatchG = cast<GlobalVariable>(VMap[G]);
+      PatchG->setInitializer(MapValue(G->getInitializer(), VMap));
+      copyComdat(PatchG, G);
+    }
+  }
+
+  for (Function *F : Targets) {
+    auto *PatchF = cast<Function>(VMap[F]);
+    auto PatchArg = PatchF->arg_begin();
+    for (Argument &Arg : F->args()) {
+      PatchArg->setName(Arg.getName());
+      VMap[&Arg] = &*PatchArg++;
+    }
+
+    SmallVector<ReturnInst *, 8> Returns;
+    CloneFunctionInto(PatchF, F, VMap,
+                      CloneFunctionChangeType::DifferentModule, Returns);
+    copyComdat(PatchF, F);
+  }
+
+  return Patch;
+}
+
 void beginPatchRecording(void) {
   patchRecording = true;
   patchHelpers.clear();
@@ -300,44 +447,126 @@ void recordPatchGlobal(GlobalVariable *G) {
   }
 }
 
-void endPatchRecordingAndWrite(Function *F) {
+std::string endPatchRecording(Function *F) {
   patchRecording = false;
+  return renderPatchModule(*F->getParent(), F);
+}
 
-  raw_ostream &out = errs();
-  std::error_code EC;
-  llvm::raw_fd_ostream patchFile("resolve-patch.ll", EC,
-                                 llvm::sys::fs::OF_Append);
-  if (!EC) {
-    patchFile << renderPatchModule(*F->getParent(), F);
-    patchFile.close();
-    out << "[CVEAssert] Wrote to patch file (resolve-patch.ll).\n";
-  } else {
-    out << "[CVEAssert] Error: COULD NOT OPEN PATCH FILE.\n";
-  }
+Value *createSanitizerEnabledCheck(IRBuilder<> &Builder, Function *F,
+                                   SanitizerFlag flag) {
+  GlobalVariable *Map = getSanitizerMap(F);
+  if (!Map) {
+    return Builder.getTrue();
+  }
+
+  recordPatchGlobal(Map);
+  LLVMContext &Ctx = F->getContext();
+  auto i1Ty = Type::getInt1Ty(Ctx);
+  auto usizeTy = Type::getInt64Ty(Ctx);
+  Value *Zero = Builder.getInt64(0);
+  Value *MapPtr = Builder.CreateGEP(Map->getValueType(), Map, {Zero, Zero});
+  Value *MapEntry = Builder.CreateCall(
+      getOrCreateSanitizerMapEntry(F->getParent()),
+      {MapPtr, ConstantInt::get(usizeTy, static_cast<uint64_t>(flag))});
+  return Builder.CreateICmpNE(MapEntry, ConstantInt::get(i1Ty, 0));
 }
 
 void createSanitizerGateBranch(IRBuilder<> &Builder, Function *F,
                                SanitizerFlag flag, BasicBlock *DisabledBB,
                                BasicBlock *EnabledBB) {
-  if (GlobalVariable *Map = getSanitizerMap(F)) {
-    recordPatchGlobal(Map);
-    LLVMContext &Ctx = F->getContext();
-    auto i1Ty = Type::getInt1Ty(Ctx);
-    auto usizeTy = Type::getInt64Ty(Ctx);
-    Value *Zero = Builder.getInt64(0);
-    Value *MapPtr = Builder.CreateGEP(Map->getValueType(), Map, {Zero, Zero});
-    Value *MapEntry = Builder.CreateCall(
-        getOrCreateSanitizerMapEntry(F->getParent()),
-        {MapPtr, ConstantInt::get(usizeTy, static_cast<uint64_t>(flag))});
-    Value *IsDisabled =
-        Builder.CreateICmpEQ(MapEntry, ConstantInt::get(i1Ty, 0));
-    Builder.CreateCondBr(IsDisabled, DisabledBB, EnabledBB);
+  if (getSanitizerMap(F)) {
+    Value *IsEnabled = createSanitizerEnabledCheck(Builder, F, flag);
+    Builder.CreateCondBr(IsEnabled, EnabledBB, DisabledBB);
     return;
   }
 
   Builder.CreateBr(EnabledBB);
 }
 
+/// Returns true if calls to `F` can be forwarded to a clone of it
+bool canMultiversion(Function *F) {
+  if (F->isDeclaration() || F->isVarArg()) {
+    return false;
+  }
+
+  for (Argument &Arg : F->args()) {
+    if (Arg.hasInAllocaAttr() || Arg.hasPreallocatedAttr() ||
+        Arg.hasSwiftErrorAttr()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Clones `F` before it is instrumented. The clone runs when the sanitizer
+/// gating `F` is disabled, so it is never instrumented itself.
+Function *cloneUncheckedVersion(Function *F) {
+  ValueToValueMapTy VMap;
+  Function *Unchecked = CloneFunction(F, VMap);
+  Unchecked->setName(F->getName() + ".unchecked");
+  Unchecked->setLinkage(GlobalValue::InternalLinkage);
+  Unchecked->setVisibility(GlobalValue::DefaultVisibility);
+  Unchecked->setDLLStorageClass(GlobalValue::DefaultStorageClass);
+  Unchecked->setComdat(nullptr);
+  Unchecked->setMetadata("cve.noinstrument",
+                         MDNode::get(F->getContext(), {}));
+  return Unchecked;
+}
+
+/// Reads the `flag` entry of `Map` once on entry to `F` and forwards the
+/// call to `Unchecked` when it is disabled. The checks left in `F` are then
+/// not gated individually.
+void createSanitizerDispatch(Function *F, Function *Unchecked,
+                             GlobalVariable *Map, SanitizerFlag flag) {
+  LLVMContext &Ctx = F->getContext();
+  auto usizeTy = Type::getInt64Ty(Ctx);
+  BasicBlock *CheckedBB = &F->getEntryBlock();
+
+  // Static allocas must stay in the entry block
+  SmallVector<AllocaInst *, 16> StaticAllocas;
+  for (Instruction &I : *CheckedBB) {
+    if (auto *AI = dyn_cast<AllocaInst>(&I)) {
+      if (AI->isStaticAlloca()) {
+        StaticAllocas.push_back(AI);
+      }
+    }
+  }
+
+  BasicBlock *DispatchBB =
+      BasicBlock::Create(Ctx, "sanitizer.dispatch", F, CheckedBB);
+  BasicBlock *UncheckedBB =
+      BasicBlock::Create(Ctx, "sanitizer.disabled", F, CheckedBB);
+
+  IRBuilder<> Builder(DispatchBB);
+  Value *Zero = Builder.getInt64(0);
+  Value *MapPtr = Builder.CreateGEP(Map->getValueType(), Map, {Zero, Zero});
+  Value *MapEntry = Builder.CreateCall(
+      getOrCreateSanitizerMapEntry(F->getParent()),
+      {MapPtr, ConstantInt::get(usizeTy, static_cast<uint64_t>(flag))});
+  Builder.CreateCondBr(MapEntry, CheckedBB, UncheckedBB);
+
+  for (AllocaInst *AI : StaticAllocas) {
+    AI->moveBefore(DispatchBB->getFirstNonPHI());
+  }
+
+  Builder.SetInsertPoint(UncheckedBB);
+  SmallVector<Value *, 8> Args;
+  for (Argument &Arg : F->args()) {
+    Args.push_back(&Arg);
+  }
+  CallInst *Call = Builder.CreateCall(Unchecked, Args);
+  Call->setCallingConv(Unchecked->getCallingConv());
+  Call->setAttributes(Unchecked->getAttributes());
+
+  if (F->getReturnType()->isVoidTy()) {
+    Builder.CreateRetVoid();
+  } else {
+    Builder.CreateRet(Call);
+  }
+
+  validateIR(F);
+}
+
 Function *getOrCreateSanitizerMapEntry(Module *M) {
   LLVMContext &Ctx = M->getContext();
   auto boolType = Type::getInt1Ty(Ctx);
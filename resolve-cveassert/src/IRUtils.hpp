@@ -14,6 +14,7 @@
 #include "llvm/IR/Type.h"
 
 #include "CVEAssert.hpp"
+#include <memory>
 #include <string>
 
 std::string getLLVMType(llvm::Type *ty);
@@ -26,12 +27,26 @@ llvm::Function *getOrCreateResolveHelper(
     llvm::GlobalValue::LinkageTypes linkType = llvm::Function::InternalLinkage);
 void validateIR(llvm::Function *F);
 
+/// Copies `Targets` into a new module of the same context, along with the
+/// global variables they reference. Other functions are only declared.
+std::unique_ptr<llvm::Module>
+extractPatchModule(llvm::Module &M, llvm::ArrayRef<llvm::Function *> Targets);
+
 void beginPatchRecording(void);
 void recordPatchFunction(llvm::Function *F);
 void recordPatchGlobal(llvm::GlobalVariable *G);
-void endPatchRecordingAndWrite(llvm::Function *F);
+/// Returns the patch IR of `F` and the helpers and globals recorded since
+/// beginPatchRecording
+std::string endPatchRecording(llvm::Function *F);
 
 llvm::Function *getOrCreateSanitizerMapEntry(llvm::Module *M);
+llvm::Value *createSanitizerEnabledCheck(llvm::IRBuilder<> &Builder,
+                                         llvm::Function *F, SanitizerFlag flag);
 void createSanitizerGateBranch(llvm::IRBuilder<> &Builder, llvm::Function *F,
                                SanitizerFlag flag, llvm::BasicBlock *DisabledBB,
                                llvm::BasicBlock *EnabledBB);
+
+bool canMultiversion(llvm::Function *F);
+llvm::Function *cloneUncheckedVersion(llvm::Function *F);
+void createSanitizerDispatch(llvm::Function *F, llvm::Function *Unchecked,
+                             llvm::GlobalVariable *Map, SanitizerFlag flag);
@@ -12,9 +12,11 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Metadata.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include "IRUtils.hpp"
+#include "InstrumentAllocators.hpp"
 
 #include <utility>
 
@@ -87,6 +89,125 @@ void instrumentLibraryAllocations(Function *F) {
       F, "munmap", FunctionType::get(integerType, {ptrType, sizeType}, false));
 }
 
+std::optional<uint64_t> getFrameSlotSize(const Value *V) {
+  auto *gep = dyn_cast<GetElementPtrInst>(V);
+  MDNode *slot = gep ? gep->getMetadata("cve.frame.slot") : nullptr;
+  if (!slot) {
+    return std::nullopt;
+  }
+  return mdconst::extract<ConstantInt>(slot->getOperand(0))->getZExtValue();
+}
+
+/// Collects the instructions before which `F` leaves its frame: returns,
+/// resumes unwinding into the caller, and musttail calls, which must stay
+/// directly before their return. longjmp skips all of these, see
+/// ShadowStack::push_frame for how the runtime copes with the frames it drops.
+static SmallVector<Instruction *, 4> getFrameExits(Function *F) {
+  SmallVector<Instruction *, 4> exits;
+  for (auto &BB : *F) {
+    Instruction *term = BB.getTerminator();
+    if (isa<ReturnInst>(term)) {
+      CallInst *tail = BB.getTerminatingMustTailCall();
+      exits.push_back(tail ? tail : term);
+    } else if (isa<ResumeInst>(term)) {
+      exits.push_back(term);
+    }
+  }
+  return exits;
+}
+
+/// Merges the static array allocas of `F` into a single frame alloca and
+/// registers them with one __resolve_push_frame call on entry. A constant
+/// descriptor lists the offset and size of each array within the frame. Each
+/// array keeps a one element pad, like the allocas padded by instrumentAlloca.
+static void createStackFrame(Function *F, ArrayRef<AllocaInst *> allocas) {
+  if (allocas.empty()) {
+    return;
+  }
+
+  Module *M = F->getParent();
+  LLVMContext &Ctx = M->getContext();
+  IRBuilder<> builder(Ctx);
+  const DataLayout &DL = M->getDataLayout();
+
+  auto ptrType = PointerType::get(Ctx, 0);
+  auto sizeType = Type::getInt64Ty(Ctx);
+  auto voidType = Type::getVoidTy(Ctx);
+  auto byteType = Type::getInt8Ty(Ctx);
+
+  StructType *slotType = StructType::get(Ctx, {sizeType, sizeType});
+  SmallVector<Constant *, 8> slots;
+  SmallVector<std::pair<uint64_t, uint64_t>, 8> layout;
+  uint64_t frameSize = 0;
+  Align frameAlign(1);
+
+  for (AllocaInst *alloca : allocas) {
+    auto *arrType = cast<ArrayType>(alloca->getAllocatedType());
+    uint64_t size = DL.getTypeAllocSize(arrType).getFixedValue();
+    uint64_t pad =
+        DL.getTypeAllocSize(arrType->getElementType()).getFixedValue();
+
+    frameSize = alignTo(frameSize, alloca->getAlign());
+    frameAlign = std::max(frameAlign, alloca->getAlign());
+    layout.push_back({frameSize, size});
+    slots.push_back(ConstantStruct::get(
+        slotType, {ConstantInt::get(sizeType, frameSize),
+                   ConstantInt::get(sizeType, size)}));
+    frameSize += size + pad;
+  }
+
+  ArrayType *descriptorType = ArrayType::get(slotType, slots.size());
+  auto *descriptor = new GlobalVariable(
+      *M, descriptorType, true, GlobalValue::PrivateLinkage,
+      ConstantArray::get(descriptorType, slots), F->getName() + ".frame");
+
+  builder.SetInsertPoint(&*F->getEntryBlock().getFirstInsertionPt());
+  AllocaInst *frame = builder.CreateAlloca(
+      ArrayType::get(byteType, frameSize), nullptr, "resolve.frame");
+  frame->setAlignment(frameAlign);
+  frame->setMetadata("cve.noinstrument", MDNode::get(Ctx, {}));
+  frame->setMetadata("cve.frame", MDNode::get(Ctx, {}));
+
+  for (auto [alloca, slot] : zip(allocas, layout)) {
+    auto *slotPtr = GetElementPtrInst::CreateInBounds(
+        byteType, frame, {ConstantInt::get(sizeType, slot.first)},
+        alloca->getName() + ".inst");
+    builder.Insert(slotPtr);
+    slotPtr->setMetadata("cve.noinstrument", MDNode::get(Ctx, {}));
+    slotPtr->setMetadata(
+        "cve.frame.slot",
+        MDNode::get(Ctx, {ConstantAsMetadata::get(
+                             ConstantInt::get(sizeType, slot.second))}));
+
+    // The frame is live for the whole call, so scoped lifetimes no longer
+    // apply to the arrays in it
+    for (User *user : make_early_inc_range(alloca->users())) {
+      auto *ii = dyn_cast<IntrinsicInst>(user);
+      if (ii && ii->isLifetimeStartOrEnd()) {
+        ii->eraseFromParent();
+      }
+    }
+    alloca->replaceAllUsesWith(slotPtr);
+  }
+
+  auto pushFrameFn = M->getOrInsertFunction(
+      "__resolve_push_frame",
+      FunctionType::get(voidType, {ptrType, ptrType, sizeType}, false));
+  auto popFrameFn = M->getOrInsertFunction(
+      "__resolve_pop_frame",
+      FunctionType::get(voidType, {ptrType, sizeType}, false));
+
+  builder.CreateCall(pushFrameFn,
+                     {frame, descriptor,
+                      ConstantInt::get(sizeType, allocas.size())});
+
+  for (Instruction *exit : getFrameExits(F)) {
+    builder.SetInsertPoint(exit);
+    builder.CreateCall(popFrameFn,
+                       {frame, ConstantInt::get(sizeType, frameSize)});
+  }
+}
+
 void instrumentAlloca(Function *F) {
   Module *M = F->getParent();
   LLVMContext &Ctx = M->getContext();
@@ -98,6 +219,7 @@ void instrumentAlloca(Function *F) {
   auto voidType = Type::getVoidTy(Ctx);
 
   SmallVector<AllocaInst *, 16> allocas;
+  SmallVector<AllocaInst *, 16> frameAllocas;
   SmallVector<AllocaInst *, 16> shadowSlots;
 
   StructType *shadowType = StructType::get(Ctx, {ptrType, sizeType});
@@ -274,27 +396,30 @@ void instrumentAlloca(Function *F) {
       continue;
     }
 
+    if (CVE_ASSERT_STACK_FRAMES && isStaticArray && alloca->isStaticAlloca()) {
+      frameAllocas.push_back(alloca);
+      continue;
+    }
+
     // TODO: Add fast filter to prune non-escaping allocas
     handle_alloca(alloca);
   }
 
-  for (auto &BB : *F) {
-    for (auto &instr : BB) {
-      if (auto *inst = dyn_cast<ReturnInst>(&instr)) {
-        builder.SetInsertPoint(inst);
-        for (auto *slot : shadowSlots) {
-          Value *ptrField = builder.CreateStructGEP(shadowType, slot, 0);
-          LoadInst *addr = builder.CreateLoad(ptrType, ptrField);
-          addr->setMetadata("cve.noinstrument", MDNode::get(Ctx, {}));
-          Value *sizeField = builder.CreateStructGEP(shadowType, slot, 1);
-          LoadInst *size = builder.CreateLoad(sizeType, sizeField);
-          size->setMetadata("cve.noinstrument", MDNode::get(Ctx, {}));
-          builder.CreateCall(invalidateFn, {addr, size});
-        }
-      }
+  for (Instruction *exit : getFrameExits(F)) {
+    builder.SetInsertPoint(exit);
+    for (auto *slot : shadowSlots) {
+      Value *ptrField = builder.CreateStructGEP(shadowType, slot, 0);
+      LoadInst *addr = builder.CreateLoad(ptrType, ptrField);
+      addr->setMetadata("cve.noinstrument", MDNode::get(Ctx, {}));
+      Value *sizeField = builder.CreateStructGEP(shadowType, slot, 1);
+      LoadInst *size = builder.CreateLoad(sizeType, sizeField);
+      size->setMetadata("cve.noinstrument", MDNode::get(Ctx, {}));
+      builder.CreateCall(invalidateFn, {addr, size});
     }
   }
 
+  createStackFrame(F, frameAllocas);
+
   for (auto *alloca : allocas) {
     if (alloca->use_empty()) {
       alloca->eraseFromParent();
@@ -6,6 +6,13 @@
 #pragma once
 
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Value.h"
+
+#include <optional>
 
 void instrumentAlloca(llvm::Function *F);
 void instrumentLibraryAllocations(llvm::Function *F);
+
+/// Returns the tracked size of `V` if it is the slot of an array alloca that
+/// instrumentAlloca merged into a stack frame (RESOLVE_STACK_FRAMES)
+std::optional<uint64_t> getFrameSlotSize(const llvm::Value *V);
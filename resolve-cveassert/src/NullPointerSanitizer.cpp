@@ -5,6 +5,7 @@
 
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Twine.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
@@ -12,7 +13,9 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include "CVEAssert.hpp"
+#include "CheckOptimizer.hpp"
 #include "IRUtils.hpp"
+#include "RemediationReport.hpp"
 #include "Vulnerability.hpp"
 
 using namespace llvm;
@@ -185,7 +188,46 @@ void sanitizeNullPointers(Function *F,
     }
   }
 
+  // Checks that terminate on failure make later checks of the same pointer
+  // redundant
+  CheckOptimization optimized;
+  if (strategy == Vulnerability::RemediationStrategies::EXIT ||
+      strategy == Vulnerability::RemediationStrategies::RECOVER) {
+    const DataLayout &DL = F->getParent()->getDataLayout();
+    SmallVector<CheckedAccess> accesses;
+    for (auto &BB : *F) {
+      for (auto &inst : BB) {
+        if (auto *load = dyn_cast<LoadInst>(&inst)) {
+          accesses.push_back(
+              {load, load->getPointerOperand(),
+               DL.getTypeStoreSize(load->getType()).getFixedValue()});
+        } else if (auto *store = dyn_cast<StoreInst>(&inst)) {
+          Type *valueType = store->getValueOperand()->getType();
+          accesses.push_back(
+              {store, store->getPointerOperand(),
+               DL.getTypeStoreSize(valueType).getFixedValue()});
+        }
+      }
+    }
+
+    DominatorTree DT(*F);
+    optimized = optimizeChecks(*F, DT, accesses, CheckFact::NonNull);
+  }
+
+  unsigned redundant = optimized.redundant.size();
+  unsigned inserted = loadList.size() + storeList.size() - redundant;
+  reportInsertedChecks(F, "null-pointer", inserted);
+  reportRemovedChecks(F, "null-pointer", redundant);
+  if (CVE_ASSERT_DEBUG) {
+    errs() << "[CVEAssert] Null pointer checks in " << F->getName() << ": "
+           << inserted << " inserted, " << redundant << " redundant\n";
+  }
+
   for (auto *load : loadList) {
+    if (optimized.redundant.contains(load)) {
+      continue;
+    }
+
     builder.SetInsertPoint(load);
     auto valueType = load->getType();
 
@@ -199,6 +241,10 @@ void sanitizeNullPointers(Function *F,
   }
 
   for (auto *store : storeList) {
+    if (optimized.redundant.contains(store)) {
+      continue;
+    }
+
     builder.SetInsertPoint(store);
     auto valueType = store->getValueOperand()->getType();
     auto storeFn = getOrCreateStoreWrapper(F, valueType, strategy);
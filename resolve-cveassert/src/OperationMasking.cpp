@@ -11,6 +11,7 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include "IRUtils.hpp"
+#include "RemediationReport.hpp"
 
 #include <optional>
 #include <string>
@@ -97,6 +98,8 @@ void sanitizeUndesirableOperationInFunction(Function *F, std::string fnName,
   Function *resolveSanitizedFn =
       replaceUndesirableFunction(M, callsToReplace.front(), argNum);
 
+  reportInsertedChecks(F, "operation-masking", callsToReplace.size());
+
   // Replace calls at all callsites in the module
   for (auto call : callsToReplace) {
     builder.SetInsertPoint(call);
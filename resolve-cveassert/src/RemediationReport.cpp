@@ -0,0 +1,138 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "CVEAssert.hpp"
+#include "RemediationReport.hpp"
+
+using namespace llvm;
+
+namespace {
+
+struct FunctionReport {
+  /// Checks inserted per sanitizer
+  std::map<std::string, unsigned> checks;
+  /// Redundant or provably passing checks removed per sanitizer
+  std::map<std::string, unsigned> removed;
+  /// Helper functions created while instrumenting the function
+  unsigned wrappers = 0;
+  double seconds = 0;
+};
+
+} // end anonymous namespace
+
+/// Functions are keyed by name so the copies instrumented for patch output
+/// add to the report of the function they were copied from. Patches are
+/// instrumented on worker threads, hence the lock.
+static std::map<std::string, FunctionReport> functionReports;
+static std::mutex functionReportsLock;
+
+void reportInsertedChecks(Function *F, StringRef sanitizer, unsigned count) {
+  if (count == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(functionReportsLock);
+  functionReports[F->getName().str()].checks[sanitizer.str()] += count;
+}
+
+void reportRemovedChecks(Function *F, StringRef sanitizer, unsigned count) {
+  if (count == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(functionReportsLock);
+  functionReports[F->getName().str()].removed[sanitizer.str()] += count;
+}
+
+void reportInstrumentedFunction(Function *F, unsigned wrappers,
+                                double seconds) {
+  std::lock_guard<std::mutex> lock(functionReportsLock);
+  FunctionReport &report = functionReports[F->getName().str()];
+  report.wrappers += wrappers;
+  report.seconds += seconds;
+}
+
+void resetRemediationReport() { functionReports.clear(); }
+
+void writeRemediationReport(Module &M, double seconds) {
+  if (functionReports.empty()) {
+    return;
+  }
+
+  unsigned checks = 0;
+  unsigned removed = 0;
+  unsigned wrappers = 0;
+  for (auto &[name, report] : functionReports) {
+    for (auto &[sanitizer, count] : report.checks) {
+      checks += count;
+    }
+    for (auto &[sanitizer, count] : report.removed) {
+      removed += count;
+    }
+    wrappers += report.wrappers;
+  }
+
+  if (CVE_ASSERT_DEBUG) {
+    errs() << "[CVEAssert] Instrumented " << functionReports.size()
+           << " functions in " << M.getSourceFileName() << ": " << checks
+           << " checks, " << wrappers << " helpers, "
+           << format("%.3f", seconds * 1000) << " ms";
+    if (removed) {
+      errs() << ", " << removed << " checks removed";
+    }
+    errs() << "\n";
+  }
+
+  const char *reportPath = std::getenv("RESOLVE_REMEDIATION_REPORT");
+  if (!reportPath || !*reportPath) {
+    return;
+  }
+
+  std::error_code EC;
+  raw_fd_ostream reportFile(reportPath, EC, sys::fs::OF_Append);
+  if (EC) {
+    errs() << "[CVEAssert] Error: Unable to open remediation report: "
+           << reportPath << "\n";
+    return;
+  }
+
+  // One line per module so every compilation of a build can append to the
+  // same report
+  json::OStream J(reportFile);
+  J.object([&] {
+    J.attribute("module", M.getSourceFileName());
+    J.attribute("time-ms", seconds * 1000);
+    J.attributeArray("functions", [&] {
+      for (auto &[name, report] : functionReports) {
+        J.object([&] {
+          J.attribute("name", name);
+          J.attributeObject("checks", [&] {
+            for (auto &[sanitizer, count] : report.checks) {
+              J.attribute(sanitizer, count);
+            }
+          });
+          if (!report.removed.empty()) {
+            J.attributeObject("removed", [&] {
+              for (auto &[sanitizer, count] : report.removed) {
+                J.attribute(sanitizer, count);
+              }
+            });
+          }
+          J.attribute("wrappers", report.wrappers);
+          J.attribute("time-ms", report.seconds * 1000);
+        });
+      }
+    });
+  });
+  reportFile << "\n";
+}
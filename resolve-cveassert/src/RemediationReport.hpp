@@ -0,0 +1,34 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+/// Adds `count` checks inserted by `sanitizer` in `F` to the remediation
+/// report of the current module
+void reportInsertedChecks(llvm::Function *F, llvm::StringRef sanitizer,
+                          unsigned count);
+
+/// Adds `count` checks that `sanitizer` left out of `F`, because an earlier
+/// check already covers them or they cannot fail, to the remediation report
+/// of the current module
+void reportRemovedChecks(llvm::Function *F, llvm::StringRef sanitizer,
+                         unsigned count);
+
+/// Adds one instrumentation run over `F` to the remediation report, with the
+/// number of helper functions it created and its wall time
+void reportInstrumentedFunction(llvm::Function *F, unsigned wrappers,
+                                double seconds);
+
+/// Starts a new remediation report for the module being instrumented
+void resetRemediationReport();
+
+/// Appends the remediation report of `M` as one JSON line to the file named
+/// by RESOLVE_REMEDIATION_REPORT, if set, and summarizes it on standard error
+/// when CVE_ASSERT_DEBUG is set
+void writeRemediationReport(llvm::Module &M, double seconds);
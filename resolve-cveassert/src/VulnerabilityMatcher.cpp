@@ -0,0 +1,191 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Demangle/Demangle.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
+#include <deque>
+
+#include "CVEAssert.hpp"
+#include "VulnerabilityMatcher.hpp"
+
+using namespace llvm;
+
+StringRef DemangleCache::get(const Function &F) {
+  auto [it, inserted] = names.try_emplace(&F);
+  if (inserted) {
+    char *demangledName = itaniumDemangle(F.getName().str(), false);
+    it->second = demangledName ?: "";
+    std::free(demangledName);
+  }
+  return it->second;
+}
+
+void SubstringAutomaton::add(StringRef pattern, unsigned id) {
+  unsigned state = 0;
+  for (char c : pattern) {
+    auto it = nodes[state].next.find(c);
+    if (it != nodes[state].next.end()) {
+      state = it->second;
+      continue;
+    }
+
+    unsigned child = nodes.size();
+    nodes.emplace_back();
+    nodes[state].next[c] = child;
+    state = child;
+  }
+  nodes[state].outputs.push_back(id);
+}
+
+void SubstringAutomaton::build() {
+  // Breadth first, so the failure target of a node is always complete before
+  // the node itself
+  std::deque<unsigned> worklist;
+  for (auto &[c, child] : nodes[0].next) {
+    nodes[child].fail = 0;
+    worklist.push_back(child);
+  }
+
+  while (!worklist.empty()) {
+    unsigned state = worklist.front();
+    worklist.pop_front();
+
+    for (auto &[c, child] : nodes[state].next) {
+      unsigned fail = nodes[state].fail;
+      while (fail != 0 && !nodes[fail].next.count(c)) {
+        fail = nodes[fail].fail;
+      }
+      nodes[child].fail = nodes[fail].next.lookup(c);
+
+      const auto &inherited = nodes[nodes[child].fail].outputs;
+      nodes[child].outputs.append(inherited.begin(), inherited.end());
+      worklist.push_back(child);
+    }
+  }
+}
+
+void SubstringAutomaton::search(StringRef text,
+                                function_ref<void(unsigned)> onMatch) const {
+  unsigned state = 0;
+  for (char c : text) {
+    while (state != 0 && !nodes[state].next.count(c)) {
+      state = nodes[state].fail;
+    }
+    state = nodes[state].next.lookup(c);
+
+    for (unsigned id : nodes[state].outputs) {
+      onMatch(id);
+    }
+  }
+}
+
+/// Return true if `targetFile` names `sourceFile`. Either may be relative to
+/// a different directory, so a match at a path component boundary suffices.
+static bool fileMatches(StringRef sourceFile, StringRef targetFile) {
+  if (targetFile.empty()) {
+    return true;
+  }
+
+  SmallString<128> source(sourceFile);
+  SmallString<128> target(targetFile);
+  sys::path::remove_dots(source, true);
+  sys::path::remove_dots(target, true);
+
+  auto endsWithPath = [](StringRef path, StringRef suffix) {
+    return path.ends_with(suffix) &&
+           (path.size() == suffix.size() ||
+            sys::path::is_separator(path[path.size() - suffix.size() - 1]));
+  };
+  return endsWithPath(source, target) || endsWithPath(target, source);
+}
+
+VulnerabilityMatcher::VulnerabilityMatcher(ArrayRef<Vulnerability> vulns,
+                                           StringRef sourceFile,
+                                           DemangleCache &demangled)
+    : numVulns(vulns.size()), demangled(demangled) {
+  StringMap<unsigned> patternIds;
+
+  for (unsigned i = 0; i < vulns.size(); i++) {
+    StringRef targetName = vulns[i].TargetFunctionName;
+    if (!fileMatches(sourceFile, vulns[i].TargetFileName)) {
+      continue;
+    }
+
+    // Empty function name matches all functions
+    if (targetName.empty()) {
+      matchAll.push_back(i);
+      continue;
+    }
+
+    // Caret/dollar anchors request exact matching
+    if (targetName.size() >= 2 && targetName.front() == '^' &&
+        targetName.back() == '$') {
+      exact[targetName.drop_front().drop_back()].push_back(i);
+      continue;
+    }
+
+    auto [it, inserted] = patternIds.try_emplace(targetName,
+                                                 substringVulns.size());
+    if (inserted) {
+      substrings.add(targetName, it->second);
+      substringVulns.emplace_back();
+    }
+    substringVulns[it->second].push_back(i);
+  }
+
+  substrings.build();
+}
+
+SmallVector<unsigned, 4> VulnerabilityMatcher::match(const Function &F) {
+  // Skip noinstrument functions
+  if (F.getMetadata("cve.noinstrument")) {
+    return {};
+  }
+
+  if (matchAll.empty() && exact.empty() && substringVulns.empty()) {
+    return {};
+  }
+
+  BitVector matched(numVulns);
+  for (unsigned i : matchAll) {
+    matched.set(i);
+  }
+
+  auto matchExact = [&](StringRef name) {
+    if (auto it = exact.find(name); it != exact.end()) {
+      for (unsigned i : it->second) {
+        matched.set(i);
+      }
+    }
+  };
+  auto matchSubstring = [&](unsigned id) {
+    for (unsigned i : substringVulns[id]) {
+      matched.set(i);
+    }
+  };
+
+  // Check the demangled name first, then fall back to the raw symbol
+  StringRef demangledName = demangled.get(F);
+  if (CVE_ASSERT_DEBUG) {
+    errs() << "[CVEAssert] Trying fn " << F.getName()
+           << " Demangled name: " << demangledName << "\n";
+  }
+
+  matchExact(demangledName);
+  substrings.search(demangledName, matchSubstring);
+  matchExact(F.getName());
+  substrings.search(F.getName(), matchSubstring);
+
+  SmallVector<unsigned, 4> result;
+  for (unsigned i : matched.set_bits()) {
+    result.push_back(i);
+  }
+  return result;
+}
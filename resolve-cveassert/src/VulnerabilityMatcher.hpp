@@ -0,0 +1,75 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+#pragma once
+
+#include "Vulnerability.hpp"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+
+#include <string>
+#include <vector>
+
+/// Demangled function names, computed once per function
+class DemangleCache {
+  llvm::DenseMap<const llvm::Function *, std::string> names;
+
+public:
+  /// Returns the demangled name of `F`, or an empty string if it is not an
+  /// Itanium mangled name. The result is only valid until the next call.
+  llvm::StringRef get(const llvm::Function &F);
+};
+
+/// Aho-Corasick automaton finding every pattern contained in a string in a
+/// single pass over it
+class SubstringAutomaton {
+  struct Node {
+    llvm::SmallDenseMap<char, unsigned, 4> next;
+    unsigned fail = 0;
+    llvm::SmallVector<unsigned, 1> outputs;
+  };
+
+  std::vector<Node> nodes = std::vector<Node>(1);
+
+public:
+  /// Adds `pattern`, reported as `id` by search
+  void add(llvm::StringRef pattern, unsigned id);
+  /// Computes the failure links. Must be called after the last add.
+  void build();
+  /// Calls `onMatch` with the id of each pattern found in `text`, once per
+  /// occurrence
+  void search(llvm::StringRef text,
+              llvm::function_ref<void(unsigned)> onMatch) const;
+};
+
+/// Matches functions against the target function names of a list of
+/// vulnerabilities at once. Exact (^name$) targets are looked up in a hash
+/// table and the remaining targets are found as substrings with one
+/// automaton. Vulnerabilities whose TargetFileName does not name the source
+/// file of the module never match.
+class VulnerabilityMatcher {
+  /// Vulnerabilities with an empty target, which match every function
+  llvm::SmallVector<unsigned, 4> matchAll;
+  /// Vulnerabilities per exact target name
+  llvm::StringMap<llvm::SmallVector<unsigned, 1>> exact;
+  /// Vulnerabilities per substring pattern id
+  std::vector<llvm::SmallVector<unsigned, 1>> substringVulns;
+  SubstringAutomaton substrings;
+  unsigned numVulns;
+  DemangleCache &demangled;
+
+public:
+  VulnerabilityMatcher(llvm::ArrayRef<Vulnerability> vulns,
+                       llvm::StringRef sourceFile, DemangleCache &demangled);
+
+  /// Returns the indices of the vulnerabilities targeting `F`, in ascending
+  /// order
+  llvm::SmallVector<unsigned, 4> match(const llvm::Function &F);
+};
@@ -0,0 +1,78 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that divisions, shifts and additions whose divisor, shift amount or
+// result is provably in range are left uninstrumented, while the others are
+// still checked. The loop counter of accumulate lives in a stack slot at -O0.
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/arith_elision.json %clang -S -emit-llvm \
+// RUN: -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@scale
+// CHECK: sanitize.div
+// CHECK-LABEL: define {{.*}}@pack
+// CHECK: sanitize.shift
+//
+// Check the per-function summaries printed in debug mode
+// RUN: CVE_ASSERT_DEBUG=1 RESOLVE_LABEL_CVE=vulnerabilities/arith_elision.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o /dev/null 2>&1 | %FileCheck %s --check-prefix=STATS
+// STATS-DAG: [CVEAssert] Divide by zero checks in scale: 1 inserted, 2 proven safe
+// STATS-DAG: [CVEAssert] Bit shift checks in pack: 1 inserted, 2 proven safe
+// STATS-DAG: [CVEAssert] Integer overflow checks in accumulate: 1 inserted, 1 proven safe
+// STATS-DAG: [CVEAssert] Instrumented 3 functions in {{.*}}arith_elision.c: 3 checks, {{.*}}, 5 checks removed
+//
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/arith_elision.json %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: %s -o %t.exe
+//
+// Test that the remediation is successful (division by zero)
+// RUN: %t.exe 0; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the remediation is successful (oversized shift)
+// RUN: %t.exe 40; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the remediation is successful (overflowing sum)
+// RUN: %t.exe 30000000; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: %t.exe 1; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 42
+
+#include <stdlib.h>
+
+int scale(int x, int n) {
+  // Constant divisors and divisors bounded away from zero need no check
+  int half = x / 2;
+  int rest = x % ((n & 7) + 1);
+  return half + rest + 40 / n;
+}
+
+unsigned pack(unsigned x, unsigned n) {
+  // Masked shift amounts are below the bit width
+  return (x << 4) | (x >> (n & 31)) | (1u << n);
+}
+
+int accumulate(int n) {
+  // The counter stays below 100, but the sum is unbounded
+  int sum = 0;
+  for (int i = 0; i < 100; ++i) {
+    sum += n;
+  }
+  return sum;
+}
+
+int main(int argc, char *argv[]) {
+  int n = atoi(argv[1]);
+  if (n > 1000000) {
+    return accumulate(n) > 0;
+  }
+  int result = scale(n * 4, n);
+  if (n > 1) {
+    return (int)pack(1, n);
+  }
+  return result;
+}
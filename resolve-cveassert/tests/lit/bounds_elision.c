@@ -0,0 +1,45 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that the constant in-bounds store is not instrumented while the
+// variable index is still checked
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/bounds_elision.json %clang -S -emit-llvm \
+// RUN: -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@read_table
+// CHECK-NOT: call void @__resolve_bound_st_
+// CHECK: call {{.*}}@__resolve_bound_ld_
+//
+// Check the per-function summary printed in debug mode
+// RUN: CVE_ASSERT_DEBUG=1 RESOLVE_LABEL_CVE=vulnerabilities/bounds_elision.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o /dev/null 2>&1 | %FileCheck %s --check-prefix=STATS
+// STATS: [CVEAssert] Bounds checks in read_table: 2 inserted, {{[0-9]+}} elided
+//
+// Test that the remediation is successful (out-of-bounds read)
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/bounds_elision.json %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 50; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/bounds_elision.json %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 2; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 42
+
+#include <stdlib.h>
+
+int table[4] = { 0 };
+
+int read_table(int idx) {
+  table[2] = 42;
+  return table[idx];
+}
+
+int main(int argc, char *argv[]) {
+  int idx = atoi(argv[1]);
+  return read_table(idx);
+}
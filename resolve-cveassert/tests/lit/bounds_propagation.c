@@ -0,0 +1,55 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that propagated bounds replace the load/store wrappers and that the
+// loop only looks up the bounds of buf once per load of the pointer
+// RUN: RESOLVE_BOUNDS_PROPAGATION=1 RESOLVE_LABEL_CVE=vulnerabilities/bounds_propagation.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@vuln
+// CHECK-NOT: call void @__resolve_bound_st_
+// CHECK: call {{.*}}@__resolve_get_bounds
+//
+// Check the per-function summary printed in debug mode
+// RUN: CVE_ASSERT_DEBUG=1 RESOLVE_BOUNDS_PROPAGATION=1 \
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/bounds_propagation.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o /dev/null 2>&1 | %FileCheck %s --check-prefix=STATS
+// STATS: [CVEAssert] Bounds checks in vuln: {{.*}}, 1 bounds lookups
+//
+// Test that the remediation is successful
+// RUN: RESOLVE_BOUNDS_PROPAGATION=1 RESOLVE_LABEL_CVE=vulnerabilities/bounds_propagation.json \
+// RUN: %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 17; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the remediation is successful with optimizations
+// RUN: RESOLVE_BOUNDS_PROPAGATION=1 RESOLVE_LABEL_CVE=vulnerabilities/bounds_propagation.json \
+// RUN: %clang -O3 -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 17; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: RESOLVE_BOUNDS_PROPAGATION=1 RESOLVE_LABEL_CVE=vulnerabilities/bounds_propagation.json \
+// RUN: %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 8; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 0
+
+#include <stdlib.h>
+
+void vuln(char *buf, int n) {
+   for (int i = 0; i < n; ++i) {
+      buf[i] = 0x69;
+   }
+}
+
+int main(int argc, char *argv[]) {
+   char tmp[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+   vuln(tmp, atoi(argv[1]));
+   return 0;
+}
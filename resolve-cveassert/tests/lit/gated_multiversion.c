@@ -0,0 +1,35 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that the gated function reads its flag once on entry and forwards
+// to an unchecked clone, with no per-check flag lookups left
+// RUN: RESOLVE_GATE_MULTIVERSION=1 RESOLVE_LABEL_CVE=vulnerabilities/gated_multiversion.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@vuln(
+// CHECK: call {{.*}}@__resolve_get_flag
+// CHECK: call {{.*}}@vuln.unchecked(
+// CHECK-NOT: call {{.*}}@__resolve_get_flag
+// CHECK: define internal {{.*}}@vuln.unchecked(
+// CHECK-NOT: call {{.*}}@__resolve_get_flag
+//
+// Test that the remediation is successful while the flag is set
+// RUN: RESOLVE_GATE_MULTIVERSION=1 RESOLVE_LABEL_CVE=vulnerabilities/gated_multiversion.json \
+// RUN: %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+
+void vuln(char *buf) {
+   for (int i = 0; i < 17; ++i) {
+      buf[i] = 0x69;
+   }
+}
+
+int main() {
+   char tmp[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+   vuln(tmp);
+   return 0;
+}
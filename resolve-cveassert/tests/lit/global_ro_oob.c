@@ -7,8 +7,9 @@
 // RUN: RESOLVE_LABEL_CVE=vulnerabilities/global_ro_oob.json %clang -S -emit-llvm \
 // RUN: -fpass-plugin=%plugin \
 // RUN: %s -o - | %FileCheck %s
+// CHECK: @__resolve_global_table = private constant {{.*}}ptr @secret,{{.*}} section "resolve_globals"
 // CHECK: @llvm.global_ctors ={{.*}}@__resolve_register_globals_ctor
-// CHECK: call void @__resolve_register_global(ptr @secret
+// CHECK: call void @__resolve_register_globals(ptr @__resolve_global_table
 //
 // Test that the remediation is successful (out-of-bounds read)
 // RUN: RESOLVE_LABEL_CVE=vulnerabilities/global_ro_oob.json %clang -O0 -g -fpass-plugin=%plugin \
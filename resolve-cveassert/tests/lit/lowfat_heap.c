@@ -0,0 +1,41 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that heap accesses test the low-fat heap before looking up bounds
+// RUN: RESOLVE_LOWFAT_HEAP=1 RESOLVE_LABEL_CVE=vulnerabilities/lowfat_heap.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@__resolve_access_ok_{{heap|generic}}
+// CHECK: load i64, ptr @__resolve_lowfat_base
+// CHECK: load i64, ptr @__resolve_lowfat_span
+// CHECK: call {{.*}}@__resolve_get_bounds
+//
+// Test that the remediation is successful
+// RUN: RESOLVE_LOWFAT_HEAP=1 RESOLVE_LABEL_CVE=vulnerabilities/lowfat_heap.json \
+// RUN: %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: RESOLVE_LOWFAT_HEAP=1 %t.exe 12; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the remediation is successful with optimizations
+// RUN: RESOLVE_LOWFAT_HEAP=1 RESOLVE_LABEL_CVE=vulnerabilities/lowfat_heap.json \
+// RUN: %clang -O3 -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: RESOLVE_LOWFAT_HEAP=1 %t.exe 12; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: RESOLVE_LOWFAT_HEAP=1 %t.exe 11; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 0
+
+#include <stdlib.h>
+
+int main(int argc, char *argv[]) {
+   // buf[12] is inside the 16 byte slot, but past the object
+   char *buf = malloc(12);
+   buf[atoi(argv[1])] = 0x69;
+   free(buf);
+   return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that the index arithmetic and loop counters of a loop nest are proven
+// not to overflow at -O0, where the counters live in stack slots, so only the
+// running sum keeps its check
+// RUN: CVE_ASSERT_DEBUG=1 RESOLVE_LABEL_CVE=vulnerabilities/overflow_loop_kernel.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o /dev/null 2>&1 | %FileCheck %s --check-prefix=STATS
+// STATS: [CVEAssert] Integer overflow checks in sum_tile: 1 inserted, 4 proven safe
+//
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/overflow_loop_kernel.json %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: %s -o %t.exe
+//
+// Test that the remediation is successful
+// RUN: %t.exe 1; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: %t.exe 0; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 42
+
+#include <limits.h>
+#include <stdlib.h>
+
+#define TILE 64
+
+int tile[TILE * TILE];
+
+int sum_tile(const int *buf) {
+  int sum = 0;
+  for (int i = 0; i < TILE; ++i) {
+    for (int j = 0; j < TILE; ++j) {
+      sum += buf[i * TILE + j];
+    }
+  }
+  return sum;
+}
+
+int main(int argc, char *argv[]) {
+  int big = atoi(argv[1]);
+  for (int k = 0; k < TILE * TILE; ++k) {
+    tile[k] = big ? INT_MAX / 2 : k % 10;
+  }
+  return sum_tile(tile) == 18420 ? 42 : 1;
+}
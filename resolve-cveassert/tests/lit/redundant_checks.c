@@ -0,0 +1,66 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that checks dominated by an earlier check of the same pointer are
+// dropped, and that the field stores share one widened bounds check
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/redundant_checks.json %clang -S -emit-llvm \
+// RUN: -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@fill_header
+// CHECK: call {{.*}}@__resolve_access_ok_{{[a-z]+}}(ptr {{.*}}, i64 12, ptr null)
+// CHECK-NOT: call {{.*}}@__resolve_bound_st_
+// CHECK: ret void
+//
+// Check the per-function summaries printed in debug mode
+// RUN: CVE_ASSERT_DEBUG=1 RESOLVE_LABEL_CVE=vulnerabilities/redundant_checks.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o /dev/null 2>&1 | %FileCheck %s --check-prefix=STATS
+// STATS-DAG: [CVEAssert] Bounds checks in fill_header: 2 inserted, {{[0-9]+}} elided, 0 hoisted to loop preheaders, 4 redundant (2 merged into wider checks)
+// STATS-DAG: [CVEAssert] Null pointer checks in sum_point: 2 inserted, 5 redundant
+//
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/redundant_checks.json %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+//
+// Test that the remediation is successful (out-of-bounds field store)
+// RUN: %t.exe 0; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the remediation is successful (null dereference)
+// RUN: %t.exe -1; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: %t.exe 14; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 42
+
+#include <stdlib.h>
+
+struct header {
+  int tag;
+  int len;
+  int crc;
+};
+
+void fill_header(struct header *h, int n) {
+  h->tag = 1;
+  h->len = n;
+  h->crc = n * 2;
+}
+
+int sum_point(struct header *h) {
+  return h->tag + h->len + h->crc;
+}
+
+int main(int argc, char *argv[]) {
+  int n = atoi(argv[1]);
+  if (n < 0) {
+    return sum_point(NULL);
+  }
+
+  // Too small for the crc field when n is 0
+  struct header *h = malloc(n ? sizeof(struct header) : 2 * sizeof(int));
+  fill_header(h, n);
+  return sum_point(h) - 1;
+}
@@ -0,0 +1,51 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that no check is dropped as redundant when a failed check falls
+// through, as it does for strategies that bounds checks instrument as continue
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/redundant_checks_sat.json %clang -S -emit-llvm \
+// RUN: -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@fill_header
+// CHECK-NOT: call {{.*}}@__resolve_access_ok_{{[a-z]+}}(ptr {{.*}}, i64 12, ptr null)
+// CHECK: ret void
+//
+// RUN: CVE_ASSERT_DEBUG=1 RESOLVE_LABEL_CVE=vulnerabilities/redundant_checks_sat.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o /dev/null 2>&1 | %FileCheck %s --check-prefix=STATS
+// STATS-DAG: [CVEAssert] Bounds checks in fill_header: {{[1-9][0-9]*}} inserted, {{[0-9]+}} elided, 0 hoisted to loop preheaders, 0 redundant (0 merged into wider checks)
+// STATS-DAG: [CVEAssert] Null pointer checks in sum_point: 7 inserted, 0 redundant
+//
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/redundant_checks_sat.json %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+//
+// Test that the normal behavior is preserved
+// RUN: %t.exe 14; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 42
+
+#include <stdlib.h>
+
+struct header {
+  int tag;
+  int len;
+  int crc;
+};
+
+void fill_header(struct header *h, int n) {
+  h->tag = 1;
+  h->len = n;
+  h->crc = n * 2;
+}
+
+int sum_point(struct header *h) {
+  return h->tag + h->len + h->crc;
+}
+
+int main(int argc, char *argv[]) {
+  int n = atoi(argv[1]);
+  struct header *h = malloc(sizeof(struct header));
+  fill_header(h, n);
+  return sum_point(h) - 1;
+}
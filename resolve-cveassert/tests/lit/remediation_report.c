@@ -0,0 +1,44 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that instrumentation is reported to a file instead of the console
+// RUN: rm -f %t.json
+// RUN: RESOLVE_REMEDIATION_REPORT=%t.json \
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/remediation_report.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o /dev/null 2>&1 | %FileCheck %s --check-prefix=LOG --allow-empty
+// LOG-NOT: [CVEAssert]
+//
+// Check the console summary in debug mode
+// RUN: CVE_ASSERT_DEBUG=1 \
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/remediation_report.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o /dev/null 2>&1 | %FileCheck %s --check-prefix=SUMMARY
+// SUMMARY: [CVEAssert] Instrumented 1 functions in {{.*}}remediation_report.c: {{[0-9]+}} checks, {{[0-9]+}} helpers
+//
+// Check the JSON report of the module
+// RUN: %FileCheck %s --check-prefix=REPORT < %t.json
+// REPORT: {"module":"{{.*}}remediation_report.c","time-ms":{{.*}},"functions":[{"name":"divide","checks":{"divide-by-zero":1},"wrappers":{{[0-9]+}},"time-ms":{{.*}}}]}
+//
+// Test that the remediation is successful
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/remediation_report.json \
+// RUN: %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 0; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: %t.exe 2; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 21
+
+#include <stdlib.h>
+
+int divide(int a, int b) {
+  return a / b;
+}
+
+int main(int argc, char *argv[]) {
+  return divide(42, atoi(argv[1]));
+}
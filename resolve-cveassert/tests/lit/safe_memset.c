@@ -8,7 +8,7 @@
 // RUN: -fpass-plugin=%plugin \
 // RUN: %s -o - | %FileCheck %s 
 // CHECK: call ptr @__resolve_memset
-// RUN: RESOLVE_LABEL_CVE=vulnerabilities/memset_oob.json %clang -O0 -g -fpass-plugin=%plugin \ 
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/safe_memset.json %clang -O0 -g -fpass-plugin=%plugin \ 
 // RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
 // RUN: %t.exe; test $? -eq 0
 
@@ -0,0 +1,44 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that the stack arrays are registered with one frame descriptor
+// RUN: RESOLVE_STACK_FRAMES=1 RESOLVE_LABEL_CVE=vulnerabilities/stack_frames.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@main
+// CHECK: %resolve.frame = alloca
+// CHECK: call void @__resolve_push_frame(ptr %resolve.frame, ptr @main.frame, i64 2)
+// CHECK-NOT: call void @__resolve_alloca
+// CHECK: call void @__resolve_pop_frame(ptr %resolve.frame
+//
+// Test that the remediation is successful
+// RUN: RESOLVE_STACK_FRAMES=1 RESOLVE_LABEL_CVE=vulnerabilities/stack_frames.json \
+// RUN: %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 16; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the remediation is successful with optimizations
+// RUN: RESOLVE_STACK_FRAMES=1 RESOLVE_LABEL_CVE=vulnerabilities/stack_frames.json \
+// RUN: %clang -O3 -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 16; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: %t.exe 15; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 0
+
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char *argv[]) {
+   char name[16];
+   char path[16];
+   memset(path, 0, sizeof(path));
+   // name[16] is the padding between name and path
+   name[atoi(argv[1])] = 0x69;
+   return path[0];
+}
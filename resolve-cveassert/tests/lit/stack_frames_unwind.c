@@ -0,0 +1,95 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that a frame is popped on every exit that leaves it on the stack
+// RUN: RESOLVE_STACK_FRAMES=1 RESOLVE_LABEL_CVE=vulnerabilities/stack_frames_unwind.json \
+// RUN: %clang -S -emit-llvm -fexceptions -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@guarded
+// CHECK: call void @__resolve_push_frame(ptr %resolve.frame, ptr @guarded.frame, i64 1)
+// CHECK: call void @__resolve_pop_frame(ptr %resolve.frame
+// CHECK-NEXT: ret
+// CHECK: call void @__resolve_pop_frame(ptr %resolve.frame
+// CHECK-NEXT: resume
+// CHECK-LABEL: define {{.*}}@forward
+// CHECK: call void @__resolve_pop_frame(ptr %resolve.frame
+// CHECK-NEXT: musttail call
+//
+// Test that frames skipped by longjmp do not hide an overflow in a later frame
+// RUN: RESOLVE_STACK_FRAMES=1 RESOLVE_LABEL_CVE=vulnerabilities/stack_frames_unwind.json \
+// RUN: %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 16; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the remediation is successful with optimizations
+// RUN: RESOLVE_STACK_FRAMES=1 RESOLVE_LABEL_CVE=vulnerabilities/stack_frames_unwind.json \
+// RUN: %clang -O3 -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 16; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: %t.exe 15; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 0
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+static jmp_buf env;
+
+static void release(char **p) { free(*p); }
+
+__attribute__((noinline)) void consume(char *buf) { buf[0] = 0; }
+
+// Unwinding through consume leaves by the resume of the cleanup
+int guarded(int n) {
+   char *owned __attribute__((cleanup(release))) = malloc(16);
+   char buf[16];
+   memset(buf, n, sizeof(buf));
+   consume(buf);
+   return buf[1];
+}
+
+__attribute__((noinline)) int step(int n) { return n - 1; }
+
+int forward(int n) {
+   char buf[16];
+   memset(buf, n, sizeof(buf));
+   __attribute__((musttail)) return step(buf[n & 15]);
+}
+
+// Jumps back to main without popping the frames of bail and descend
+__attribute__((noinline)) void bail(int depth) {
+   char scratch[64];
+   memset(scratch, depth, sizeof(scratch));
+   consume(scratch);
+   longjmp(env, 1);
+}
+
+__attribute__((noinline)) void descend(int depth) {
+   char scratch[64];
+   memset(scratch, depth, sizeof(scratch));
+   consume(scratch);
+   bail(depth + 1);
+}
+
+// Reuses the slots of the skipped frames
+__attribute__((noinline)) int probe(int i) {
+   char name[16];
+   char path[16];
+   memset(path, 0, sizeof(path));
+   // name[16] is the padding between name and path
+   name[i] = 0x69;
+   return path[0];
+}
+
+int main(int argc, char *argv[]) {
+   if (!setjmp(env)) {
+      descend(0);
+   }
+   return probe(atoi(argv[1]));
+}
@@ -0,0 +1,46 @@
+/*
+ *   Copyright (c) 2025 Riverside Research.
+ *   LGPL-3; See LICENSE.txt in the repo root for details.
+ */
+
+// Check that propagated bounds of a VLA come from its element count rather
+// than a lookup, which would run before the VLA is registered
+// RUN: RESOLVE_BOUNDS_PROPAGATION=1 RESOLVE_LABEL_CVE=vulnerabilities/vla_propagation.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o - | %FileCheck %s
+// CHECK-LABEL: define {{.*}}@example
+// CHECK-NOT: call {{.*}}@__resolve_get_bounds
+// CHECK: call void @__resolve_alloca
+// CHECK-NOT: call {{.*}}@__resolve_get_bounds
+// CHECK: ret
+//
+// RUN: CVE_ASSERT_DEBUG=1 RESOLVE_BOUNDS_PROPAGATION=1 \
+// RUN: RESOLVE_LABEL_CVE=vulnerabilities/vla_propagation.json \
+// RUN: %clang -S -emit-llvm -fpass-plugin=%plugin \
+// RUN: %s -o /dev/null 2>&1 | %FileCheck %s --check-prefix=STATS
+// STATS: [CVEAssert] Bounds checks in example: {{.*}}, 0 bounds lookups
+//
+// Test that the remediation is successful
+// RUN: RESOLVE_BOUNDS_PROPAGATION=1 RESOLVE_LABEL_CVE=vulnerabilities/vla_propagation.json \
+// RUN: %clang -O0 -g -fpass-plugin=%plugin \
+// RUN: -L%rlib -lresolve -Wl,-rpath=%rlib %s -o %t.exe
+// RUN: %t.exe 6; EXIT_CODE=$?; \
+// RUN: echo Remediated exit: $EXIT_CODE; test $EXIT_CODE -eq 3
+//
+// Test that the normal behavior is preserved
+// RUN: %t.exe 5; EXIT_CODE=$?; \
+// RUN: echo Normal exit: $EXIT_CODE; test $EXIT_CODE -eq 8
+
+#include <stdlib.h>
+
+int example(int n, int last) {
+  int arr[n];
+  for (int i = 0; i < last; ++i) {
+    arr[i] = i;
+  }
+  return arr[n - 1] * 2 + arr[0];
+}
+
+int main(int argc, char *argv[]) {
+  return example(5, atoi(argv[1]));
+}
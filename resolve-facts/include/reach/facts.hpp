@@ -103,3 +103,39 @@ load_log_from_file(const std::filesystem::path &path) {
   return j.template get<log>();
 }
 } // namespace dlsym
+
+// Indirect call target profile from dynamic analysis, for weighting
+// IndirectCall edges by the targets seen at runtime.
+namespace icall_profile {
+struct target {
+  std::optional<NamespacedNodeId> function; // facts id, if known
+  std::optional<std::string> symbol;        // else the dynamic symbol
+  uint64_t count = 0;
+};
+
+struct site {
+  NamespacedNodeId site; // call instruction
+  std::vector<target> targets;
+  uint64_t overflow = 0; // calls whose target did not fit the cache
+};
+
+struct profile {
+  std::vector<site> sites;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(target, function, symbol,
+                                                count);
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(site, site, targets, overflow);
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(profile, sites);
+
+inline std::optional<profile>
+load_profile_from_file(const std::filesystem::path &path) {
+  std::ifstream f(path);
+  if (!f.is_open()) {
+    return {};
+  }
+  nlohmann::json j;
+  f >> j;
+  return j.template get<profile>();
+}
+} // namespace icall_profile
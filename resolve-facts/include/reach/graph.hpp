@@ -21,6 +21,10 @@ namespace graph {
 // edges is 1.0.
 constexpr double INDIRECT_WEIGHT = 1000000.0;
 
+// Weight assigned to indirect calls to targets observed in an indirect
+// call profile.
+constexpr double PROFILED_INDIRECT_WEIGHT = 1.0;
+
 enum class EdgeType {
   DirectCall,
   IndirectCall,
@@ -57,9 +61,14 @@ struct T {
 // no duplicate nodes in edge lists).
 bool wf(const E &g);
 
+// If [profile] is given, indirect call sites it covers get cheap edges
+// to their observed targets. Other candidates are kept at
+// INDIRECT_WEIGHT only if the site overflowed its target cache, and
+// dropped otherwise.
 T build_from_program_facts(
     const resolve_facts::ProgramFacts &pf, bool dynlink,
-    const std::optional<std::vector<dlsym::loaded_symbol>> &loaded_syms);
+    const std::optional<std::vector<dlsym::loaded_symbol>> &loaded_syms,
+    const std::optional<icall_profile::profile> &profile = {});
 
 constexpr reach_facts::LoadOptions SIMPLE_LOAD_OPTIONS =
     reach_facts::LoadOptions::Contains | reach_facts::LoadOptions::Calls |
@@ -87,11 +87,21 @@ map_loaded_symbols_to_ids(const database &db,
   return loaded_ids;
 }
 
-T graph::build_from_program_facts(const ProgramFacts &pf, bool dynlink,
-                                  const optional<vector<symbol>> &loaded_syms) {
+T graph::build_from_program_facts(
+    const ProgramFacts &pf, bool dynlink,
+    const optional<vector<symbol>> &loaded_syms,
+    const optional<icall_profile::profile> &profile) {
 
   T g;
 
+  // Profiled indirect call sites
+  NodeMap<const icall_profile::site *> profiled_sites;
+  if (profile.has_value()) {
+    for (const auto &site : profile->sites) {
+      profiled_sites.emplace(site.site, &site);
+    }
+  }
+
   // adapted from build_cfg
   // Need to be able to look up triple (bb -> instr -> call)
   NodeMap<NNodeId> calls;
@@ -186,10 +196,47 @@ T graph::build_from_program_facts(const ProgramFacts &pf, bool dynlink,
         continue;
       }
 
+      // Else indirect. If the site was profiled, its observed targets
+      // are cheap. Observed externals are linked to every definition
+      // of the same name, which is the same function at runtime.
+      std::unordered_set<NNodeId, resolve_facts::pair_hash> observed;
+      const auto site_it = profiled_sites.find(instr);
+      if (site_it != profiled_sites.end()) {
+        for (const auto &t : site_it->second->targets) {
+          std::optional<string> name = t.symbol;
+          if (t.function.has_value() && pf.containsNode(*t.function)) {
+            const auto &fn = *t.function;
+            g.addEdge(fn, bb, EdgeType::IndirectCall,
+                      PROFILED_INDIRECT_WEIGHT);
+            observed.emplace(fn);
+            if (pf.getNode(fn).linkage == Linkage::ExternalLinkage) {
+              name = pf.getNode(fn).name;
+            }
+          }
+          if (name.has_value() && externs_by_name.contains(*name)) {
+            for (const auto &h : externs_by_name.at(*name)) {
+              if (!observed.contains(h)) {
+                g.addEdge(h, bb, EdgeType::ExternIndirectCall,
+                          PROFILED_INDIRECT_WEIGHT);
+                observed.emplace(h);
+              }
+            }
+          }
+        }
+
+        // Every target called at this site was recorded, so the static
+        // candidates below are infeasible for this execution.
+        if (site_it->second->overflow == 0) {
+          continue;
+        }
+      }
+
       if (address_taken_by_sig.contains(*n.function_type)) {
-        // Else indirect. Add edges for all compatible address-taken functions.
+        // Add edges for all compatible address-taken functions.
         for (const auto &fn : address_taken_by_sig.at(*n.function_type)) {
-          g.addEdge(fn, bb, EdgeType::IndirectCall, INDIRECT_WEIGHT);
+          if (!observed.contains(fn)) {
+            g.addEdge(fn, bb, EdgeType::IndirectCall, INDIRECT_WEIGHT);
+          }
         }
       }
 
@@ -202,7 +249,8 @@ T graph::build_from_program_facts(const ProgramFacts &pf, bool dynlink,
             const auto &n2 = pf.getNode(h);
             if (n2.type == NodeType::Function &&
                 n2.function_type == n.function_type &&
-                (!loaded_syms.has_value() || loaded_ids.contains(h))) {
+                (!loaded_syms.has_value() || loaded_ids.contains(h)) &&
+                !observed.contains(h)) {
               g.addEdge(h, bb, EdgeType::ExternIndirectCall, INDIRECT_WEIGHT);
             }
           }
@@ -34,6 +34,7 @@ struct config {
   bool dynlink = false;
   std::optional<std::filesystem::path> out_path = {};
   std::optional<std::filesystem::path> dlsym_log_path = {};
+  std::optional<std::filesystem::path> indirect_profile_path = {};
   std::string graph_type = "";
   std::optional<size_t> num_paths = {};
   bool validate_facts = false;
@@ -47,6 +48,7 @@ NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(candidate_node, file,
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(config, facts_path, queries,
                                                 candidate_path, dynlink,
                                                 out_path, dlsym_log_path,
+                                                indirect_profile_path,
                                                 graph_type, num_paths,
                                                 validate_facts, verbose);
 
@@ -60,6 +60,9 @@ conf::config load_config(const argparse::ArgumentParser &program) {
     if (program.present<string>("dlsym-log")) {
       conf.dlsym_log_path = program.present<string>("dlsym-log");
     }
+    if (program.present<string>("indirect-profile")) {
+      conf.indirect_profile_path = program.present<string>("indirect-profile");
+    }
     if (program.present<string>("graph")) {
       conf.graph_type = program.get<string>("graph");
     } else if (conf.graph_type == "") {
@@ -120,6 +123,19 @@ build_loaded_syms(const optional<fs::path> &path) {
   }
 }
 
+optional<icall_profile::profile>
+build_indirect_profile(const optional<fs::path> &path) {
+  if (!path.has_value()) {
+    return {};
+  }
+  const auto profile = icall_profile::load_profile_from_file(path.value());
+  if (!profile.has_value()) {
+    cerr << "WARNING: could not open indirect call profile " << path.value()
+         << endl;
+  }
+  return profile;
+}
+
 void validate_config(const conf::config &conf) {
   if (!fs::exists(conf.facts_path)) {
     cerr << "CONFIG ERROR: facts_path " << conf.facts_path << " doesn't exist."
@@ -147,6 +163,9 @@ int main(int argc, char *argv[]) {
       .flag();
   program.add_argument("-ds", "--dlsym-log")
       .help("path to file containing dlsym log of loaded symbols");
+  program.add_argument("-ip", "--indirect-profile")
+      .help("path to indirect call profile used to weight indirect call "
+            "edges");
   program.add_argument("-g", "--graph")
       .help("graph type (\"simple\", \"cfg\", or \"call\"). Default \"cfg\"");
   program.add_argument("-p", "--path")
@@ -177,13 +196,16 @@ int main(int argc, char *argv[]) {
   }
   validate_config(conf);
   const auto loaded_syms = build_loaded_syms(conf.dlsym_log_path);
+  const auto indirect_profile =
+      build_indirect_profile(conf.indirect_profile_path);
 
   // Execute reachability queries.
   // First, build graph.
 
   typedef graph::T (*graph_builder)(
       const resolve_facts::ProgramFacts &, bool,
-      const optional<vector<dlsym::loaded_symbol>> &);
+      const optional<vector<dlsym::loaded_symbol>> &,
+      const optional<icall_profile::profile> &);
 
   const unordered_map<string, graph_builder> graph_builders = {
       {"cfg", graph::build_from_program_facts},
@@ -215,7 +237,8 @@ int main(int argc, char *argv[]) {
 
   t0 = system_clock::now();
   const auto g =
-      graph_builders.at(conf.graph_type)(pf, conf.dynlink, loaded_syms);
+      graph_builders.at(conf.graph_type)(pf, conf.dynlink, loaded_syms,
+                                         indirect_profile);
   duration<double> graph_build_time = system_clock::now() - t0;
 
   if (conf.verbose) {